@@ -0,0 +1,75 @@
+#include "bench_runner.h++"
+#include "util/json.h++"
+#include <numeric>
+
+using std::string, std::string_view;
+
+namespace Ludwig {
+
+auto BenchResult::full_name() const -> string {
+  string out = name;
+  for (const auto& [k, v] : params) fmt::format_to(std::back_inserter(out), "/{}={}", k, v);
+  return out;
+}
+
+auto BenchResult::percentile(double p) const -> uint64_t {
+  if (samples_ns.empty()) return 0;
+  return samples_ns[std::min(samples_ns.size() - 1, (size_t)(p * (double)samples_ns.size()))];
+}
+
+auto BenchRunner::selected(string_view name, const BenchParams& params) const -> bool {
+  if (options.filter.empty()) return true;
+  return BenchResult{ .name = string(name), .params = params }.full_name().contains(options.filter);
+}
+
+auto BenchRunner::record(BenchResult&& result) -> void {
+  std::sort(result.samples_ns.begin(), result.samples_ns.end());
+  spdlog::info("{}{}: {:d} iterations, median {:.1f}µs, p99 {:.1f}µs",
+    result.full_name(),
+    result.threads > 1 ? fmt::format(" ({:d} threads)", result.threads) : "",
+    result.samples_ns.size(),
+    (double)result.percentile(0.5) / 1000.0,
+    (double)result.percentile(0.99) / 1000.0
+  );
+  results.push_back(std::move(result));
+}
+
+static inline auto json_string(string_view s, string& out) -> void {
+  JsonSerialize<string_view>::to_json(s, out);
+}
+
+auto BenchRunner::to_json(string_view metadata) const -> string {
+  string out = R"({"metadata":)";
+  out += metadata;
+  out += R"(,"results":[)";
+  bool first = true;
+  for (const auto& r : results) {
+    if (!first) out.push_back(',');
+    first = false;
+    out += R"({"name":)";
+    json_string(r.name, out);
+    out += R"(,"params":{)";
+    for (size_t i = 0; i < r.params.size(); i++) {
+      if (i) out.push_back(',');
+      json_string(r.params[i].first, out);
+      out.push_back(':');
+      json_string(r.params[i].second, out);
+    }
+    const auto n = r.samples_ns.size();
+    const auto total = std::accumulate(r.samples_ns.begin(), r.samples_ns.end(), (uint64_t)0);
+    fmt::format_to(std::back_inserter(out),
+      R"(}},"threads":{:d},"iterations":{:d},"wall_ns":{:d},"ops_per_sec":{:.1f},)"
+      R"("mean_ns":{:d},"min_ns":{:d},"p50_ns":{:d},"p90_ns":{:d},"p99_ns":{:d},"max_ns":{:d}}})",
+      r.threads, n, r.wall_ns,
+      r.wall_ns ? (double)n * 1e9 / (double)r.wall_ns : 0.0,
+      n ? total / n : 0,
+      n ? r.samples_ns.front() : 0,
+      r.percentile(0.5), r.percentile(0.9), r.percentile(0.99),
+      n ? r.samples_ns.back() : 0
+    );
+  }
+  out += "]}\n";
+  return out;
+}
+
+}
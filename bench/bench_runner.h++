@@ -0,0 +1,121 @@
+#pragma once
+#include "util/common.h++"
+#include <thread>
+
+namespace Ludwig {
+
+struct BenchOptions {
+  // Each benchmark runs for at least this long, and at least min_iterations
+  // times, unless it reaches max_iterations first
+  std::chrono::milliseconds min_time = std::chrono::milliseconds(1000);
+  size_t min_iterations = 10, max_iterations = 1'000'000;
+  // If not empty, only benchmarks whose full name (see BenchResult::full_name)
+  // contains this are run
+  std::string filter;
+};
+
+using BenchParams = std::vector<std::pair<std::string, std::string>>;
+
+struct BenchResult {
+  std::string name;
+  BenchParams params;
+  size_t threads;
+  uint64_t wall_ns;
+  // Time taken by each call, sorted
+  std::vector<uint64_t> samples_ns;
+
+  // Like "list_board_threads/sort=Hot"
+  auto full_name() const -> std::string;
+  auto percentile(double p) const -> uint64_t;
+};
+
+// Keeps the compiler from optimizing away a benchmark's work
+static inline auto do_not_optimize(size_t n) -> void {
+  asm volatile("" : : "r"(n) : "memory");
+}
+
+// Times benchmark functions and collects the results, which can be written as
+// JSON. A benchmark function does one unit of work (one page of a listing, one
+// request, one transaction) and returns something that depends on its result,
+// such as a count or a length.
+class BenchRunner {
+private:
+  BenchOptions options;
+  std::vector<BenchResult> results;
+
+  auto selected(std::string_view name, const BenchParams& params) const -> bool;
+  auto record(BenchResult&& result) -> void;
+public:
+  BenchRunner(BenchOptions options) : options(options) {}
+
+  // Calls `fn()` repeatedly, on the calling thread, after one warmup call
+  template <typename Fn>
+  auto run(std::string name, BenchParams params, Fn&& fn) -> void {
+    using namespace std::chrono;
+    if (!selected(name, params)) return;
+    do_not_optimize(fn());
+    std::vector<uint64_t> samples;
+    const auto start = steady_clock::now();
+    auto now = start;
+    while (samples.size() < options.max_iterations &&
+        (samples.size() < options.min_iterations || now - start < options.min_time)) {
+      const auto t0 = now;
+      do_not_optimize(fn());
+      now = steady_clock::now();
+      samples.push_back((uint64_t)duration_cast<nanoseconds>(now - t0).count());
+    }
+    record({
+      .name = std::move(name),
+      .params = std::move(params),
+      .threads = 1,
+      .wall_ns = (uint64_t)duration_cast<nanoseconds>(now - start).count(),
+      .samples_ns = std::move(samples)
+    });
+  }
+
+  // Calls `fn(thread_index)` repeatedly on `threads` threads at once, to
+  // measure throughput under contention
+  template <typename Fn>
+  auto run_concurrent(std::string name, BenchParams params, size_t threads, Fn&& fn) -> void {
+    using namespace std::chrono;
+    if (!selected(name, params)) return;
+    std::vector<std::vector<uint64_t>> thread_samples(threads);
+    std::vector<std::thread> running;
+    std::atomic<size_t> ready = 0;
+    const auto per_thread_max = std::max<size_t>(1, options.max_iterations / threads);
+    steady_clock::time_point start;
+    for (size_t t = 0; t < threads; t++) {
+      running.emplace_back([&, t] {
+        do_not_optimize(fn(t));
+        // Start timing once every thread has warmed up
+        if (ready.fetch_add(1) + 1 == threads) start = steady_clock::now();
+        while (ready.load() < threads) std::this_thread::yield();
+        auto& samples = thread_samples[t];
+        auto now = steady_clock::now();
+        const auto deadline = now + options.min_time;
+        while (samples.size() < per_thread_max && (samples.size() < options.min_iterations || now < deadline)) {
+          const auto t0 = now;
+          do_not_optimize(fn(t));
+          now = steady_clock::now();
+          samples.push_back((uint64_t)duration_cast<nanoseconds>(now - t0).count());
+        }
+      });
+    }
+    for (auto& th : running) th.join();
+    const auto wall_ns = (uint64_t)duration_cast<nanoseconds>(steady_clock::now() - start).count();
+    std::vector<uint64_t> samples;
+    for (auto& s : thread_samples) samples.insert(samples.end(), s.begin(), s.end());
+    record({
+      .name = std::move(name),
+      .params = std::move(params),
+      .threads = threads,
+      .wall_ns = wall_ns,
+      .samples_ns = std::move(samples)
+    });
+  }
+
+  // `metadata` is a JSON object describing the instance and build
+  auto to_json(std::string_view metadata) const -> std::string;
+};
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "bench_runner.h++"
+#include "instance_generator.h++"
+#include "services/lmdb_search_engine.h++"
+#include "controllers/board_controller.h++"
+#include "controllers/post_controller.h++"
+#include "controllers/search_controller.h++"
+#include "controllers/session_controller.h++"
+#include "controllers/site_controller.h++"
+#include "controllers/user_controller.h++"
+
+namespace Ludwig {
+
+struct BenchInstance {
+  std::shared_ptr<DB> db;
+  std::shared_ptr<LmdbSearchEngine> search_engine;
+  std::shared_ptr<SiteController> site;
+  std::shared_ptr<UserController> users;
+  std::shared_ptr<BoardController> boards;
+  std::shared_ptr<PostController> posts;
+  std::shared_ptr<SearchController> search;
+  std::shared_ptr<SessionController> sessions;
+  std::shared_ptr<FirstRunController> first_run;
+  GeneratedInstance data;
+};
+
+// Every PostController::list_* sort, and comment trees for each comment sort
+auto bench_listings(BenchRunner& runner, BenchInstance& instance) -> void;
+// markdown_to_rich_text and rich_text_to_html, on a sample of comments
+auto bench_rich_text(BenchRunner& runner, BenchInstance& instance) -> void;
+// LmdbSearchEngine::search, for common and rare terms, in each sort
+auto bench_search(BenchRunner& runner, BenchInstance& instance) -> void;
+// Queued write transactions (DB::open_write_txn) from several threads at once
+auto bench_writes(BenchRunner& runner, BenchInstance& instance) -> void;
+// Full HTTP requests to webapp and API pages, from a server on a local port
+auto bench_http(BenchRunner& runner, BenchInstance& instance) -> void;
+
+}
@@ -0,0 +1,265 @@
+#include "instance_generator.h++"
+#include "util/rich_text.h++"
+#include <cmath>
+#include <random>
+
+using flatbuffers::FlatBufferBuilder, std::shared_ptr, std::string, std::string_view, std::vector;
+
+namespace Ludwig {
+
+static constexpr string_view WORDS[] = {
+  "the", "of", "and", "to", "in", "is", "that", "it", "for", "was", "on", "with", "as", "this", "but", "not",
+  "panda", "forum", "server", "thread", "comment", "board", "garden", "library", "compiler", "river", "mountain",
+  "coffee", "keyboard", "history", "weather", "election", "recipe", "bicycle", "telescope", "archive", "festival",
+  "question", "answer", "update", "release", "benchmark", "database", "network", "protocol", "federation",
+  "moderator", "community", "photograph", "language", "kernel", "migration", "workshop", "chess", "violin",
+  "quasar", "zeppelin", "marmalade", "obsidian", "lighthouse", "saxophone", "tundra", "origami", "xylophone"
+};
+
+class ContentGenerator {
+  std::mt19937_64 gen;
+public:
+  ContentGenerator(uint64_t seed) : gen(seed) {}
+
+  auto below(uint64_t n) -> uint64_t {
+    return std::uniform_int_distribution<uint64_t>(0, n - 1)(gen);
+  }
+
+  auto chance(double p) -> bool {
+    return std::bernoulli_distribution(p)(gen);
+  }
+
+  // Picks from [0, n), heavily weighted toward the start; `skew` = 1 is uniform
+  auto skewed(uint64_t n, double skew) -> uint64_t {
+    const double u = std::uniform_real_distribution<double>(0, 1)(gen);
+    return std::min(n - 1, (uint64_t)(std::pow(u, skew) * (double)n));
+  }
+
+  auto word() -> string_view {
+    // Zipf-like, so that some search terms are much more common than others
+    return WORDS[skewed(std::size(WORDS), 2.5)];
+  }
+
+  auto sentence(size_t min_words, size_t max_words) -> string {
+    string out;
+    const auto n = min_words + below(max_words - min_words + 1);
+    for (size_t i = 0; i < n; i++) {
+      if (i) out.push_back(' ');
+      out += word();
+    }
+    if (!out.empty()) out[0] = (char)toupper(out[0]);
+    return out;
+  }
+
+  // Mostly plain paragraphs, with some of each kind of Markdown the renderer
+  // handles specially
+  auto markdown(size_t paragraphs) -> string {
+    string out;
+    for (size_t p = 0; p < paragraphs; p++) {
+      if (p) out += "\n\n";
+      switch (below(10)) {
+        case 0:
+          for (size_t i = 0; i < 3; i++) fmt::format_to(std::back_inserter(out), "- {}\n", sentence(2, 6));
+          break;
+        case 1:
+          fmt::format_to(std::back_inserter(out), "> {}.", sentence(6, 20));
+          break;
+        case 2:
+          fmt::format_to(std::back_inserter(out), "```\n{}\n```", sentence(3, 8));
+          break;
+        default:
+          for (size_t i = 0, n = 1 + below(4); i < n; i++) {
+            if (i) out.push_back(' ');
+            switch (below(8)) {
+              case 0: fmt::format_to(std::back_inserter(out), "**{}** {}.", word(), sentence(3, 12)); break;
+              case 1: fmt::format_to(std::back_inserter(out), "{} _{}_.", sentence(3, 12), word()); break;
+              case 2: fmt::format_to(std::back_inserter(out), "{} `{}`.", sentence(3, 12), word()); break;
+              case 3: fmt::format_to(std::back_inserter(out), "See [{}](https://{}.example.test/{}).", word(), word(), below(1000)); break;
+              case 4: fmt::format_to(std::back_inserter(out), "{} :{}:", sentence(3, 12), word()); break;
+              default: fmt::format_to(std::back_inserter(out), "{}.", sentence(4, 16));
+            }
+          }
+      }
+    }
+    return out;
+  }
+};
+
+// Commits and reopens the transaction every `BATCH` records, so that no
+// single transaction gets too large
+static constexpr size_t BATCH = 10000;
+
+template <typename Fn>
+static auto in_batches(DB& db, size_t n, string_view what, Fn fn) -> void {
+  spdlog::info("Generating {:d} {}", n, what);
+  for (size_t start = 0; start < n; start += BATCH) {
+    auto txn = db.open_write_txn_sync();
+    for (size_t i = start; i < std::min(n, start + BATCH); i++) fn(txn, i);
+    txn.commit();
+  }
+}
+
+auto generate_instance(
+  shared_ptr<DB> db,
+  shared_ptr<FirstRunController> first_run,
+  const InstanceOptions& options
+) -> GeneratedInstance {
+  assert(options.users > 0 && options.boards > 0 && options.threads > 0);
+  ContentGenerator g(options.seed);
+  GeneratedInstance out;
+  FlatBufferBuilder fbb;
+  const auto now = now_s();
+  static constexpr uint64_t MAX_AGE = 60 * 60 * 24 * 30;
+
+  first_run->first_run_setup(db->open_write_txn_sync(), {
+    .base_url = "http://ludwig.test",
+    .default_board_name = "main",
+    .admin_name = "admin",
+    .admin_password = "password"
+  });
+  {
+    auto txn = db->open_read_txn();
+    out.subscriber = txn.get_user_id_by_name("admin").value();
+  }
+
+  in_batches(*db, options.users, "users", [&](WriteTxn& txn, size_t i) {
+    fbb.Clear();
+    const auto name = fbb.CreateString(fmt::format("user{:d}", i));
+    flatbuffers::Offset<flatbuffers::String> bio_raw = 0;
+    flatbuffers::Offset<flatbuffers::Vector<RichText>> bio_type = 0;
+    flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<void>>> bio = 0;
+    if (g.chance(0.3)) {
+      const auto text = g.markdown(1);
+      bio_raw = fbb.CreateString(text);
+      std::tie(bio_type, bio) = markdown_to_rich_text(fbb, text);
+    }
+    UserBuilder user(fbb);
+    user.add_name(name);
+    user.add_created_at(now - MAX_AGE - g.below(MAX_AGE));
+    user.add_salt((uint32_t)g.below(UINT32_MAX));
+    if (!bio_raw.IsNull()) {
+      user.add_bio_raw(bio_raw);
+      user.add_bio_type(bio_type);
+      user.add_bio(bio);
+    }
+    fbb.Finish(user.Finish());
+    out.users.push_back(txn.create_user(fbb.GetBufferSpan()));
+  });
+
+  in_batches(*db, options.boards, "boards", [&](WriteTxn& txn, size_t i) {
+    fbb.Clear();
+    const auto name = fbb.CreateString(fmt::format("board{:d}", i));
+    const auto description_text = g.markdown(2);
+    const auto description_raw = fbb.CreateString(description_text);
+    const auto [description_type, description] = markdown_to_rich_text(fbb, description_text);
+    BoardBuilder board(fbb);
+    board.add_name(name);
+    board.add_created_at(now - MAX_AGE - g.below(MAX_AGE));
+    board.add_description_raw(description_raw);
+    board.add_description_type(description_type);
+    board.add_description(description);
+    fbb.Finish(board.Finish());
+    const auto id = txn.create_board(fbb.GetBufferSpan());
+    fbb.Clear();
+    LocalBoardBuilder local_board(fbb);
+    local_board.add_owner(out.subscriber);
+    fbb.Finish(local_board.Finish());
+    txn.set_local_board(id, fbb.GetBufferSpan());
+    out.boards.push_back(id);
+  });
+
+  const auto n_subscriptions = std::min(options.subscriptions, options.boards);
+  in_batches(*db, options.users + 1, "subscription lists", [&](WriteTxn& txn, size_t i) {
+    for (size_t j = 0; j < n_subscriptions; j++) {
+      // The subscriber gets exactly `subscriptions` boards, spread evenly
+      if (i == options.users) txn.set_subscription(out.subscriber, out.boards[j * options.boards / n_subscriptions], true);
+      else txn.set_subscription(out.users[i], out.boards[g.skewed(options.boards, 2)], true);
+    }
+  });
+
+  vector<uint64_t> thread_times, board_thread_counts(options.boards, 0), user_post_counts(options.users, 0);
+  in_batches(*db, options.threads, "threads", [&](WriteTxn& txn, size_t i) {
+    fbb.Clear();
+    const auto author = g.skewed(options.users, 2), board = g.skewed(options.boards, 3);
+    const auto created_at = now - g.below(MAX_AGE);
+    const auto [title_type, title] = plain_text_to_rich_text(fbb, g.sentence(3, 12));
+    flatbuffers::Offset<flatbuffers::String> content_url = 0, content_text_raw = 0;
+    flatbuffers::Offset<flatbuffers::Vector<RichText>> content_text_type = 0;
+    flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<void>>> content_text = 0;
+    if (g.chance(0.5)) {
+      content_url = fbb.CreateString(fmt::format("https://{}.example.test/{:d}", g.word(), i));
+    } else {
+      const auto text = g.markdown(1 + g.below(4));
+      content_text_raw = fbb.CreateString(text);
+      std::tie(content_text_type, content_text) = markdown_to_rich_text(fbb, text);
+    }
+    ThreadBuilder thread(fbb);
+    thread.add_author(out.users[author]);
+    thread.add_board(out.boards[board]);
+    thread.add_title_type(title_type);
+    thread.add_title(title);
+    thread.add_created_at(created_at);
+    thread.add_salt((uint32_t)g.below(UINT32_MAX));
+    if (!content_url.IsNull()) thread.add_content_url(content_url);
+    if (!content_text_raw.IsNull()) {
+      thread.add_content_text_raw(content_text_raw);
+      thread.add_content_text_type(content_text_type);
+      thread.add_content_text(content_text);
+    }
+    fbb.Finish(thread.Finish());
+    out.threads.push_back(txn.create_thread(fbb.GetBufferSpan()));
+    thread_times.push_back(created_at);
+    board_thread_counts[board]++;
+    user_post_counts[author]++;
+  });
+
+  // Each thread's comments, as (id, created_at), so replies can pick a parent
+  vector<vector<std::pair<uint64_t, uint64_t>>> thread_comments(options.threads);
+  in_batches(*db, options.comments, "comments", [&](WriteTxn& txn, size_t i) {
+    fbb.Clear();
+    const auto thread = g.skewed(options.threads, 3), author = g.skewed(options.users, 2);
+    auto& siblings = thread_comments[thread];
+    uint64_t parent = out.threads[thread], parent_time = thread_times[thread];
+    if (!siblings.empty() && g.chance(0.65)) {
+      std::tie(parent, parent_time) = siblings[g.below(siblings.size())];
+    }
+    const auto created_at = parent_time + g.below(std::max<uint64_t>(1, now - parent_time));
+    const auto text = g.markdown(1 + g.skewed(4, 2));
+    const auto content_raw = fbb.CreateString(text);
+    const auto [content_type, content] = markdown_to_rich_text(fbb, text);
+    CommentBuilder comment(fbb);
+    comment.add_author(out.users[author]);
+    comment.add_parent(parent);
+    comment.add_thread(out.threads[thread]);
+    comment.add_created_at(created_at);
+    comment.add_salt((uint32_t)g.below(UINT32_MAX));
+    comment.add_content_raw(content_raw);
+    comment.add_content_type(content_type);
+    comment.add_content(content);
+    fbb.Finish(comment.Finish());
+    const auto id = txn.create_comment(fbb.GetBufferSpan());
+    out.comments.push_back(id);
+    siblings.emplace_back(id, created_at);
+    user_post_counts[author]++;
+  });
+
+  in_batches(*db, options.votes, "votes", [&](WriteTxn& txn, size_t) {
+    const auto user = out.users[g.below(options.users)];
+    const auto post = out.comments.empty() || g.chance(0.4)
+      ? out.threads[g.skewed(options.threads, 3)]
+      : out.comments[g.below(out.comments.size())];
+    txn.set_vote(user, post, g.chance(0.8) ? Vote::Upvote : Vote::Downvote);
+  });
+
+  const auto max_index = [](const auto& v) {
+    return (size_t)std::distance(v.begin(), std::max_element(v.begin(), v.end()));
+  };
+  out.busiest_board = out.boards[max_index(board_thread_counts)];
+  out.busiest_user = out.users[max_index(user_post_counts)];
+  vector<size_t> comment_counts;
+  for (const auto& c : thread_comments) comment_counts.push_back(c.size());
+  out.busiest_thread = out.threads[max_index(comment_counts)];
+  return out;
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "db/db.h++"
+#include "controllers/first_run_controller.h++"
+
+namespace Ludwig {
+
+struct InstanceOptions {
+  size_t users = 2000, boards = 200, threads = 20000, comments = 200000, votes = 500000,
+    subscriptions = 20; // per user
+  uint64_t seed = 42;
+};
+
+struct GeneratedInstance {
+  std::vector<uint64_t> users, boards, threads, comments;
+  // A local user, subscribed to `subscriptions` boards, for the Home feed
+  uint64_t subscriber;
+  // The board with the most threads, the thread with the most comments, and
+  // the user with the most posts
+  uint64_t busiest_board, busiest_thread, busiest_user;
+};
+
+// Fills an empty database with a synthetic instance: users, boards, threads
+// with Markdown or link content, comment trees, votes, and subscriptions.
+//
+// Boards, threads, and authors are picked with a skewed distribution, so that
+// a few of each are much busier than the rest, like on a real instance. The
+// same options (and the same build) always produce the same instance, except
+// that timestamps are relative to the current time.
+auto generate_instance(
+  std::shared_ptr<DB> db,
+  std::shared_ptr<FirstRunController> first_run,
+  const InstanceOptions& options
+) -> GeneratedInstance;
+
+}
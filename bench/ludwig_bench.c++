@@ -0,0 +1,164 @@
+#include "benchmarks.h++"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include <filesystem>
+#include <optparse.h>
+#include <unistd.h>
+
+using namespace Ludwig;
+using std::make_shared, std::stoull, std::string;
+
+// Removes the generated database files at exit, unless they were named with --db
+struct GeneratedFiles {
+  std::vector<std::filesystem::path> paths;
+  ~GeneratedFiles() {
+    std::error_code ec;
+    for (const auto& p : paths) {
+      std::filesystem::remove(p, ec);
+      std::filesystem::remove(p.string() + "-lock", ec);
+    }
+  }
+};
+
+int main(int argc, char** argv) {
+  auto parser = optparse::OptionParser()
+    .version(string(VERSION))
+    .description("Generates a synthetic Ludwig instance and benchmarks it; writes results as JSON");
+  parser.add_option("--users").dest("users").type("INT").set_default(2000);
+  parser.add_option("--boards").dest("boards").type("INT").set_default(200);
+  parser.add_option("--threads").dest("threads").type("INT").set_default(20000);
+  parser.add_option("--comments").dest("comments").type("INT").set_default(200000);
+  parser.add_option("--votes").dest("votes").type("INT").set_default(500000);
+  parser.add_option("--subscriptions")
+    .dest("subscriptions")
+    .type("INT")
+    .help("boards each user subscribes to (default = 20)")
+    .set_default(20);
+  parser.add_option("--seed")
+    .dest("seed")
+    .type("INT")
+    .help("random seed; the same seed always generates the same instance (default = 42)")
+    .set_default(42);
+  parser.add_option("--db")
+    .dest("db")
+    .type("FILE.mdb")
+    .help("database filename, must not exist yet, and is kept afterward (default = a temporary file)");
+  parser.add_option("-s", "--map-size")
+    .dest("map_size")
+    .type("INT")
+    .help("maximum database size, in MiB; also applies to the search db (default = 4096)")
+    .set_default(4096);
+  parser.add_option("--write-batch")
+    .dest("write_batch")
+    .type("INT")
+    .help("max queued database writes to commit together, as in ludwig --write-batch (default = 1)")
+    .set_default(1);
+  parser.add_option("-o", "--output")
+    .dest("output")
+    .type("FILE.json")
+    .help(R"(where to write results; "-" is stdout (default = -))")
+    .set_default("-");
+  parser.add_option("-f", "--filter")
+    .dest("filter")
+    .help(R"(only run benchmarks whose full name contains this, e.g. "list_board_threads/sort=Hot")")
+    .set_default("");
+  parser.add_option("--min-time-ms")
+    .dest("min_time_ms")
+    .type("INT")
+    .help("minimum time to run each benchmark, in milliseconds (default = 1000)")
+    .set_default(1000);
+  parser.add_option("--log-level")
+    .dest("log_level")
+    .help("log level (debug, info, warn, error, critical)")
+    .set_default("info");
+  parser.add_help_option();
+
+  const optparse::Values options = parser.parse_args(argc, argv);
+  // stdout may be the JSON output, so logs go to stderr
+  spdlog::set_default_logger(spdlog::stderr_color_mt("ludwig_bench"));
+  spdlog::set_level(spdlog::level::from_str(options["log_level"]));
+
+  const InstanceOptions instance_options {
+    .users = std::max(1ULL, stoull(options["users"])),
+    .boards = std::max(1ULL, stoull(options["boards"])),
+    .threads = std::max(1ULL, stoull(options["threads"])),
+    .comments = stoull(options["comments"]),
+    .votes = stoull(options["votes"]),
+    .subscriptions = stoull(options["subscriptions"]),
+    .seed = stoull(options["seed"])
+  };
+  const auto map_size = stoull(options["map_size"]);
+  const WriteBatchOptions write_batch { .max_txns = std::max(1ULL, stoull(options["write_batch"])) };
+
+  GeneratedFiles generated;
+  std::filesystem::path dbfile, searchfile;
+  if (options.is_set_by_user("db")) {
+    dbfile = options["db"].c_str();
+    searchfile = dbfile;
+    searchfile.replace_extension(".search.mdb");
+    if (std::filesystem::exists(dbfile) || std::filesystem::exists(searchfile)) {
+      spdlog::critical("{} or {} already exists; the benchmark needs a new database", dbfile.string(), searchfile.string());
+      return EXIT_FAILURE;
+    }
+  } else {
+    const auto tmp = std::filesystem::temp_directory_path();
+    dbfile = tmp / fmt::format("ludwig-bench-{:d}.mdb", getpid());
+    searchfile = tmp / fmt::format("ludwig-bench-{:d}.search.mdb", getpid());
+    generated.paths = { dbfile, searchfile };
+  }
+
+  BenchInstance instance;
+  try {
+    instance.db = make_shared<DB>(dbfile.c_str(), map_size, false, write_batch);
+    instance.search_engine = make_shared<LmdbSearchEngine>(searchfile, map_size);
+  } catch (const std::runtime_error& e) {
+    spdlog::critical("Could not open database: {}", e.what());
+    return EXIT_FAILURE;
+  }
+  instance.site = make_shared<SiteController>(instance.db);
+  instance.boards = make_shared<BoardController>(instance.site);
+  instance.users = make_shared<UserController>(instance.site);
+  instance.posts = make_shared<PostController>(instance.site);
+  instance.search = make_shared<SearchController>(instance.db, instance.search_engine);
+  instance.sessions = make_shared<SessionController>(instance.db, instance.site, instance.users);
+  instance.first_run = make_shared<FirstRunController>(instance.users, instance.boards, instance.site);
+
+  const auto generate_start = std::chrono::steady_clock::now();
+  instance.data = generate_instance(instance.db, instance.first_run, instance_options);
+  spdlog::info("Indexing for search");
+  instance.search->index_all();
+  instance.search_engine->set_reindex_required(false);
+  const auto generate_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - generate_start).count();
+  spdlog::info("Generated instance in {:.1f}s", generate_s);
+
+  BenchRunner runner({
+    .min_time = std::chrono::milliseconds(stoull(options["min_time_ms"])),
+    .filter = options["filter"]
+  });
+  bench_listings(runner, instance);
+  bench_rich_text(runner, instance);
+  bench_search(runner, instance);
+  bench_http(runner, instance);
+  // Last, because it changes the instance
+  bench_writes(runner, instance);
+
+  const auto metadata = fmt::format(
+    R"({{"version":"{}","timestamp":{:d},"seed":{:d},"users":{:d},"boards":{:d},"threads":{:d},)"
+    R"("comments":{:d},"votes":{:d},"subscriptions":{:d},"write_batch":{:d},"generate_s":{:.3f}}})",
+    VERSION, now_s(), instance_options.seed, instance_options.users, instance_options.boards,
+    instance_options.threads, instance_options.comments, instance_options.votes,
+    instance_options.subscriptions, write_batch.max_txns, generate_s
+  );
+  const auto json = runner.to_json(metadata);
+  if (options["output"] == "-") {
+    fwrite(json.data(), 1, json.size(), stdout);
+  } else {
+    std::unique_ptr<FILE, int(*)(FILE*)> f(fopen(options["output"].c_str(), "wb"), &fclose);
+    if (f == nullptr) {
+      spdlog::critical("Could not open {}: {}", options["output"], strerror(errno));
+      return EXIT_FAILURE;
+    }
+    fwrite(json.data(), 1, json.size(), f.get());
+    spdlog::info("Results written to {}", options["output"]);
+  }
+  return EXIT_SUCCESS;
+}
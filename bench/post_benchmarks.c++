@@ -0,0 +1,115 @@
+#include "benchmarks.h++"
+#include "models/local_user.h++"
+#include "util/rich_text.h++"
+#include "views/webapp/html/html_rich_text.h++"
+
+using flatbuffers::FlatBufferBuilder, std::string, std::vector;
+
+namespace Ludwig {
+
+// The number of entries on one page of the webapp
+static constexpr size_t PAGE_SIZE = 20;
+
+template <typename Gen>
+static auto first_page(Gen gen) -> size_t {
+  size_t n = 0;
+  for (const auto& e : gen) {
+    do_not_optimize(e.id);
+    if (++n >= PAGE_SIZE) break;
+  }
+  return n;
+}
+
+auto bench_listings(BenchRunner& runner, BenchInstance& instance) -> void {
+  auto& db = *instance.db;
+  auto& posts = *instance.posts;
+  const auto& data = instance.data;
+  static const std::optional<LocalUserDetail> logged_out;
+
+  for (const auto sort : EnumValuesSortType()) {
+    const BenchParams params { {"sort", EnumNameSortType(sort)} };
+    runner.run("list_board_threads", params, [&] {
+      auto txn = db.open_read_txn();
+      PageCursor cursor;
+      return first_page(posts.list_board_threads(txn, cursor, data.busiest_board, sort, logged_out));
+    });
+    runner.run("list_board_comments", params, [&] {
+      auto txn = db.open_read_txn();
+      PageCursor cursor;
+      return first_page(posts.list_board_comments(txn, cursor, data.busiest_board, sort, logged_out));
+    });
+    for (const auto [feed, feed_name] : {
+      std::pair(PostController::FEED_ALL, "all"),
+      std::pair(PostController::FEED_LOCAL, "local"),
+      std::pair(PostController::FEED_HOME, "home")
+    }) {
+      BenchParams feed_params { {"feed", feed_name}, {"sort", EnumNameSortType(sort)} };
+      runner.run("list_feed_threads", feed_params, [&] {
+        auto txn = db.open_read_txn();
+        const auto login = LocalUserDetail::get_login(txn, std::optional(data.subscriber));
+        PageCursor cursor;
+        return first_page(posts.list_feed_threads(txn, cursor, feed, sort, login));
+      });
+      runner.run("list_feed_comments", feed_params, [&] {
+        auto txn = db.open_read_txn();
+        const auto login = LocalUserDetail::get_login(txn, std::optional(data.subscriber));
+        PageCursor cursor;
+        return first_page(posts.list_feed_comments(txn, cursor, feed, sort, login));
+      });
+    }
+  }
+
+  for (const auto sort : EnumValuesUserPostSortType()) {
+    const BenchParams params { {"sort", EnumNameUserPostSortType(sort)} };
+    runner.run("list_user_threads", params, [&] {
+      auto txn = db.open_read_txn();
+      PageCursor cursor;
+      return first_page(posts.list_user_threads(txn, cursor, data.busiest_user, sort, logged_out));
+    });
+    runner.run("list_user_comments", params, [&] {
+      auto txn = db.open_read_txn();
+      PageCursor cursor;
+      return first_page(posts.list_user_comments(txn, cursor, data.busiest_user, sort, logged_out));
+    });
+  }
+
+  for (const auto sort : EnumValuesCommentSortType()) {
+    for (const uint16_t limit : {20, 200}) {
+      runner.run("comment_tree", { {"sort", EnumNameCommentSortType(sort)}, {"limit", std::to_string(limit)} }, [&] {
+        auto txn = db.open_read_txn();
+        CommentTree tree;
+        posts.thread_detail(txn, tree, data.busiest_thread, sort, logged_out, {}, limit);
+        return tree.size();
+      });
+    }
+  }
+}
+
+auto bench_rich_text(BenchRunner& runner, BenchInstance& instance) -> void {
+  static constexpr size_t SAMPLES = 1000;
+  const auto& comments = instance.data.comments;
+  if (comments.empty()) return;
+  auto txn = instance.db->open_read_txn();
+  vector<const Comment*> sample;
+  for (size_t i = 0; i < SAMPLES; i++) {
+    if (const auto c = txn.get_comment(comments[i * comments.size() / SAMPLES % comments.size()])) {
+      sample.push_back(&c->get());
+    }
+  }
+
+  // Each call handles the next comment in the sample, round-robin
+  size_t i = 0;
+  runner.run("markdown_to_rich_text", {}, [&] {
+    const auto& c = *sample[i++ % sample.size()];
+    FlatBufferBuilder fbb;
+    markdown_to_rich_text(fbb, c.content_raw()->string_view());
+    return (size_t)fbb.GetSize();
+  });
+  const ToHtmlOptions opts;
+  runner.run("rich_text_to_html", {}, [&] {
+    const auto& c = *sample[i++ % sample.size()];
+    return rich_text_to_html(c.content_type(), c.content(), opts).length();
+  });
+}
+
+}
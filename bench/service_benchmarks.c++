@@ -0,0 +1,163 @@
+#include "benchmarks.h++"
+#include "controllers/dump_controller.h++"
+#include "controllers/lemmy_api_controller.h++"
+#include "services/asio_http_client.h++"
+#include "services/rich_text_cache.h++"
+#include "views/webapp/routes.h++"
+#include "views/lemmy_api_routes.h++"
+#include <future>
+#include <random>
+
+using std::make_shared, std::promise, std::string, std::vector;
+
+namespace Ludwig {
+
+auto bench_search(BenchRunner& runner, BenchInstance& instance) -> void {
+  if (!instance.search_engine) return;
+  // Common words are in most posts; rare words are at the end of the generator's word list
+  static constexpr std::pair<std::string_view, const char*> QUERIES[] = {
+    {"the", "common"},
+    {"forum server", "common_pair"},
+    {"xylophone", "rare"},
+    {"origami xylophone", "rare_pair"}
+  };
+  static constexpr std::pair<SearchResultSort, const char*> SORTS[] = {
+    {SearchResultSort::Relevant, "Relevant"},
+    {SearchResultSort::Top, "Top"},
+    {SearchResultSort::New, "New"}
+  };
+  for (const auto& [query, query_name] : QUERIES) {
+    for (const auto& [sort, sort_name] : SORTS) {
+      runner.run("search", { {"query", query_name}, {"sort", sort_name} }, [&] {
+        promise<size_t> result;
+        auto future = result.get_future();
+        instance.search_engine->search({
+          .query = query,
+          .include_users = true,
+          .include_boards = true,
+          .include_threads = true,
+          .include_comments = true,
+          .include_cws = true,
+          .sort = sort,
+          .board_id = 0,
+          .offset = 0,
+          .limit = 20
+        })->on_complete([&](auto results) { result.set_value(results.size()); });
+        return future.get();
+      });
+    }
+  }
+}
+
+auto bench_writes(BenchRunner& runner, BenchInstance& instance) -> void {
+  const auto& data = instance.data;
+  for (const size_t threads : {1, 4, 16}) {
+    vector<std::mt19937_64> gens;
+    for (size_t t = 0; t < threads; t++) gens.emplace_back(t);
+    // Each call waits for its turn in the write queue, votes, commits, and
+    // then waits for its batch to be committed, as a request handler does
+    runner.run_concurrent("write_txn_vote", { {"threads", std::to_string(threads)} }, threads, [&](size_t t) {
+      auto& gen = gens[t];
+      const auto user = data.users[gen() % data.users.size()],
+        post = data.threads[gen() % data.threads.size()];
+      promise<WriteTxn> queued;
+      auto future = queued.get_future();
+      instance.db->open_write_txn()->on_complete([&](WriteTxn txn) { queued.set_value(std::move(txn)); });
+      std::shared_ptr<CompletableOnce<bool>> committed;
+      {
+        auto txn = future.get();
+        txn.set_vote(user, post, gen() % 2 ? Vote::Upvote : Vote::Downvote);
+        committed = txn.commit();
+      }
+      promise<bool> done;
+      auto done_future = done.get_future();
+      committed->on_complete([&](bool ok) { done.set_value(ok); });
+      if (!done_future.get()) throw std::runtime_error("Vote was not committed");
+      return t;
+    });
+  }
+}
+
+auto bench_http(BenchRunner& runner, BenchInstance& instance) -> void {
+  auto dump_c = make_shared<DumpController>();
+  auto rich_text_cache = make_shared<RichTextCache>(64 * MiB);
+  auto api_c = make_shared<Lemmy::ApiController>(
+    instance.site, instance.users, instance.sessions, instance.boards, instance.posts, instance.search, instance.first_run
+  );
+
+  // One server thread, like IntegrationTest; requests are not rate limited
+  struct Server { uWS::Loop* loop; uWS::App* app; uint16_t port; };
+  promise<Server> server_promise;
+  auto server_future = server_promise.get_future();
+  std::thread server_thread([&] {
+    uWS::App app;
+    define_webapp_routes(
+      app,
+      instance.db,
+      instance.site,
+      instance.sessions,
+      instance.posts,
+      instance.boards,
+      instance.users,
+      instance.search,
+      instance.first_run,
+      dump_c,
+      nullptr,
+      rich_text_cache
+    );
+    Lemmy::define_api_routes(app, instance.db, api_c);
+    app.listen("127.0.0.1", 0, [&](auto* listen_socket) {
+      const int port = listen_socket ? us_socket_local_port(false, (us_socket_t*)listen_socket) : 0;
+      if (port > 0) {
+        server_promise.set_value({ uWS::Loop::get(), &app, (uint16_t)port });
+        return;
+      }
+      try { throw std::runtime_error("Could not create benchmark server"); }
+      catch (...) { server_promise.set_exception(std::current_exception()); }
+    }).run();
+  });
+  Server server;
+  try { server = server_future.get(); }
+  catch (const std::runtime_error& e) {
+    spdlog::error("Skipping HTTP benchmarks: {}", e.what());
+    server_thread.join();
+    return;
+  }
+
+  string board_name, user_name;
+  {
+    auto txn = instance.db->open_read_txn();
+    board_name = txn.get_board(instance.data.busiest_board)->get().name()->str();
+    user_name = txn.get_user(instance.data.busiest_user)->get().name()->str();
+  }
+  const std::pair<string, string> pages[] = {
+    {"home", "/"},
+    {"board", fmt::format("/b/{}", board_name)},
+    {"thread", fmt::format("/thread/{:x}", instance.data.busiest_thread)},
+    {"user", fmt::format("/u/{}", user_name)},
+    {"api_post_list", "/api/v3/post/list?sort=Hot&limit=20"}
+  };
+
+  {
+    AsioThreadPool client_pool(2);
+    AsioHttpClient http(client_pool.io, UINT32_MAX, UnsafeHttps::UNSAFE, UnsafeLocalRequests::UNSAFE);
+    const auto base_url = fmt::format("http://127.0.0.1:{:d}", server.port);
+    for (const auto& [page, path] : pages) {
+      const auto url = base_url + path;
+      if (const auto rsp = http.get(url).dispatch_and_wait(); rsp->status() != 200) {
+        spdlog::error("Skipping HTTP benchmark for {}: got status {:d}", path, rsp->status());
+        continue;
+      }
+      for (const size_t threads : {1, 8}) {
+        runner.run_concurrent("http_get", { {"page", page}, {"threads", std::to_string(threads)} }, threads, [&](size_t) {
+          return http.get(url).dispatch_and_wait()->body().size();
+        });
+      }
+    }
+  }
+
+  server.loop->defer([app = server.app] { app->close(); });
+  server_thread.join();
+}
+
+}
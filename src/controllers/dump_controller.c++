@@ -1,25 +1,121 @@
 #include "dump_controller.h++"
 #include "search_controller.h++"
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <parallel_hashmap/phmap.h>
 #include <zstd.h>
 
-using std::copy, std::make_unique, std::runtime_error, std::shared_ptr, std::span, std::string_view, std::unique_ptr;
+using std::copy, std::exception, std::exception_ptr, std::make_shared, std::make_unique, std::max,
+    std::min, std::mutex, std::optional, std::runtime_error, std::shared_ptr, std::span,
+    std::string_view, std::thread, std::unique_lock, std::unique_ptr, std::vector,
+    flatbuffers::FlatBufferBuilder, flatbuffers::GetRoot;
 
 namespace Ludwig {
 
-auto DumpController::import_dump(
-  const char* db_filename,
-  FILE* zstd_dump_file,
-  size_t file_size,
-  std::shared_ptr<SearchEngine> search,
-  size_t map_size_mb
-) -> void {
-  unique_ptr<ZSTD_DCtx, void(*)(ZSTD_DCtx*)> dctx(ZSTD_createDCtx(), [](auto* c) { ZSTD_freeDCtx(c); });
-  if (dctx == nullptr) throw runtime_error("zstd init failed");
+// Bounded queue between the stages of the dump import/export pipelines. Once
+// closed, push fails and pop returns the remaining items (unless discarded),
+// then nullopt.
+template <typename T> class PipelineQueue {
+private:
+  mutex lock;
+  std::condition_variable not_empty, not_full;
+  std::deque<T> items;
+  size_t capacity;
+  bool closed = false;
+public:
+  PipelineQueue(size_t capacity) : capacity(capacity) {}
+
+  auto push(T item) -> bool {
+    unique_lock<mutex> g(lock);
+    not_full.wait(g, [&] { return closed || items.size() < capacity; });
+    if (closed) return false;
+    items.push_back(std::move(item));
+    not_empty.notify_one();
+    return true;
+  }
+
+  auto pop() -> optional<T> {
+    unique_lock<mutex> g(lock);
+    not_empty.wait(g, [&] { return closed || !items.empty(); });
+    if (items.empty()) return {};
+    T item = std::move(items.front());
+    items.pop_front();
+    not_full.notify_one();
+    return item;
+  }
+
+  auto close(bool discard = false) -> void {
+    {
+      std::lock_guard<mutex> g(lock);
+      closed = true;
+      if (discard) items.clear();
+    }
+    not_empty.notify_all();
+    not_full.notify_all();
+  }
+};
+
+static constexpr auto PROGRESS_INTERVAL = std::chrono::seconds(5);
+
+// Logs throughput of an import or export every PROGRESS_INTERVAL
+class DumpProgress {
+private:
+  string_view verb;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now(), last_log = start;
+public:
+  DumpProgress(string_view verb) : verb(verb) {}
+
+  auto update(size_t bytes, size_t records, optional<double> fraction = {}, bool force = false) -> void {
+    const auto now = std::chrono::steady_clock::now();
+    if (!force && now - last_log < PROGRESS_INTERVAL) return;
+    last_log = now;
+    const double seconds = max(std::chrono::duration<double>(now - start).count(), 0.001);
+    const double mib = (double)bytes / (double)MiB;
+    spdlog::info("{} {}{:.1f} MiB, {} records ({:.1f} MiB/s, {:.0f} records/s)",
+      verb,
+      fraction ? fmt::format("{:.1f}%, ", 100.0 * *fraction) : "",
+      mib, records, mib / seconds, (double)records / seconds
+    );
+  }
+};
+
+static inline auto pipeline_workers() -> size_t {
+  return max<size_t>(1, thread::hardware_concurrency() / 2);
+}
+
+// Dump entries are copied into batches at this alignment, so that
+// FlatBuffers scalars are never read unaligned
+static constexpr size_t IMPORT_ENTRY_ALIGN = 8;
+static constexpr size_t IMPORT_BATCH_SIZE = 1 * MiB;
+
+struct ImportBatch {
+  vector<uint8_t> data;
+  vector<std::pair<size_t, size_t>> ranges;
+  // Filled in by a verifier thread before `verified` is set
+  vector<const Dump*> entries;
+  std::promise<void> verified;
+};
+
+// Decompresses a zstd dump file; `read` fills a buffer with the next N bytes
+class DumpReader {
+private:
+  FILE* file;
+  unique_ptr<ZSTD_DCtx, void(*)(ZSTD_DCtx*)> dctx;
   const size_t in_buf_size = ZSTD_DStreamInSize(), out_buf_size = ZSTD_DStreamOutSize();
-  const auto in_buf = make_unique<uint8_t[]>(in_buf_size), out_buf = make_unique<uint8_t[]>(out_buf_size);
-  size_t out_pos = 0, out_max = 0, total_read = 0;
+  const unique_ptr<uint8_t[]> in_buf = make_unique<uint8_t[]>(in_buf_size), out_buf = make_unique<uint8_t[]>(out_buf_size);
+  size_t out_pos = 0, out_max = 0;
   ZSTD_inBuffer input { in_buf.get(), 0, 0 };
-  auto db = DB::import(db_filename, [&](uint8_t* buf, size_t expected) -> size_t {
+public:
+  std::atomic<size_t> compressed_bytes = 0;
+
+  DumpReader(FILE* file) : file(file), dctx(ZSTD_createDCtx(), [](auto* c) { ZSTD_freeDCtx(c); }) {
+    if (dctx == nullptr) throw runtime_error("zstd init failed");
+  }
+
+  auto read(uint8_t* buf, size_t expected) -> size_t {
     uint8_t* buf_offset = buf;
     size_t remaining_expected = expected;
     do {
@@ -35,10 +131,9 @@ auto DumpController::import_dump(
         remaining_expected -= remaining_available;
       }
       if (input.pos >= input.size) {
-        const size_t bytes = fread(in_buf.get(), 1, in_buf_size, zstd_dump_file);
+        const size_t bytes = fread(in_buf.get(), 1, in_buf_size, file);
         if (!bytes) return expected - remaining_expected;
-        total_read += bytes;
-        spdlog::info("{:.2f}%", 100.0 * ((double)total_read / (double)file_size));
+        compressed_bytes.fetch_add(bytes, std::memory_order_relaxed);
         input = { in_buf.get(), bytes, 0 };
       }
       ZSTD_outBuffer output { out_buf.get(), out_buf_size, 0 };
@@ -48,34 +143,261 @@ auto DumpController::import_dump(
       out_max = output.pos;
     } while (remaining_expected);
     return expected;
+  }
+
+  // Reads entries until the batch reaches IMPORT_BATCH_SIZE; returns nullptr at EOF
+  auto read_batch() -> shared_ptr<ImportBatch> {
+    auto batch = make_shared<ImportBatch>();
+    batch->data.reserve(IMPORT_BATCH_SIZE + DUMP_ENTRY_MAX_SIZE);
+    uint8_t prefix[4];
+    while (batch->data.size() < IMPORT_BATCH_SIZE && read(prefix, 4) == 4) {
+      const auto len = flatbuffers::GetSizePrefixedBufferLength(prefix);
+      if (len > DUMP_ENTRY_MAX_SIZE) {
+        throw runtime_error(fmt::format("DB dump entry is larger than max of {}MiB", DUMP_ENTRY_MAX_SIZE / MiB));
+      } else if (len < 4) {
+        throw runtime_error("DB dump entry is less than 4 bytes; this shouldn't be possible");
+      }
+      const size_t offset = (batch->data.size() + IMPORT_ENTRY_ALIGN - 1) & ~(IMPORT_ENTRY_ALIGN - 1);
+      batch->data.resize(offset + len);
+      copy(prefix, prefix + 4, batch->data.data() + offset);
+      if (len > 4 && read(batch->data.data() + offset + 4, len - 4) != len - 4) {
+        throw runtime_error("Did not read the expected number of bytes (truncated DB dump entry?)");
+      }
+      batch->ranges.emplace_back(offset, len);
+    }
+    return batch->ranges.empty() ? nullptr : batch;
+  }
+};
+
+// Adds imported entries to the search index, in dump order. Comments are
+// indexed against a copy of their thread that keeps only the fields a
+// SearchEngine filters on (board and content warning), so that every thread
+// in the dump doesn't have to be kept in memory.
+class DumpIndexer {
+private:
+  SearchEngine& search;
+  phmap::flat_hash_map<uint64_t, std::pair<uint64_t, bool>> threads;
+  FlatBufferBuilder fbb;
+public:
+  size_t indexed = 0;
+
+  DumpIndexer(SearchEngine& search) : search(search) {}
+
+  auto index(const Dump& entry) noexcept -> void {
+    const auto data = entry.data()->data();
+    try {
+      switch (entry.type()) {
+        case DumpType::User:
+          search.index(entry.id(), *GetRoot<User>(data));
+          break;
+        case DumpType::Board:
+          search.index(entry.id(), *GetRoot<Board>(data));
+          break;
+        case DumpType::Thread: {
+          const auto& thread = *GetRoot<Thread>(data);
+          search.index(entry.id(), thread);
+          threads.emplace(entry.id(), std::pair(
+            thread.board(), thread.content_warning() && thread.content_warning()->size()
+          ));
+          break;
+        }
+        case DumpType::Comment: {
+          const auto& comment = *GetRoot<Comment>(data);
+          const auto thread_it = threads.find(comment.thread());
+          if (thread_it == threads.end()) {
+            spdlog::warn("Comment {:x} is in unknown thread {:x}, not adding to search index", entry.id(), comment.thread());
+            return;
+          }
+          const auto [board, cw] = thread_it->second;
+          fbb.Clear();
+          const auto cw_str = cw ? fbb.CreateString("cw") : flatbuffers::Offset<flatbuffers::String>();
+          ThreadBuilder t(fbb);
+          t.add_board(board);
+          if (cw) t.add_content_warning(cw_str);
+          fbb.Finish(t.Finish());
+          search.index(entry.id(), comment, *GetRoot<Thread>(fbb.GetBufferPointer()));
+          break;
+        }
+        default:
+          return;
+      }
+      indexed++;
+    } catch (const exception& e) {
+      spdlog::warn("Error adding {} {:x} to search index: {}", EnumNameDumpType(entry.type()), entry.id(), e.what());
+    }
+  }
+};
+
+auto DumpController::import_dump(
+  const char* db_filename,
+  FILE* zstd_dump_file,
+  size_t file_size,
+  std::shared_ptr<SearchEngine> search,
+  size_t map_size_mb
+) -> void {
+  // Pipeline: one thread reads and decompresses batches of entries, worker
+  // threads verify them, this thread writes them to the database in dump
+  // order, and (if search is enabled) one more thread indexes them.
+  DumpReader reader(zstd_dump_file);
+  const size_t workers = pipeline_workers();
+  PipelineQueue<shared_ptr<ImportBatch>> to_verify(workers * 2), to_write(workers * 2), to_index(64);
+  exception_ptr reader_error;
+  vector<thread> threads;
+  Defer join_all([&] {
+    to_verify.close(true);
+    to_write.close(true);
+    to_index.close(true);
+    for (auto& th : threads) if (th.joinable()) th.join();
+  });
+  threads.emplace_back([&] {
+    try {
+      while (auto batch = reader.read_batch()) {
+        // Writer order is fixed here, before verification can reorder batches
+        if (!to_write.push(batch) || !to_verify.push(batch)) break;
+      }
+    } catch (...) {
+      reader_error = std::current_exception();
+    }
+    to_verify.close();
+    to_write.close();
+  });
+  for (size_t i = 0; i < workers; i++) {
+    threads.emplace_back([&] {
+      while (auto batch = to_verify.pop()) {
+        auto& b = **batch;
+        try {
+          b.entries.reserve(b.ranges.size());
+          for (const auto [offset, len] : b.ranges) {
+            b.entries.push_back(&DB::verify_dump_entry({b.data.data() + offset, len}));
+          }
+          b.verified.set_value();
+        } catch (...) {
+          b.verified.set_exception(std::current_exception());
+        }
+      }
+    });
+  }
+  size_t indexed = 0;
+  if (search) {
+    threads.emplace_back([&] {
+      DumpIndexer indexer(*search);
+      while (auto batch = to_index.pop()) {
+        for (const auto* entry : (*batch)->entries) indexer.index(*entry);
+      }
+      indexed = indexer.indexed;
+    });
+  }
+
+  DumpProgress progress("Imported");
+  size_t bytes = 0, records = 0;
+  shared_ptr<ImportBatch> current;
+  auto db = DB::import_batched(db_filename, [&]() -> std::span<const Dump* const> {
+    if (current) {
+      bytes += current->data.size();
+      records += current->entries.size();
+      progress.update(bytes, records, (double)reader.compressed_bytes.load(std::memory_order_relaxed) / (double)max<size_t>(file_size, 1));
+      if (search) to_index.push(std::move(current));
+      current = nullptr;
+    }
+    auto next = to_write.pop();
+    if (!next) {
+      if (reader_error) std::rethrow_exception(reader_error);
+      return {};
+    }
+    current = std::move(*next);
+    current->verified.get_future().get();
+    return current->entries;
   }, map_size_mb);
-  if (search) SearchController(db, search).index_all();
+  progress.update(bytes, records, 1.0, true);
+
+  if (search) {
+    spdlog::info("Waiting for search indexing to finish");
+    to_index.close();
+    for (auto& th : threads) if (th.joinable()) th.join();
+    // Karma comes from votes, which follow all of the posts in the dump
+    auto txn = db->open_read_txn();
+    for (const auto thread : txn.list_threads_old()) {
+      if (const auto stats = txn.get_post_stats(thread); stats && stats->get().karma()) {
+        search->update_karma(thread, SearchResultType::Thread, stats->get().karma());
+      }
+    }
+    for (const auto comment : txn.list_comments_old()) {
+      if (const auto stats = txn.get_post_stats(comment); stats && stats->get().karma()) {
+        search->update_karma(comment, SearchResultType::Comment, stats->get().karma());
+      }
+    }
+    spdlog::info("Added {} records to search index", indexed);
+  }
 }
 
-  auto DumpController::export_dump(ReadTxn& txn) -> std::generator<span<uint8_t>> {
-    unique_ptr<ZSTD_CCtx, void(*)(ZSTD_CCtx*)> cctx(ZSTD_createCCtx(), [](auto* c) { ZSTD_freeCCtx(c); });
-    if (cctx == nullptr) throw runtime_error("zstd init failed");
-    const size_t in_buf_size = ZSTD_CStreamInSize(), out_buf_size = ZSTD_CStreamOutSize();
-    auto in_buf = make_unique<uint8_t[]>(in_buf_size), out_buf = make_unique<uint8_t[]>(out_buf_size);
-    size_t in_pos = 0;
-    for (auto span : txn.dump()) {
-      assert(span.size() <= in_buf_size);
-      if (in_pos + span.size() > in_buf_size) {
-        ZSTD_inBuffer input = { in_buf.get(), in_pos, 0 };
-        do {
-          ZSTD_outBuffer output = { out_buf.get(), out_buf_size, 0 };
-          ZSTD_compressStream2(cctx.get(), &output, &input, ZSTD_e_continue);
-          co_yield std::span{out_buf.get(), output.pos};
-        } while (input.pos < input.size);
-        in_pos = 0;
+// Uncompressed bytes per chunk handed from the dump thread to the compressor;
+// must be at least DUMP_ENTRY_MAX_SIZE
+static constexpr size_t EXPORT_CHUNK_SIZE = 4 * MiB;
+
+auto DumpController::export_dump(DB& db) -> std::generator<span<uint8_t>> {
+  unique_ptr<ZSTD_CCtx, void(*)(ZSTD_CCtx*)> cctx(ZSTD_createCCtx(), [](auto* c) { ZSTD_freeCCtx(c); });
+  if (cctx == nullptr) throw runtime_error("zstd init failed");
+  // Compression runs on zstd's own worker threads, if zstd was built with
+  // multithreading support; otherwise this fails and compression stays inline
+  if (const auto err = ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_nbWorkers, (int)pipeline_workers()); ZSTD_isError(err)) {
+    spdlog::debug("Multithreaded zstd compression is not available: {}", ZSTD_getErrorName(err));
+  }
+
+  // The read txn is opened on the dump thread, since LMDB transactions
+  // can't move between threads
+  PipelineQueue<vector<uint8_t>> chunks(4);
+  exception_ptr dump_error;
+  std::atomic<size_t> records = 0;
+  thread dumper([&] {
+    try {
+      auto txn = db.open_read_txn();
+      vector<uint8_t> chunk;
+      chunk.reserve(EXPORT_CHUNK_SIZE);
+      for (auto entry : txn.dump()) {
+        if (chunk.size() + entry.size() > EXPORT_CHUNK_SIZE) {
+          if (!chunks.push(std::move(chunk))) return;
+          chunk = {};
+          chunk.reserve(EXPORT_CHUNK_SIZE);
+        }
+        chunk.insert(chunk.end(), entry.begin(), entry.end());
+        records.fetch_add(1, std::memory_order_relaxed);
       }
-      copy(span.begin(), span.end(), in_buf.get() + in_pos);
-      in_pos += span.size();
+      if (!chunk.empty()) chunks.push(std::move(chunk));
+    } catch (...) {
+      dump_error = std::current_exception();
     }
-    ZSTD_inBuffer input = { in_buf.get(), in_pos, 0 };
-    ZSTD_outBuffer output = { out_buf.get(), out_buf_size, 0 };
-    const auto remaining = ZSTD_compressStream2(cctx.get(), &output, &input, ZSTD_e_end);
-    co_yield span{out_buf.get(), output.pos};
-    assert(remaining == 0);
+    chunks.close();
+  });
+  Defer join([&] {
+    chunks.close(true);
+    dumper.join();
+  });
+
+  DumpProgress progress("Exported");
+  const size_t out_buf_size = ZSTD_CStreamOutSize();
+  const auto out_buf = make_unique<uint8_t[]>(out_buf_size);
+  size_t bytes = 0;
+  while (auto chunk = chunks.pop()) {
+    ZSTD_inBuffer input { chunk->data(), chunk->size(), 0 };
+    do {
+      ZSTD_outBuffer output { out_buf.get(), out_buf_size, 0 };
+      const auto ret = ZSTD_compressStream2(cctx.get(), &output, &input, ZSTD_e_continue);
+      if (ZSTD_isError(ret)) throw runtime_error(ZSTD_getErrorName(ret));
+      if (output.pos) co_yield span{out_buf.get(), output.pos};
+    } while (input.pos < input.size);
+    bytes += chunk->size();
+    progress.update(bytes, records.load(std::memory_order_relaxed));
   }
+  if (dump_error) std::rethrow_exception(dump_error);
+  ZSTD_inBuffer input { nullptr, 0, 0 };
+  size_t remaining;
+  do {
+    ZSTD_outBuffer output { out_buf.get(), out_buf_size, 0 };
+    remaining = ZSTD_compressStream2(cctx.get(), &output, &input, ZSTD_e_end);
+    if (ZSTD_isError(remaining)) throw runtime_error(ZSTD_getErrorName(remaining));
+    if (output.pos) co_yield span{out_buf.get(), output.pos};
+  } while (remaining);
+  progress.update(bytes, records.load(std::memory_order_relaxed), {}, true);
+}
+
 }
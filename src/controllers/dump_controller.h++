@@ -6,6 +6,8 @@ namespace Ludwig {
 
 class DumpController {
 public:
+  // Imports a zstd-compressed dump into a new database file, decompressing,
+  // verifying, writing, and (if `search` is set) indexing on separate threads.
   static auto import_dump(
     const char* db_filename,
     FILE* zstd_dump_file,
@@ -14,7 +16,9 @@ public:
     size_t map_size_mb = 1024
   ) -> void;
 
-  auto export_dump(ReadTxn& txn) -> std::generator<std::span<uint8_t>>;
+  // Yields a zstd-compressed dump of a snapshot of `db`. The dump is read on a
+  // separate thread, and compressed with multiple zstd workers if available.
+  auto export_dump(DB& db) -> std::generator<std::span<uint8_t>>;
 };
 
 }
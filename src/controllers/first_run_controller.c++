@@ -11,7 +11,11 @@ using std::optional, std::string, std::string_view, std::unique_ptr,
 
 namespace Ludwig {
 
-auto FirstRunController::first_run_setup(WriteTxn txn, FirstRunSetup&& update, uint64_t as_user) -> void {
+auto FirstRunController::first_run_setup(
+  WriteTxn txn,
+  FirstRunSetup&& update,
+  uint64_t as_user
+) -> std::shared_ptr<CompletableOnce<bool>> {
   update.validate();
   if (as_user && !LocalUserDetail::get(txn, as_user, {}).local_user().admin()) {
     throw ApiError("Only an admin can perform first-run setup", 403);
@@ -112,7 +116,7 @@ auto FirstRunController::first_run_setup(WriteTxn txn, FirstRunSetup&& update, u
   DEFAULT(color_accent, SiteDetail::DEFAULT_COLOR_ACCENT)
   DEFAULT(color_accent_dim, SiteDetail::DEFAULT_COLOR_ACCENT_DIM)
   DEFAULT(color_accent_hover, SiteDetail::DEFAULT_COLOR_ACCENT_HOVER)
-  site_controller->update_site(std::move(txn), update, admin);
+  return site_controller->update_site(std::move(txn), update, admin);
 }
 
 auto FirstRunController::first_run_setup_options(ReadTxn& txn) -> FirstRunSetupOptions {
@@ -34,7 +34,12 @@ public:
 
   static auto interactive_setup(bool admin_exists, bool default_board_exists) -> FirstRunSetup;
   static auto first_run_setup_options(ReadTxn& txn) -> FirstRunSetupOptions;
-  auto first_run_setup(WriteTxn txn, FirstRunSetup&& update, uint64_t as_user = 0) -> void;
+  // Completes once the setup is committed, with false if it was lost
+  auto first_run_setup(
+    WriteTxn txn,
+    FirstRunSetup&& update,
+    uint64_t as_user = 0
+  ) -> std::shared_ptr<CompletableOnce<bool>>;
 };
 
 }
\ No newline at end of file
@@ -471,7 +471,7 @@ namespace Ludwig::Lemmy {
   /* createPrivateMessage */
   /* createPrivateMessageReport */
 
-  auto ApiController::create_site(WriteTxn txn, CreateSite& form, optional<SecretString>&& auth) -> SiteResponse {
+  auto ApiController::create_site(WriteTxn txn, CreateSite& form, optional<SecretString>&& auth) -> std::shared_ptr<CompletableOnce<bool>> {
     require_auth(form, std::move(auth), txn, true);
     const auto home_page_type = form.default_post_listing_type
       .transform(parse_listing_type)
@@ -484,8 +484,7 @@ namespace Ludwig::Lemmy {
     // TODO: captcha
     // TODO: federation
     // TODO: taglines
-    const auto counts = build_site_aggregates(txn);
-    first_run_controller->first_run_setup(std::move(txn), {{
+    return first_run_controller->first_run_setup(std::move(txn), {{
       .name = form.name,
       .description = form.sidebar,
       .icon_url = form.icon,
@@ -500,7 +499,6 @@ namespace Ludwig::Lemmy {
       .registration_enabled = registration_mode.transform(λx(x != RegistrationMode::Closed)),
       .registration_application_required = registration_mode.transform(λx(x == RegistrationMode::RequireApplication)),
     }, nullopt, nullopt, nullopt, nullopt });
-    return { .site_view = build_site_view(site_controller->site_detail(), counts), .taglines = {} };
   }
 
   auto ApiController::delete_account(WriteTxn& txn, DeleteAccount&, optional<SecretString>&&) -> void {
@@ -570,7 +568,7 @@ namespace Ludwig::Lemmy {
 
   /* editPrivateMessage */
 
-  auto ApiController::edit_site(WriteTxn txn, EditSite& form, optional<SecretString>&& auth) -> SiteResponse {
+  auto ApiController::edit_site(WriteTxn txn, EditSite& form, optional<SecretString>&& auth) -> std::shared_ptr<CompletableOnce<bool>> {
     const auto user_id = require_auth(form, std::move(auth), txn, true);
     const auto home_page_type = form.default_post_listing_type
       .transform(parse_listing_type)
@@ -583,8 +581,7 @@ namespace Ludwig::Lemmy {
     // TODO: captcha
     // TODO: federation
     // TODO: taglines
-    const auto counts = build_site_aggregates(txn);
-    site_controller->update_site(std::move(txn), {
+    return site_controller->update_site(std::move(txn), {
       .name = form.name,
       .description = form.sidebar,
       .icon_url = form.icon,
@@ -598,7 +595,6 @@ namespace Ludwig::Lemmy {
       .registration_enabled = registration_mode.transform(λx(x != RegistrationMode::Closed)),
       .registration_application_required = registration_mode.transform(λx(x == RegistrationMode::RequireApplication)),
     }, user_id);
-    return { .site_view = build_site_view(site_controller->site_detail(), counts), .taglines = {} };
   }
 
   /* featurePost */
@@ -1024,8 +1020,18 @@ namespace Ludwig::Lemmy {
     if (limit > 256) throw ApiError("search requires 0 < limit <= 256", 400);
     const auto user_id = optional_auth(txn, form, std::move(auth));
     const auto login = LocalUserDetail::get_login(txn, user_id);
+    const auto type = form.type_.transform(parse_search_type).value_or(SearchType::All);
+    const auto sort = form.sort.value_or("");
     return search_controller->search({
       .query = form.q,
+      .include_users = type == SearchType::All || type == SearchType::Users,
+      .include_boards = type == SearchType::All || type == SearchType::Communities,
+      .include_threads = type == SearchType::All || type == SearchType::Posts || type == SearchType::Url,
+      .include_comments = type == SearchType::All || type == SearchType::Comments,
+      .include_cws = !login || !login->local_user().hide_cw_posts(),
+      .sort = sort == "New" ? SearchResultSort::New
+        : sort.starts_with("Top") ? SearchResultSort::Top
+        : SearchResultSort::Relevant,
       .board_id = form.community_id.value_or(0),
       .offset = (size_t)((form.page.value_or(1) - 1) * limit),
       .limit = limit
@@ -219,7 +219,8 @@ namespace Ludwig::Lemmy {
     /* createPrivateMessage */
     /* createPrivateMessageReport */
 
-    auto create_site(WriteTxn txn, CreateSite& form, std::optional<SecretString>&& auth) -> SiteResponse;
+    // Completes once the change is committed; build the response with get_site_view after that
+    auto create_site(WriteTxn txn, CreateSite& form, std::optional<SecretString>&& auth) -> std::shared_ptr<CompletableOnce<bool>>;
 
     auto delete_account(WriteTxn& txn, DeleteAccount& form, std::optional<SecretString>&& auth) -> void;
 
@@ -244,7 +245,8 @@ namespace Ludwig::Lemmy {
 
     /* editPrivateMessage */
 
-    auto edit_site(WriteTxn txn, EditSite& form, std::optional<SecretString>&& auth) -> SiteResponse;
+    // Completes once the change is committed; build the response with get_site_view after that
+    auto edit_site(WriteTxn txn, EditSite& form, std::optional<SecretString>&& auth) -> std::shared_ptr<CompletableOnce<bool>>;
 
     /* featurePost */
 
@@ -1,6 +1,7 @@
 #include "post_controller.h++"
 #include "util/rich_text.h++"
 #include "models/board.h++"
+#include <bit>
 #include <queue>
 
 using std::function, std::generator, std::min, std::max, std::nullopt, std::optional, std::pair, std::priority_queue,
@@ -10,14 +11,6 @@ namespace chrono = std::chrono;
 
 namespace Ludwig {
 
-static constexpr double RANK_GRAVITY = 1.8;
-
-static inline auto rank_numerator(int64_t karma) -> double {
-  return std::log(max<int64_t>(1, 3 + karma));
-}
-static inline auto rank_denominator(chrono::duration<double> time_diff) -> double {
-  return std::pow(max(0L, chrono::duration_cast<chrono::hours>(time_diff).count()) + 2L, RANK_GRAVITY);
-}
 template <typename T> static auto latest_comment_cmp(const T& a, const T& b) -> bool {
   return a.stats().latest_comment() > b.stats().latest_comment();
 }
@@ -139,6 +132,28 @@ static inline auto ranked_new_comments(
   cursor.reset();
 }
 
+// Reads a page from one of the materialized Hot/Active rank indexes. Unlike
+// ranked(), the cursor is the last entry yielded, which is how Hot/Active page
+// cursors have always been encoded.
+template <class T, class Fn>
+static inline auto rank_index_gen(Fn get_entry, PageCursor& cursor, DBIter iter, bool by_board) -> generator<const T&> {
+  for (const auto id : iter) {
+    const auto key = *iter.get_cursor();
+    const auto rank_bits = by_board ? key.int_field_1() : key.int_field_0();
+    cursor.set(rank_bits, id);
+    try {
+      if (auto entry = get_entry(id)) {
+        entry->rank = cursor.rank_k();
+        if constexpr (requires { fetch_card(*entry); }) fetch_card(*entry);
+        co_yield *entry;
+      }
+    } catch (const ApiError& e) {
+      spdlog::warn("{} {:x} error: {}", T::noun, id, e.what());
+    }
+  }
+  cursor.reset();
+}
+
 static auto comment_tree(
   ReadTxn& txn,
   CommentTree& tree,
@@ -239,14 +254,19 @@ static inline auto earliest_time(SortType sort) -> Timestamp {
   }
 }
 
+// `by_board` is true if the index keys are (board, sort key), false if they
+// are just the sort key; either way, page cursors are (sort key, next ID).
 template <class T, class Fn>
-static inline auto iter_gen(Fn get_entry, PageCursor& cursor, SortType sort, DBIter iter) -> generator<const T&> {
+static inline auto iter_gen(Fn get_entry, PageCursor& cursor, SortType sort, DBIter iter, bool by_board = true) -> generator<const T&> {
   const auto earliest = earliest_time(sort);
   auto it = iter.begin();
   while (it != iter.end()) {
     const auto id = *it;
     if (++it == iter.end()) cursor.reset();
-    else cursor.set(iter.get_cursor()->int_field_1(), *it);
+    else {
+      const auto key = *iter.get_cursor();
+      cursor.set(by_board ? key.int_field_1() : key.int_field_0(), *it);
+    }
     try {
       if (const optional<T> entry = get_entry(id)) {
         const Timestamp time = entry->created_at();
@@ -261,6 +281,68 @@ static inline auto iter_gen(Fn get_entry, PageCursor& cursor, SortType sort, DBI
   cursor.reset();
 }
 
+// Home feeds of users subscribed to more boards than this scan the global
+// index instead; past this point, most of the global index is in the feed
+// anyway, and opening an iterator per board costs more than it saves.
+static constexpr size_t HOME_FEED_MERGE_MAX_BOARDS = 256;
+
+// Merges per-board indexes (keys are (board, sort key), values are IDs) into
+// one listing in the same order as the global index, using a heap of the
+// current head of each board's iterator. Page cursors match iter_gen, or
+// rank_index_gen if `rank_index` is true.
+template <class T, class Fn>
+static inline auto merge_gen(
+  Fn get_entry,
+  PageCursor& cursor,
+  SortType sort,
+  vector<DBIter> iters,
+  Dir dir,
+  bool rank_index = false
+) -> generator<const T&> {
+  struct Head { uint64_t k, id; size_t i; };
+  const auto head_cmp = [dir](const Head& a, const Head& b) -> bool {
+    return dir == Dir::Desc ? pair(a.k, a.id) < pair(b.k, b.id) : pair(a.k, a.id) > pair(b.k, b.id);
+  };
+  priority_queue<Head, vector<Head>, decltype(head_cmp)> heads(head_cmp);
+  const auto push_head = [&](size_t i) {
+    if (!iters[i].is_done()) heads.push({ iters[i].get_cursor()->int_field_1(), *iters[i], i });
+  };
+  for (size_t i = 0; i < iters.size(); i++) push_head(i);
+  const auto earliest = earliest_time(sort);
+  while (!heads.empty()) {
+    const auto [k, id, i] = heads.top();
+    heads.pop();
+    ++iters[i];
+    push_head(i);
+    if (rank_index) cursor.set(k, id);
+    else if (heads.empty()) cursor.reset();
+    else cursor.set(heads.top().k, heads.top().id);
+    try {
+      if (optional<T> entry = get_entry(id)) {
+        if (rank_index) entry->rank = std::bit_cast<double>(k);
+        else if (entry->created_at() < earliest) continue;
+        if constexpr (requires { fetch_card(*entry); }) fetch_card(*entry);
+        co_yield *entry;
+      }
+    } catch (const ApiError& e) {
+      spdlog::warn("{} {:x} error: {}", T::noun, id, e.what());
+    }
+  }
+  cursor.reset();
+}
+
+// Returns the boards a user is subscribed to, or nullopt if there are more
+// than HOME_FEED_MERGE_MAX_BOARDS of them
+static inline auto home_feed_boards(ReadTxn& txn, Login login) -> optional<vector<uint64_t>> {
+  if (!login) throw ApiError("Must be logged in to view Home feed", 403);
+  vector<uint64_t> boards;
+  for (const auto id : txn.list_subscribed_boards(login->id)) {
+    if (boards.size() >= HOME_FEED_MERGE_MAX_BOARDS) return {};
+    boards.push_back(id);
+  }
+  return boards;
+}
+
 auto PostController::thread_detail(
   ReadTxn& txn,
   CommentTree& tree_out,
@@ -333,23 +415,11 @@ auto PostController::list_board_threads(
   };
   switch (sort) {
     case Active:
-      return ranked<RankType::Active, ThreadDetail>(
-        txn,
-        cursor,
-        txn.list_threads_of_board_new(board_id),
-        txn.list_threads_of_board_top(board_id),
-        get_entry,
-        cursor.rank_k()
-      );
+      return rank_index_gen<ThreadDetail>(get_entry, cursor,
+        txn.list_threads_of_board_active(board_id, cursor.next_cursor_desc(board_id)), true);
     case Hot:
-      return ranked<RankType::Hot, ThreadDetail>(
-        txn,
-        cursor,
-        txn.list_threads_of_board_new(board_id),
-        txn.list_threads_of_board_top(board_id),
-        get_entry,
-        cursor.rank_k()
-      );
+      return rank_index_gen<ThreadDetail>(get_entry, cursor,
+        txn.list_threads_of_board_hot(board_id, cursor.next_cursor_desc(board_id)), true);
     case NewComments:
       return ranked_new_comments<ThreadDetail>(
         txn,
@@ -397,23 +467,11 @@ auto PostController::list_board_comments(
   };
   switch (sort) {
     case Active:
-      return ranked<RankType::Active, CommentDetail>(
-        txn,
-        cursor,
-        txn.list_comments_of_board_new(board_id),
-        txn.list_comments_of_board_top(board_id),
-        get_entry,
-        cursor.rank_k()
-      );
+      return rank_index_gen<CommentDetail>(get_entry, cursor,
+        txn.list_comments_of_board_active(board_id, cursor.next_cursor_desc(board_id)), true);
     case Hot:
-      return ranked<RankType::Hot, CommentDetail>(
-        txn,
-        cursor,
-        txn.list_comments_of_board_new(board_id),
-        txn.list_comments_of_board_top(board_id),
-        get_entry,
-        cursor.rank_k()
-      );
+      return rank_index_gen<CommentDetail>(get_entry, cursor,
+        txn.list_comments_of_board_hot(board_id, cursor.next_cursor_desc(board_id)), true);
     case NewComments:
       return ranked_new_comments<CommentDetail>(
         txn,
@@ -465,6 +523,84 @@ auto feed_filter_fn(uint64_t feed_id, ReadTxn& txn, Login login) -> function<boo
   }
 }
 
+static auto home_feed_threads(
+  ReadTxn& txn,
+  PageCursor& cursor,
+  const vector<uint64_t>& boards,
+  SortType sort,
+  Login login
+) -> generator<const ThreadDetail&> {
+  using enum SortType;
+  const auto get_entry = [=, &txn](uint64_t id) -> optional<ThreadDetail> {
+    const auto e = optional(ThreadDetail::get(txn, id, login));
+    return e->should_show(login) ? e : nullopt;
+  };
+  vector<DBIter> iters;
+  iters.reserve(boards.size());
+  for (const auto board : boards) {
+    switch (sort) {
+      case Active:
+        iters.push_back(txn.list_threads_of_board_active(board, cursor.next_cursor_desc(board)));
+        break;
+      case Hot:
+        iters.push_back(txn.list_threads_of_board_hot(board, cursor.next_cursor_desc(board)));
+        break;
+      case New:
+        iters.push_back(txn.list_threads_of_board_new(board, cursor.next_cursor_asc(board)));
+        break;
+      case Old:
+        iters.push_back(txn.list_threads_of_board_old(board, cursor.next_cursor_desc(board)));
+        break;
+      case MostComments:
+        iters.push_back(txn.list_threads_of_board_most_comments(board, cursor.next_cursor_asc(board)));
+        break;
+      default:
+        iters.push_back(txn.list_threads_of_board_top(board, cursor.next_cursor_asc(board)));
+    }
+  }
+  return merge_gen<ThreadDetail>(get_entry, cursor, sort, std::move(iters),
+    sort == Old ? Dir::Asc : Dir::Desc, sort == Active || sort == Hot);
+}
+
+static auto home_feed_comments(
+  ReadTxn& txn,
+  PageCursor& cursor,
+  const vector<uint64_t>& boards,
+  SortType sort,
+  Login login
+) -> generator<const CommentDetail&> {
+  using enum SortType;
+  const auto get_entry = [=, &txn](uint64_t id) -> optional<CommentDetail> {
+    const auto e = optional(CommentDetail::get(txn, id, login));
+    return e->should_show(login) ? e : nullopt;
+  };
+  vector<DBIter> iters;
+  iters.reserve(boards.size());
+  for (const auto board : boards) {
+    switch (sort) {
+      case Active:
+        iters.push_back(txn.list_comments_of_board_active(board, cursor.next_cursor_desc(board)));
+        break;
+      case Hot:
+        iters.push_back(txn.list_comments_of_board_hot(board, cursor.next_cursor_desc(board)));
+        break;
+      case New:
+        iters.push_back(txn.list_comments_of_board_new(board, cursor.next_cursor_asc(board)));
+        break;
+      case Old:
+        iters.push_back(txn.list_comments_of_board_old(board, cursor.next_cursor_desc(board)));
+        break;
+      case MostComments:
+        iters.push_back(txn.list_comments_of_board_most_comments(board, cursor.next_cursor_asc(board)));
+        break;
+      default:
+        iters.push_back(txn.list_comments_of_board_top(board, cursor.next_cursor_asc(board)));
+    }
+  }
+  return merge_gen<CommentDetail>(get_entry, cursor, sort, std::move(iters),
+    sort == Old ? Dir::Asc : Dir::Desc, sort == Active || sort == Hot);
+}
+
 auto PostController::list_feed_threads(
   ReadTxn& txn,
   PageCursor& cursor,
@@ -473,6 +609,12 @@ auto PostController::list_feed_threads(
   Login login
 ) -> generator<const ThreadDetail&> {
   using enum SortType;
+  // NewComments isn't a simple index order, so it always uses the global scan
+  if (feed_id == FEED_HOME && sort != NewComments) {
+    if (const auto boards = home_feed_boards(txn, login)) {
+      return home_feed_threads(txn, cursor, *boards, sort, login);
+    }
+  }
   auto filter_thread = feed_filter_fn<ThreadDetail>(feed_id, txn, login);
   const auto get_entry = [=, &txn](uint64_t id) -> optional<ThreadDetail> {
     const auto e = optional(ThreadDetail::get(txn, id, login));
@@ -480,23 +622,11 @@ auto PostController::list_feed_threads(
   };
   switch (sort) {
     case Active:
-      return ranked<RankType::Active, ThreadDetail>(
-        txn,
-        cursor,
-        txn.list_threads_new(),
-        txn.list_threads_top(),
-        get_entry,
-        cursor.rank_k()
-      );
+      return rank_index_gen<ThreadDetail>(get_entry, cursor,
+        txn.list_threads_active(cursor.next_cursor_desc()), false);
     case Hot:
-      return ranked<RankType::Hot, ThreadDetail>(
-        txn,
-        cursor,
-        txn.list_threads_new(),
-        txn.list_threads_top(),
-        get_entry,
-        cursor.rank_k()
-      );
+      return rank_index_gen<ThreadDetail>(get_entry, cursor,
+        txn.list_threads_hot(cursor.next_cursor_desc()), false);
     case NewComments:
       return ranked_new_comments<ThreadDetail>(
         txn,
@@ -506,13 +636,13 @@ auto PostController::list_feed_threads(
       );
     case New:
       return iter_gen<ThreadDetail>(get_entry, cursor, sort,
-        txn.list_threads_new(cursor.next_cursor_asc()));
+        txn.list_threads_new(cursor.next_cursor_asc()), false);
     case Old:
       return iter_gen<ThreadDetail>(get_entry, cursor, sort,
-        txn.list_threads_old(cursor.next_cursor_desc()));
+        txn.list_threads_old(cursor.next_cursor_desc()), false);
     case MostComments:
       return iter_gen<ThreadDetail>(get_entry, cursor, sort,
-        txn.list_threads_most_comments(cursor.next_cursor_asc()));
+        txn.list_threads_most_comments(cursor.next_cursor_asc()), false);
     case TopAll:
     case TopYear:
     case TopSixMonths:
@@ -524,7 +654,7 @@ auto PostController::list_feed_threads(
     case TopSixHour:
     case TopHour:
       return iter_gen<ThreadDetail>(get_entry, cursor, sort,
-        txn.list_threads_top(cursor.next_cursor_asc()));
+        txn.list_threads_top(cursor.next_cursor_asc()), false);
   }
 }
 
@@ -536,6 +666,12 @@ auto PostController::list_feed_comments(
   Login login
 ) -> generator<const CommentDetail&> {
   using enum SortType;
+  // NewComments isn't a simple index order, so it always uses the global scan
+  if (feed_id == FEED_HOME && sort != NewComments) {
+    if (const auto boards = home_feed_boards(txn, login)) {
+      return home_feed_comments(txn, cursor, *boards, sort, login);
+    }
+  }
   auto filter_comment = feed_filter_fn<CommentDetail>(feed_id, txn, login);
   const auto get_entry = [=, &txn](uint64_t id) -> optional<CommentDetail> {
     const auto e = optional(CommentDetail::get(txn, id, login));
@@ -543,23 +679,11 @@ auto PostController::list_feed_comments(
   };
   switch (sort) {
     case Active:
-      return ranked<RankType::Active, CommentDetail>(
-        txn,
-        cursor,
-        txn.list_comments_new(),
-        txn.list_comments_top(),
-        get_entry,
-        cursor.rank_k()
-      );
+      return rank_index_gen<CommentDetail>(get_entry, cursor,
+        txn.list_comments_active(cursor.next_cursor_desc()), false);
     case Hot:
-      return ranked<RankType::Hot, CommentDetail>(
-        txn,
-        cursor,
-        txn.list_comments_new(),
-        txn.list_comments_top(),
-        get_entry,
-        cursor.rank_k()
-      );
+      return rank_index_gen<CommentDetail>(get_entry, cursor,
+        txn.list_comments_hot(cursor.next_cursor_desc()), false);
     case NewComments:
       return ranked_new_comments<CommentDetail>(
         txn,
@@ -569,13 +693,13 @@ auto PostController::list_feed_comments(
       );
     case New:
       return iter_gen<CommentDetail>(get_entry, cursor, sort,
-        txn.list_comments_new(cursor.next_cursor_asc()));
+        txn.list_comments_new(cursor.next_cursor_asc()), false);
     case Old:
       return iter_gen<CommentDetail>(get_entry, cursor, sort,
-        txn.list_comments_old(cursor.next_cursor_desc()));
+        txn.list_comments_old(cursor.next_cursor_desc()), false);
     case MostComments:
       return iter_gen<CommentDetail>(get_entry, cursor, sort,
-        txn.list_comments_most_comments(cursor.next_cursor_asc()));
+        txn.list_comments_most_comments(cursor.next_cursor_asc()), false);
     case TopAll:
     case TopYear:
     case TopSixMonths:
@@ -587,7 +711,7 @@ auto PostController::list_feed_comments(
     case TopSixHour:
     case TopHour:
       return iter_gen<CommentDetail>(get_entry, cursor, sort,
-        txn.list_comments_top(cursor.next_cursor_asc()));
+        txn.list_comments_top(cursor.next_cursor_asc()), false);
   }
 }
 
@@ -0,0 +1,55 @@
+#include "rank_controller.h++"
+
+using std::exception, std::optional, std::pair, std::shared_ptr;
+namespace chrono = std::chrono;
+
+namespace Ludwig {
+
+RankController::RankController(
+  shared_ptr<DB> db,
+  chrono::steady_clock::duration interval,
+  size_t batch_size
+) : db(db), interval(interval), batch_size(batch_size) {
+  assert(db != nullptr);
+  assert(batch_size > 0);
+}
+
+auto RankController::rescore() noexcept -> Async<void> {
+  const auto start = chrono::steady_clock::now();
+  const auto since = now_t() - RANK_RESCORE_MAX_AGE;
+  size_t batches = 0;
+  try {
+    optional<pair<Cursor, uint64_t>> from;
+    do {
+      auto txn = co_await asio_completable(db->open_write_txn(WritePriority::Low));
+      from = txn.rescore_thread_ranks(since, from, batch_size);
+      txn.commit();
+      batches++;
+    } while (from);
+    do {
+      auto txn = co_await asio_completable(db->open_write_txn(WritePriority::Low));
+      from = txn.rescore_comment_ranks(since, from, batch_size);
+      txn.commit();
+      batches++;
+    } while (from);
+    spdlog::debug("Rescored Hot/Active ranks in {:d} batches ({:d}ms)", batches,
+      chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count()
+    );
+  } catch (const exception& e) {
+    spdlog::error("Error rescoring Hot/Active ranks: {}", e.what());
+  }
+}
+
+auto RankController::rescore_loop() noexcept -> Async<void> {
+  try {
+    for (;;) {
+      asio::steady_timer timer(co_await asio::this_coro::executor, interval);
+      co_await timer.async_wait(asio::deferred);
+      co_await rescore();
+    }
+  } catch (const exception& e) {
+    spdlog::debug("Stopped rescoring Hot/Active ranks: {}", e.what());
+  }
+}
+
+}
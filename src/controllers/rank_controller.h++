@@ -0,0 +1,26 @@
+#pragma once
+#include "db/db.h++"
+#include "util/asio_common.h++"
+
+namespace Ludwig {
+
+// Periodically recomputes the Hot/Active rank index. Ranks are hour-granular,
+// so by default this runs once an hour, in small low-priority write
+// transactions so that it never holds the write lock for long.
+class RankController {
+private:
+  std::shared_ptr<DB> db;
+  std::chrono::steady_clock::duration interval;
+  size_t batch_size;
+public:
+  RankController(
+    std::shared_ptr<DB> db,
+    std::chrono::steady_clock::duration interval = std::chrono::hours(1),
+    size_t batch_size = 1000
+  );
+
+  auto rescore() noexcept -> Async<void>;
+  auto rescore_loop() noexcept -> Async<void>;
+};
+
+}
@@ -15,13 +15,14 @@ RemoteMediaController::RemoteMediaController(
   shared_ptr<HttpClient> http_client,
   shared_ptr<LibXmlContext> xml_ctx,
   shared_ptr<EventBus> event_bus,
-  ThumbnailCache::Dispatcher dispatcher
+  ThumbnailCache::Dispatcher dispatcher,
+  shared_ptr<ThumbnailStore> thumbnail_store
 ) : io(io), db(db), http_client(http_client), xml_ctx(xml_ctx), event_bus(event_bus),
     sub_fetch(event_bus->on_event(Event::ThreadFetchLinkCard, [&](Event, uint64_t id){
       asio::co_spawn(*this->io, fetch_link_card_for_thread(id), asio::detached);
     })),
-    small_cache(http_client, 16384, 256, dispatcher),
-    banner_cache(http_client, 256, 960, 160, dispatcher) {
+    small_cache(http_client, 16384, 256, dispatcher, thumbnail_store),
+    banner_cache(http_client, 256, 960, 160, dispatcher, thumbnail_store) {
   assert(io != nullptr);
   assert(db != nullptr);
   assert(http_client != nullptr);
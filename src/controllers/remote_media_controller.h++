@@ -24,7 +24,8 @@ public:
     std::shared_ptr<HttpClient> http_client,
     std::shared_ptr<LibXmlContext> xml_ctx,
     std::shared_ptr<EventBus> event_bus = std::make_shared<DummyEventBus>(),
-    ThumbnailCache::Dispatcher dispatcher = [](auto f) { f(); }
+    ThumbnailCache::Dispatcher dispatcher = [](auto f) { f(); return true; },
+    std::shared_ptr<ThumbnailStore> thumbnail_store = nullptr
   );
 
   auto user_avatar(std::string_view user_name) -> std::shared_ptr<CompletableOnce<ImageRef>>;
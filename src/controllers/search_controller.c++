@@ -45,6 +45,7 @@ SearchController::SearchController(
     board_sub(event_bus->on_event(Event::BoardUpdate, SEARCH_EVENT_HANDLER)), 
     thread_sub(event_bus->on_event(Event::ThreadUpdate, SEARCH_EVENT_HANDLER)),
     comment_sub(event_bus->on_event(Event::CommentUpdate, SEARCH_EVENT_HANDLER)),
+    stats_sub(event_bus->on_event(Event::PostStatsUpdate, SEARCH_EVENT_HANDLER)),
     user_del_sub(event_bus->on_event(Event::UserDelete, SEARCH_EVENT_HANDLER)),
     board_del_sub(event_bus->on_event(Event::BoardDelete, SEARCH_EVENT_HANDLER)), 
     thread_del_sub(event_bus->on_event(Event::ThreadDelete, SEARCH_EVENT_HANDLER)),
@@ -82,10 +83,19 @@ auto SearchController::event_handler(Event event, uint64_t subject_id) noexcept
       }
       case CommentUpdate: {
         auto txn = db->open_read_txn();
-        search_engine->index(subject_id, txn.get_comment(subject_id).value());
+        const auto& comment = txn.get_comment(subject_id).value().get();
+        search_engine->index(subject_id, comment, txn.get_thread(comment.thread()).value());
         spdlog::debug("Indexed comment {:x} in search engine", subject_id);
         break;
       }
+      case PostStatsUpdate: {
+        auto txn = db->open_read_txn();
+        const auto stats = txn.get_post_stats(subject_id);
+        if (!stats) return;
+        const auto type = txn.get_thread(subject_id) ? SearchResultType::Thread : SearchResultType::Comment;
+        search_engine->update_karma(subject_id, type, stats->get().karma());
+        break;
+      }
       case UserDelete:
         search_engine->unindex(subject_id, SearchResultType::User);
         break;
@@ -125,13 +135,20 @@ auto SearchController::index_all() -> void {
   for (const auto thread : txn.list_threads_old()) {
     try {
       search_engine->index(thread, txn.get_thread(thread).value());
+      if (const auto stats = txn.get_post_stats(thread)) {
+        search_engine->update_karma(thread, SearchResultType::Thread, stats->get().karma());
+      }
     } catch (const exception& e) {
       spdlog::warn("Error adding thread {:x} to search index: {}", thread, e.what());
     }
   }
   for (const auto comment : txn.list_comments_old()) {
     try {
-      search_engine->index(comment, txn.get_comment(comment).value());
+      const auto& c = txn.get_comment(comment).value().get();
+      search_engine->index(comment, c, txn.get_thread(c.thread()).value());
+      if (const auto stats = txn.get_post_stats(comment)) {
+        search_engine->update_karma(comment, SearchResultType::Comment, stats->get().karma());
+      }
     } catch (const exception& e) {
       spdlog::warn("Error adding comment {:x} to search index: {}", comment, e.what());
     }
@@ -20,7 +20,7 @@ class SearchController {
 private:
   std::shared_ptr<DB> db;
   std::shared_ptr<SearchEngine> search_engine;
-  EventBus::Subscription user_sub, board_sub, thread_sub, comment_sub,
+  EventBus::Subscription user_sub, board_sub, thread_sub, comment_sub, stats_sub,
     user_del_sub, board_del_sub, thread_del_sub, comment_del_sub;
 
   auto event_handler(Event event, uint64_t user_id) noexcept -> void;
@@ -39,7 +39,11 @@ auto SiteController::can_create_board(Login login, const SiteDetail& site) -> bo
                     login->local_user().admin());
 }
 
-auto SiteController::update_site(WriteTxn txn, const SiteUpdate& update, optional<uint64_t> as_user) -> void {
+auto SiteController::update_site(
+  WriteTxn txn,
+  const SiteUpdate& update,
+  optional<uint64_t> as_user
+) -> shared_ptr<CompletableOnce<bool>> {
   using namespace SettingsKey;
   update.validate();
   if (as_user && !can_change_site_settings(LocalUserDetail::get_login(txn, *as_user))) {
@@ -66,12 +70,17 @@ auto SiteController::update_site(WriteTxn txn, const SiteUpdate& update, optiona
   if (const auto v = update.color_accent_dim) txn.set_setting(color_accent_dim, *v);
   if (const auto v = update.color_accent_hover) txn.set_setting(color_accent_hover, *v);
   txn.set_setting(updated_at, now_s());
-  auto detail = new SiteDetail;
-  *detail = SiteDetail::get(txn);
-  txn.commit();
-  auto old_detail = cached_site_detail.exchange(detail, std::memory_order_acq_rel);
-  if (old_detail) delete old_detail;
-  event_bus->dispatch(Event::SiteUpdate);
+  auto detail = std::make_unique<SiteDetail>(SiteDetail::get(txn));
+  auto done = std::make_shared<CompletableOnce<bool>>();
+  txn.commit()->on_complete([this, detail = std::move(detail), done](bool committed) mutable {
+    if (committed) {
+      auto old_detail = cached_site_detail.exchange(detail.release(), std::memory_order_acq_rel);
+      if (old_detail) delete old_detail;
+      event_bus->dispatch(Event::SiteUpdate);
+    }
+    done->complete(committed);
+  });
+  return done;
 }
 
 auto SiteUpdate::validate() const -> void {
@@ -41,7 +41,14 @@ public:
   // update_site consumes its WriteTxn because, upon txn.commit(), it updates cached_site_detail.
   // If update_site did not call txn.commit(), cached_site_detail would be out of sync with
   // the actual site settings from the perspective of txn while txn remains live.
-  auto update_site(WriteTxn txn, const SiteUpdate& update, std::optional<uint64_t> as_user) -> void;
+  //
+  // cached_site_detail is only updated once the commit succeeds (see WriteTxn::commit); the
+  // result completes after that, with false if the changes were lost.
+  auto update_site(
+    WriteTxn txn,
+    const SiteUpdate& update,
+    std::optional<uint64_t> as_user
+  ) -> std::shared_ptr<CompletableOnce<bool>>;
 };
 
 }
\ No newline at end of file
@@ -81,6 +81,15 @@ namespace Ludwig {
     CommentsNew_Time,
     CommentsTop_Karma,
     CommentsMostComments_Comments,
+    ThreadsHot_Rank,
+    ThreadsActive_Rank,
+    ThreadsHot_BoardRank,
+    ThreadsActive_BoardRank,
+    CommentsHot_Rank,
+    CommentsActive_Rank,
+    CommentsHot_BoardRank,
+    CommentsActive_BoardRank,
+    PostRank_Post,
 
     Notification_Notification,
     NotificationsNew_UserTime,
@@ -270,6 +279,15 @@ namespace Ludwig {
     MK_DBI(CommentsNew_Time, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP)
     MK_DBI(CommentsTop_Karma, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP)
     MK_DBI(CommentsMostComments_Comments, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP)
+    MK_DBI(ThreadsHot_Rank, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP)
+    MK_DBI(ThreadsActive_Rank, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP)
+    MK_DBI(ThreadsHot_BoardRank, MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP)
+    MK_DBI(ThreadsActive_BoardRank, MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP)
+    MK_DBI(CommentsHot_Rank, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP)
+    MK_DBI(CommentsActive_Rank, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP)
+    MK_DBI(CommentsHot_BoardRank, MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP)
+    MK_DBI(CommentsActive_BoardRank, MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP)
+    MK_DBI(PostRank_Post, MDB_INTEGERKEY)
 
     MK_DBI(Notification_Notification, MDB_INTEGERKEY)
     MK_DBI(NotificationsNew_UserTime, MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP)
@@ -288,22 +306,35 @@ namespace Ludwig {
     return 0;
   }
 
-  static constexpr size_t DUMP_ENTRY_MAX_SIZE = 4 * MiB;
-
-  DB::DB(const char* filename, size_t map_size_mb, bool move_fast_and_break_things) :
+  DB::DB(const char* filename, size_t map_size_mb, bool move_fast_and_break_things, WriteBatchOptions batch_options) :
     map_size(map_size_mb * MiB - (map_size_mb * MiB) % (size_t)sysconf(_SC_PAGESIZE)),
     write_lock(1),
-    write_queue(&write_queue_cmp, write_queue_vec)
+    write_queue(&write_queue_cmp, write_queue_vec),
+    batch_options(batch_options)
   {
     MDB_txn* txn = nullptr;
-    int err = init_env(filename, &txn, move_fast_and_break_things);
+    MDB_stat rank_stat, post_stat;
+    int err = init_env(filename, &txn, move_fast_and_break_things || batch_options.sync_interval.count() > 0);
     if (err) goto die;
 
     MDB_val val;
     if (db_get(txn, dbis[Settings], SettingsKey::next_id, val)) {
       db_put(txn, dbis[Settings], SettingsKey::next_id, ID_MIN_USER);
     }
-    if ((err = mdb_txn_commit(txn))) goto die;
+    if (
+      (err = mdb_stat(txn, dbis[PostRank_Post], &rank_stat)) ||
+      (err = mdb_stat(txn, dbis[PostStats_Post], &post_stat)) ||
+      (err = mdb_txn_commit(txn))
+    ) goto die;
+
+    // Databases created before the rank index existed need it built once
+    if (!rank_stat.ms_entries && post_stat.ms_entries) {
+      spdlog::info("Building Hot/Active rank index for {:d} posts", post_stat.ms_entries);
+      auto wtxn = open_write_txn_sync();
+      wtxn.rescore_thread_ranks(Timestamp{});
+      wtxn.rescore_comment_ranks(Timestamp{});
+      wtxn.commit();
+    }
     return;
   die:
     if (txn != nullptr) mdb_txn_abort(txn);
@@ -312,7 +343,67 @@ namespace Ludwig {
   }
 
   DB::~DB() {
-    if (env != nullptr) mdb_env_close(env);
+    if (batch_txn != nullptr) commit_batch();
+    if (env != nullptr) {
+      if (batch_options.sync_interval.count() > 0) sync();
+      mdb_env_close(env);
+    }
+  }
+
+  template <typename T> static inline auto verify_dump_data(const flatbuffers::Vector<uint8_t>& data, const char* type_name) -> void {
+    Verifier verifier(data.data(), data.size());
+    if (!GetRoot<T>(data.data())->Verify(verifier)) {
+      throw runtime_error(fmt::format("FlatBuffer verification failed on read ({})", type_name));
+    }
+  }
+
+  auto DB::verify_dump_entry(std::span<const uint8_t> buf) -> const Dump& {
+    using enum DumpType;
+    const auto& entry = *flatbuffers::GetSizePrefixedRoot<Dump>(buf.data());
+    Verifier verifier(buf.data(), buf.size());
+    if (!entry.Verify(verifier)) {
+      throw runtime_error("FlatBuffer verification failed on read");
+    }
+    // Every record is verified here, so that import_batched can pass them to
+    // the WriteTxn setters as already verified
+    const auto data = entry.data();
+    if (!data) throw runtime_error("DB dump entry has no data");
+    switch (entry.type()) {
+      case User:
+        verify_dump_data<Ludwig::User>(*data, "User");
+        break;
+      case LocalUser:
+        verify_dump_data<Ludwig::LocalUser>(*data, "LocalUser");
+        break;
+      case Board:
+        verify_dump_data<Ludwig::Board>(*data, "Board");
+        break;
+      case LocalBoard:
+        verify_dump_data<Ludwig::LocalBoard>(*data, "LocalBoard");
+        break;
+      case Thread:
+        verify_dump_data<Ludwig::Thread>(*data, "Thread");
+        break;
+      case Comment:
+        verify_dump_data<Ludwig::Comment>(*data, "Comment");
+        break;
+      case Notification:
+        verify_dump_data<Ludwig::Notification>(*data, "Notification");
+        break;
+      case SettingRecord:
+        verify_dump_data<Ludwig::SettingRecord>(*data, "SettingRecord");
+        break;
+      case UpvoteBatch:
+      case DownvoteBatch:
+        verify_dump_data<VoteBatch>(*data, "VoteBatch");
+        break;
+      case SubscriptionBatch:
+        verify_dump_data<Ludwig::SubscriptionBatch>(*data, "SubscriptionBatch");
+        break;
+      default:
+        throw runtime_error("Invalid entry in database dump");
+    }
+    return entry;
   }
 
   auto DB::import(
@@ -320,20 +411,10 @@ namespace Ludwig {
     function<size_t (uint8_t*, size_t)> read,
     size_t map_size_mb
   ) -> std::shared_ptr<DB> {
-    using enum DumpType;
-    {
-      struct stat stat_buf;
-      if (stat(filename, &stat_buf) == 0) {
-        throw runtime_error("Cannot import database dump: database file " +
-            string(filename) + " already exists and would be overwritten.");
-      }
-    }
-    bool success = false;
-    Defer deleter([&] { if (!success) remove(filename); });
-    auto db = std::make_shared<DB>(filename, map_size_mb, true);
-    auto txn = db->open_write_txn_sync();
     auto buf = std::make_unique<uint8_t[]>(DUMP_ENTRY_MAX_SIZE);
-    while (read(buf.get(), 4) == 4) {
+    const Dump* entry;
+    return import_batched(filename, [&]() -> std::span<const Dump* const> {
+      if (read(buf.get(), 4) != 4) return {};
       const auto len = flatbuffers::GetSizePrefixedBufferLength(buf.get());
       if (len > DUMP_ENTRY_MAX_SIZE) {
         throw runtime_error(fmt::format("DB dump entry is larger than max of {}MiB", DUMP_ENTRY_MAX_SIZE / MiB));
@@ -345,75 +426,110 @@ namespace Ludwig {
           throw runtime_error("Did not read the expected number of bytes (truncated DB dump entry?)");
         }
       }
-      const auto entry = flatbuffers::GetSizePrefixedRoot<Dump>(buf.get());
-      Verifier verifier(buf.get(), len);
-      if (!entry->Verify(verifier)) {
-        throw runtime_error("FlatBuffer verification failed on read");
+      entry = &verify_dump_entry({buf.get(), len});
+      return {&entry, 1};
+    }, map_size_mb);
+  }
+
+  // Large imports are split into several write txns, so that LMDB doesn't
+  // have to spill dirty pages mid-transaction
+  static constexpr size_t IMPORT_TXN_MAX_ENTRIES = 1 << 16;
+
+  auto DB::import_batched(
+    const char* filename,
+    function<std::span<const Dump* const> ()> next_batch,
+    size_t map_size_mb
+  ) -> std::shared_ptr<DB> {
+    using enum DumpType;
+    {
+      struct stat stat_buf;
+      if (stat(filename, &stat_buf) == 0) {
+        throw runtime_error("Cannot import database dump: database file " +
+            string(filename) + " already exists and would be overwritten.");
       }
-      const span<uint8_t> span((uint8_t*)entry->data()->data(), entry->data()->size());
-      switch (entry->type()) {
-        case User:
-          txn.set_user(entry->id(), span, true);
-          break;
-        case LocalUser:
-          txn.set_local_user(entry->id(), span, true);
-          break;
-        case Board:
-          txn.set_board(entry->id(), span, true);
-          break;
-        case LocalBoard:
-          txn.set_local_board(entry->id(), span, true);
-          break;
-        case Thread:
-          txn.set_thread(entry->id(), span, true);
-          break;
-        case Comment:
-          txn.set_comment(entry->id(), span, true);
-          break;
-        case Notification:
-          txn.create_notification(span);
-          break;
-        case SettingRecord: {
-          const auto rec = GetRoot<Ludwig::SettingRecord>(span.data());
-          if (rec->value_str()) {
-            txn.set_setting(rec->key()->string_view(), rec->value_str()->string_view());
-          } else {
-            txn.set_setting(rec->key()->string_view(), rec->value_int().value_or(0));
+    }
+    bool success = false;
+    Defer deleter([&] { if (!success) remove(filename); });
+    auto db = std::make_shared<DB>(filename, map_size_mb, true);
+    std::optional<WriteTxn> txn(db->open_write_txn_sync());
+    size_t txn_entries = 0;
+    for (auto entries = next_batch(); !entries.empty(); entries = next_batch()) {
+      for (const auto* entry : entries) {
+        const span<uint8_t> span((uint8_t*)entry->data()->data(), entry->data()->size());
+        switch (entry->type()) {
+          case User:
+            txn->set_user(entry->id(), span, true, true);
+            break;
+          case LocalUser:
+            txn->set_local_user(entry->id(), span, true, true);
+            break;
+          case Board:
+            txn->set_board(entry->id(), span, true, true);
+            break;
+          case LocalBoard:
+            txn->set_local_board(entry->id(), span, true, true);
+            break;
+          case Thread:
+            txn->set_thread(entry->id(), span, true, true);
+            break;
+          case Comment:
+            txn->set_comment(entry->id(), span, true, true);
+            break;
+          case Notification:
+            txn->create_notification(span, true);
+            break;
+          case SettingRecord: {
+            const auto rec = GetRoot<Ludwig::SettingRecord>(span.data());
+            if (rec->value_str()) {
+              txn->set_setting(rec->key()->string_view(), rec->value_str()->string_view());
+            } else {
+              txn->set_setting(rec->key()->string_view(), rec->value_int().value_or(0));
+            }
+            break;
           }
-          break;
-        }
-        case UpvoteBatch: {
-          const auto batch = GetRoot<VoteBatch>(span.data());
-          for (const auto post : *batch->posts()) {
-            txn.set_vote(entry->id(), post, Vote::Upvote, true);
+          case UpvoteBatch: {
+            const auto batch = GetRoot<VoteBatch>(span.data());
+            for (const auto post : *batch->posts()) {
+              txn->set_vote(entry->id(), post, Vote::Upvote, true);
+            }
+            break;
           }
-          break;
-        }
-        case DownvoteBatch: {
-          const auto batch = GetRoot<VoteBatch>(span.data());
-          for (const auto post : *batch->posts()) {
-            txn.set_vote(entry->id(), post, Vote::Downvote, true);
+          case DownvoteBatch: {
+            const auto batch = GetRoot<VoteBatch>(span.data());
+            for (const auto post : *batch->posts()) {
+              txn->set_vote(entry->id(), post, Vote::Downvote, true);
+            }
+            break;
           }
-          break;
-        }
-        case SubscriptionBatch: {
-          const auto batch = GetRoot<Ludwig::SubscriptionBatch>(span.data());
-          for (const auto board : *batch->boards()) {
-            txn.set_subscription(entry->id(), board, true);
+          case SubscriptionBatch: {
+            const auto batch = GetRoot<Ludwig::SubscriptionBatch>(span.data());
+            for (const auto board : *batch->boards()) {
+              txn->set_subscription(entry->id(), board, true, true);
+            }
+            break;
           }
-          break;
+          default:
+            throw runtime_error("Invalid entry in database dump");
         }
-        default:
-          throw runtime_error("Invalid entry in database dump");
+      }
+      if ((txn_entries += entries.size()) >= IMPORT_TXN_MAX_ENTRIES) {
+        txn->commit();
+        txn.reset();
+        txn.emplace(db->open_write_txn_sync());
+        txn_entries = 0;
       }
     }
-    txn.commit();
+    // Votes are imported without updating the rank index, so rebuild it once at the end
+    txn->rescore_thread_ranks(Timestamp{});
+    txn->rescore_comment_ranks(Timestamp{});
+    txn->commit();
     success = true;
     return db;
   }
 
-  template <typename T> static inline auto get_fb(const span<uint8_t>& span) -> const T& {
+  template <typename T> static inline auto get_fb(const span<uint8_t>& span, bool verified = false) -> const T& {
     const auto& root = *GetRoot<T>(span.data());
+    if (verified) return root;
     Verifier verifier(span.data(), span.size());
     if (!root.Verify(verifier)) {
       throw runtime_error("FlatBuffer verification failed on write");
@@ -466,6 +582,22 @@ namespace Ludwig {
     mdb_cursor_close(cur);
   }
 
+  Metrics::Histogram& DB::read_txn_metric = Metrics::histogram(
+    "ludwig_db_read_txn_duration_seconds",
+    "Time LMDB read transactions are held open",
+    Metrics::Unit::Seconds
+  );
+  Metrics::Histogram& DB::write_txn_metric = Metrics::histogram(
+    "ludwig_db_write_txn_duration_seconds",
+    "Time LMDB write transactions are held open, until commit or abort",
+    Metrics::Unit::Seconds
+  );
+  Metrics::Histogram& DB::queue_wait_metric = Metrics::histogram(
+    "ludwig_db_write_queue_wait_seconds",
+    "Time queued write transactions wait for the write lock",
+    Metrics::Unit::Seconds
+  );
+
   auto DB::write_queue_cmp(PendingWriteTxnPtr a, PendingWriteTxnPtr b) -> bool {
     if (a->priority != b->priority) return a->priority < b->priority;
     return a->id > b->id;
@@ -473,28 +605,111 @@ namespace Ludwig {
 
   auto DB::next_write() noexcept -> void {
     PendingWriteTxnPtr next = nullptr;
-    {
-      lock_guard<mutex> g(write_queue_lock);
-      if (!write_queue.empty()) {
-        next = write_queue.top();
-        write_queue.pop();
+    for (;;) {
+      {
+        lock_guard<mutex> g(write_queue_lock);
+        if (!write_queue.empty()) {
+          next = write_queue.top();
+          write_queue.pop();
+          break;
+        } else if (batch_txn == nullptr) {
+          write_lock.release();
+          return;
+        }
       }
+      // Queue is empty, so don't hold the batch open waiting for more writes.
+      // Committing dispatches events, which may queue more writes; check again.
+      commit_batch();
+    }
+    if (batch_txn != nullptr && (
+      batch_size >= batch_options.max_txns ||
+      std::chrono::steady_clock::now() - batch_start >= batch_options.max_delay
+    )) {
+      commit_batch();
+    }
+    const auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - next->queued_at
+    ).count();
+    stat_queue_wait_us.fetch_add((uint64_t)wait, std::memory_order_relaxed);
+    record_max(stat_max_queue_wait_us, (uint64_t)wait);
+    queue_wait_metric.observe((uint64_t)wait * 1000);
+    if (auto* callback = std::get_if<1>(&next->state)) {
+      (*callback)(WriteTxn(*this, true));
+    } else {
+      spdlog::error(
+        "Skipping write transaction queue entry #{:d}: no callback. This is probably an error, and may deadlock!",
+        next->id
+      );
+      next_write();
     }
-    if (next) {
-      if (auto* callback = std::get_if<1>(&next->state)) {
-        (*callback)(WriteTxn(*this, true));
-      } else {
-        spdlog::error(
-          "Skipping write transaction queue entry #{:d}: no callback. This is probably an error, and may deadlock!",
-          next->id
-        );
-        next_write();
+  }
+
+  auto DB::begin_batch() -> MDB_txn* {
+    stat_txns.fetch_add(1, std::memory_order_relaxed);
+    if (batch_options.max_txns <= 1) return nullptr;
+    if (batch_txn == nullptr) {
+      if (auto err = mdb_txn_begin(env, nullptr, 0, &batch_txn)) {
+        batch_txn = nullptr;
+        throw DBError("Failed to open batch write transaction", err);
       }
-    } else {
-      write_lock.release();
+      batch_start = std::chrono::steady_clock::now();
+    }
+    batch_size++;
+    return batch_txn;
+  }
+
+  auto DB::commit_batch() noexcept -> void {
+    const auto start = std::chrono::steady_clock::now();
+    const auto txn = std::exchange(batch_txn, nullptr);
+    const auto size = std::exchange(batch_size, 0);
+    auto events = std::move(batch_events);
+    batch_events.clear();
+    auto commits = std::move(batch_commits);
+    batch_commits.clear();
+    if (auto err = mdb_txn_commit(txn)) {
+      // Every transaction in the batch is lost, and so are their events
+      spdlog::error("Failed to commit batch of {:d} write transactions: {}", size, mdb_strerror(err));
+      stat_failed_batches.fetch_add(1, std::memory_order_relaxed);
+      for (const auto& c : commits) c->complete(false);
+      return;
+    }
+    stat_batches.fetch_add(1, std::memory_order_relaxed);
+    record_max(stat_max_batch_size, size);
+    stat_commit_us.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start
+    ).count(), std::memory_order_relaxed);
+    for (const auto& [event_bus, queued_events] : events) {
+      for (auto [event, subject_id] : queued_events) event_bus->dispatch(event, subject_id);
+    }
+    for (const auto& c : commits) c->complete(true);
+  }
+
+  auto DB::sync() noexcept -> void {
+    if (auto err = mdb_env_sync(env, 1)) {
+      spdlog::error("Failed to sync database to disk: {}", mdb_strerror(err));
     }
   }
 
+  auto DB::write_queue_stats() -> WriteQueueStats {
+    using std::chrono::microseconds;
+    uint64_t depth;
+    {
+      lock_guard<mutex> g(write_queue_lock);
+      depth = write_queue.size();
+    }
+    return {
+      .txns = stat_txns.load(std::memory_order_relaxed),
+      .batches = stat_batches.load(std::memory_order_relaxed),
+      .failed_batches = stat_failed_batches.load(std::memory_order_relaxed),
+      .max_batch_size = stat_max_batch_size.load(std::memory_order_relaxed),
+      .queue_depth = depth,
+      .max_queue_depth = stat_max_queue_depth.load(std::memory_order_relaxed),
+      .total_queue_wait = microseconds(stat_queue_wait_us.load(std::memory_order_relaxed)),
+      .max_queue_wait = microseconds(stat_max_queue_wait_us.load(std::memory_order_relaxed)),
+      .total_commit_time = microseconds(stat_commit_us.load(std::memory_order_relaxed)),
+    };
+  }
+
   auto ReadTxn::get_setting_str(string_view key) -> string_view {
     MDB_val v;
     if (db_get(txn, db.dbis[Settings], key, v)) return {};
@@ -765,6 +980,42 @@ namespace Ludwig {
       Cursor(board_id, 0)
     );
   }
+  auto ReadTxn::list_threads_hot(OptKV cursor) -> DBIter {
+    return DBIter(
+      db.dbis[ThreadsHot_Rank],
+      txn,
+      Dir::Desc,
+      cursor.value_or(pair(Cursor(ID_MAX), ID_MAX)),
+      Cursor(0)
+    );
+  }
+  auto ReadTxn::list_threads_active(OptKV cursor) -> DBIter {
+    return DBIter(
+      db.dbis[ThreadsActive_Rank],
+      txn,
+      Dir::Desc,
+      cursor.value_or(pair(Cursor(ID_MAX), ID_MAX)),
+      Cursor(0)
+    );
+  }
+  auto ReadTxn::list_threads_of_board_hot(uint64_t board_id, OptKV cursor) -> DBIter {
+    return DBIter(
+      db.dbis[ThreadsHot_BoardRank],
+      txn,
+      Dir::Desc,
+      cursor.value_or(pair(Cursor(board_id, ID_MAX), ID_MAX)),
+      Cursor(board_id, 0)
+    );
+  }
+  auto ReadTxn::list_threads_of_board_active(uint64_t board_id, OptKV cursor) -> DBIter {
+    return DBIter(
+      db.dbis[ThreadsActive_BoardRank],
+      txn,
+      Dir::Desc,
+      cursor.value_or(pair(Cursor(board_id, ID_MAX), ID_MAX)),
+      Cursor(board_id, 0)
+    );
+  }
   auto ReadTxn::list_threads_of_user_new(uint64_t user_id, OptKV cursor) -> DBIter {
     return DBIter(
       db.dbis[ThreadsNew_UserTime],
@@ -897,6 +1148,42 @@ namespace Ludwig {
       Cursor(board_id, 0)
     );
   }
+  auto ReadTxn::list_comments_hot(OptKV cursor) -> DBIter {
+    return DBIter(
+      db.dbis[CommentsHot_Rank],
+      txn,
+      Dir::Desc,
+      cursor.value_or(pair(Cursor(ID_MAX), ID_MAX)),
+      Cursor(0)
+    );
+  }
+  auto ReadTxn::list_comments_active(OptKV cursor) -> DBIter {
+    return DBIter(
+      db.dbis[CommentsActive_Rank],
+      txn,
+      Dir::Desc,
+      cursor.value_or(pair(Cursor(ID_MAX), ID_MAX)),
+      Cursor(0)
+    );
+  }
+  auto ReadTxn::list_comments_of_board_hot(uint64_t board_id, OptKV cursor) -> DBIter {
+    return DBIter(
+      db.dbis[CommentsHot_BoardRank],
+      txn,
+      Dir::Desc,
+      cursor.value_or(pair(Cursor(board_id, ID_MAX), ID_MAX)),
+      Cursor(board_id, 0)
+    );
+  }
+  auto ReadTxn::list_comments_of_board_active(uint64_t board_id, OptKV cursor) -> DBIter {
+    return DBIter(
+      db.dbis[CommentsActive_BoardRank],
+      txn,
+      Dir::Desc,
+      cursor.value_or(pair(Cursor(board_id, ID_MAX), ID_MAX)),
+      Cursor(board_id, 0)
+    );
+  }
   auto ReadTxn::list_comments_of_user_new(uint64_t user_id, OptKV cursor) -> DBIter {
     return DBIter(
       db.dbis[CommentsNew_UserTime],
@@ -1212,8 +1499,8 @@ namespace Ludwig {
     set_user(id, span, true);
     return id;
   }
-  auto WriteTxn::set_user(uint64_t id, span<uint8_t> span, bool sequential) -> void {
-    const auto& user = get_fb<User>(span);
+  auto WriteTxn::set_user(uint64_t id, span<uint8_t> span, bool sequential, bool verified) -> void {
+    const auto& user = get_fb<User>(span, verified);
     const auto name = user.name()->str();
     const auto created_at = user.created_at();
     if (const auto old_user_opt = sequential ? nullopt : get_user(id)) {
@@ -1235,8 +1522,8 @@ namespace Ludwig {
     db_put(txn, db.dbis[UsersNewPosts_Time], Cursor(0), id);
     db_put(txn, db.dbis[UsersMostPosts_Posts], Cursor(0), id);
   }
-  auto WriteTxn::set_local_user(uint64_t id, span<uint8_t> span, bool sequential) -> void {
-    const auto& user = get_fb<LocalUser>(span);
+  auto WriteTxn::set_local_user(uint64_t id, span<uint8_t> span, bool sequential, bool verified) -> void {
+    const auto& user = get_fb<LocalUser>(span, verified);
     const auto email = opt_str(user.email());
     MDB_val unused;
     bool user_added = sequential || !!db_get(txn, db.dbis[LocalUser_User], id, unused);
@@ -1350,8 +1637,8 @@ namespace Ludwig {
     set_board(id, span, true);
     return id;
   }
-  auto WriteTxn::set_board(uint64_t id, span<uint8_t> span, bool sequential) -> void {
-    const auto& board = get_fb<Board>(span);
+  auto WriteTxn::set_board(uint64_t id, span<uint8_t> span, bool sequential, bool verified) -> void {
+    const auto& board = get_fb<Board>(span, verified);
     const auto name = board.name()->str();
     const auto created_at = board.created_at();
     if (const auto old_board_opt = sequential ? nullopt : get_board(id)) {
@@ -1374,8 +1661,8 @@ namespace Ludwig {
     db_put(txn, db.dbis[BoardsMostPosts_Posts], Cursor(0), id);
     db_put(txn, db.dbis[BoardsMostSubscribers_Subscribers], Cursor(0), id);
   }
-  auto WriteTxn::set_local_board(uint64_t id, span<uint8_t> span, bool sequential) -> void {
-    const auto owner = get_fb<LocalBoard>(span).owner();
+  auto WriteTxn::set_local_board(uint64_t id, span<uint8_t> span, bool sequential, bool verified) -> void {
+    const auto owner = get_fb<LocalBoard>(span, verified).owner();
     assert_fmt(!!get_user(owner), "set_local_board: board {:x} owner user {:x} does not exist", id, owner);
     if (const auto old_board_opt = sequential ? nullopt : get_local_board(id)) {
       spdlog::debug("Updating local board {:x}", id);
@@ -1426,6 +1713,10 @@ namespace Ludwig {
     delete_range(txn, db.dbis[ThreadsTop_BoardKarma], Cursor(id, 0), Cursor(id, ID_MAX));
     delete_range(txn, db.dbis[CommentsNew_BoardTime], Cursor(id, 0), Cursor(id, ID_MAX));
     delete_range(txn, db.dbis[CommentsTop_BoardKarma], Cursor(id, 0), Cursor(id, ID_MAX));
+    delete_range(txn, db.dbis[ThreadsHot_BoardRank], Cursor(id, 0), Cursor(id, ID_MAX));
+    delete_range(txn, db.dbis[ThreadsActive_BoardRank], Cursor(id, 0), Cursor(id, ID_MAX));
+    delete_range(txn, db.dbis[CommentsHot_BoardRank], Cursor(id, 0), Cursor(id, ID_MAX));
+    delete_range(txn, db.dbis[CommentsActive_BoardRank], Cursor(id, 0), Cursor(id, ID_MAX));
 
     if (const auto local_board = get_local_board(id)) {
       spdlog::debug("Deleting local board {:x}", id);
@@ -1444,8 +1735,8 @@ namespace Ludwig {
 
     return true;
   }
-  auto WriteTxn::set_subscription(uint64_t user_id, uint64_t board_id, bool subscribed) -> void {
-    const bool existing = db_has(txn, db.dbis[UsersSubscribed_Board], board_id, user_id);
+  auto WriteTxn::set_subscription(uint64_t user_id, uint64_t board_id, bool subscribed, bool sequential) -> void {
+    const bool existing = !sequential && db_has(txn, db.dbis[UsersSubscribed_Board], board_id, user_id);
     const auto board_stats = get_board_stats(board_id);
     auto subscriber_count = board_stats ? board_stats->get().subscriber_count() : 0,
       old_subscriber_count = subscriber_count;
@@ -1454,7 +1745,7 @@ namespace Ludwig {
       assert_fmt(!!board_stats, "set_subscription: board {:x} does not exist", board_id);
       if (!existing) {
         spdlog::debug("Subscribing user {:x} to board {:x}", user_id, board_id);
-        db_put(txn, db.dbis[BoardsSubscribed_User], user_id, board_id);
+        db_put(txn, db.dbis[BoardsSubscribed_User], user_id, board_id, sequential ? MDB_APPENDDUP : 0);
         db_put(txn, db.dbis[UsersSubscribed_Board], board_id, user_id);
         subscriber_count++;
       }
@@ -1509,8 +1800,8 @@ namespace Ludwig {
     set_thread(id, span, true);
     return id;
   }
-  auto WriteTxn::set_thread(uint64_t id, span<uint8_t> span, bool sequential) -> void {
-    const auto& thread = get_fb<Thread>(span);
+  auto WriteTxn::set_thread(uint64_t id, span<uint8_t> span, bool sequential, bool verified) -> void {
+    const auto& thread = get_fb<Thread>(span, verified);
     FlatBufferBuilder fbb;
     const auto author_id = thread.author(), board_id = thread.board(), created_at = thread.created_at(), instance = thread.instance();
     const auto url = opt_str(thread.content_url()).and_then([](auto u) {
@@ -1549,6 +1840,7 @@ namespace Ludwig {
           ));
           db_put(txn, db.dbis[BoardStats_Board], old_board_id, fbb.GetBufferSpan());
         }
+        if (!verified) set_rank(id, board_id, uint_to_timestamp(created_at), true, now_t());
       }
     } else {
       spdlog::debug("Creating top-level post {:x} (board {:x}, author {:x})", id, board_id, author_id);
@@ -1565,6 +1857,8 @@ namespace Ludwig {
       fbb.ForceDefaults(true);
       fbb.Finish(CreatePostStats(fbb, created_at));
       db_put(txn, db.dbis[PostStats_Post], id, fbb.GetBufferSpan(), sequential ? MDB_APPEND : 0);
+      // Imports rebuild every rank once they finish (see DB::import)
+      if (!verified) set_rank(id, board_id, uint_to_timestamp(created_at), true, now_t());
       if (!instance) {
         fbb.Clear();
         const auto& s = get_site_stats();
@@ -1660,6 +1954,7 @@ namespace Ludwig {
 
     db_del(txn, db.dbis[ChildrenNew_PostTime], Cursor(parent, created_at), id);
     db_del(txn, db.dbis[ChildrenTop_PostKarma], Cursor(parent, karma_uint(karma)), id);
+    delete_rank(id, false);
 
     phmap::flat_hash_set<uint64_t> children;
     delete_range(txn, db.dbis[ChildrenNew_PostTime], Cursor(id, 0), Cursor(id, ID_MAX),
@@ -1767,6 +2062,7 @@ namespace Ludwig {
     db_del(txn, db.dbis[ThreadsNew_BoardTime], Cursor(board_id, created_at), id);
     db_del(txn, db.dbis[ThreadsTop_BoardKarma], Cursor(board_id, karma_uint(karma)), id);
     db_del(txn, db.dbis[ThreadsMostComments_BoardComments], Cursor(board_id, descendant_count), id);
+    delete_rank(id, true);
     db_del(txn, db.dbis[Thread_Thread], id);
     db_del(txn, db.dbis[PostStats_Post], id);
 
@@ -1780,9 +2076,9 @@ namespace Ludwig {
     set_comment(id, span, true);
     return id;
   }
-  auto WriteTxn::set_comment(uint64_t id, span<uint8_t> span, bool sequential) -> void {
+  auto WriteTxn::set_comment(uint64_t id, span<uint8_t> span, bool sequential, bool verified) -> void {
     using namespace std::chrono;
-    const auto& comment = get_fb<Comment>(span);
+    const auto& comment = get_fb<Comment>(span, verified);
     const auto stats_opt = get_post_stats(id);
     const auto thread_opt = get_thread(comment.thread());
     assert_fmt(!!thread_opt, "set_comment: comment {:x} top-level ancestor thread {:x} does not exist", id, comment.thread());
@@ -1815,6 +2111,8 @@ namespace Ludwig {
       fbb.ForceDefaults(true);
       fbb.Finish(CreatePostStats(fbb, created_at));
       db_put(txn, db.dbis[PostStats_Post], id, fbb.GetBufferSpan());
+      const auto now = now_t();
+      if (!verified) set_rank(id, board_id, created_at_t, false, now);
 
       if (!instance) {
         fbb.Clear();
@@ -1852,6 +2150,7 @@ namespace Ludwig {
             s.karma()
           ));
           db_put(txn, db.dbis[PostStats_Post], parent, fbb.GetBufferSpan());
+          if (is_newer && !verified) set_rank(parent, board_id, parent_created_at, parent == comment.thread(), now);
           if (parent == comment.thread()) {
             db_del(txn, db.dbis[ThreadsMostComments_Comments], last_descendant_count, parent);
             db_del(txn, db.dbis[ThreadsMostComments_BoardComments], Cursor(board_id, last_descendant_count), parent);
@@ -1996,6 +2295,9 @@ namespace Ludwig {
       throw DBError(fmt::format("Cannot set vote on post {:x}", post_id), MDB_NOTFOUND);
     }
     const auto op_id = thread_opt ? thread_opt->get().author() : comment_opt->get().author();
+    const auto created_at = uint_to_timestamp(
+      thread_opt ? thread_opt->get().created_at() : comment_opt->get().created_at()
+    );
     spdlog::debug("Setting vote from user {:x} on post {:x} to {}", user_id, post_id, (int8_t)vote);
     switch (vote) {
       case Vote::Upvote:
@@ -2050,6 +2352,7 @@ namespace Ludwig {
       db_put(txn, db.dbis[ThreadsTop_Karma], karma_uint(new_karma), post_id);
       db_put(txn, db.dbis[ThreadsTop_BoardKarma], Cursor(thread.board(), karma_uint(new_karma)), post_id);
       db_put(txn, db.dbis[ThreadsTop_UserKarma], Cursor(thread.author(), karma_uint(new_karma)), post_id);
+      if (!sequential) set_rank(post_id, thread.board(), created_at, true, now_t());
     } else {
       const auto& comment = get_comment(post_id)->get(); // must get again, location may have changed
       db_del(txn, db.dbis[CommentsTop_Karma], karma_uint(old_karma), post_id);
@@ -2062,15 +2365,115 @@ namespace Ludwig {
         const auto& comment_thread = comment_thread_opt->get();
         db_del(txn, db.dbis[CommentsTop_BoardKarma], Cursor(comment_thread.board(), karma_uint(old_karma)), post_id);
         db_put(txn, db.dbis[CommentsTop_BoardKarma], Cursor(comment_thread.board(), karma_uint(new_karma)), post_id);
+        if (!sequential) set_rank(post_id, comment_thread.board(), created_at, false, now_t());
       }
     }
   }
 
-  auto WriteTxn::create_notification(flatbuffers::span<uint8_t> span) -> uint64_t {
+  // Ranks are non-negative doubles, so their bit patterns sort in the same
+  // order as their values. 0 is reserved as the end key of rank iterators.
+  static inline auto rank_key(double rank) -> uint64_t {
+    uint64_t bits;
+    memcpy(&bits, &rank, sizeof(uint64_t));
+    return std::max<uint64_t>(bits, 1);
+  }
+
+  struct PostRank {
+    uint64_t hot, active, board;
+  };
+
+  static inline auto get_post_rank(MDB_txn* txn, MDB_dbi dbi, uint64_t id) -> optional<PostRank> {
+    MDB_val v;
+    if (db_get(txn, dbi, id, v)) return {};
+    assert(v.mv_size == sizeof(PostRank));
+    PostRank rank;
+    memcpy(&rank, v.mv_data, sizeof(PostRank));
+    return rank;
+  }
+
+  auto WriteTxn::set_rank(uint64_t id, uint64_t board_id, Timestamp created_at, bool is_thread, Timestamp now) -> void {
+    const auto stats_opt = get_post_stats(id);
+    if (!stats_opt) return;
+    const auto& stats = stats_opt->get();
+    const auto numerator = rank_numerator(stats.karma());
+    PostRank rank {
+      .hot = rank_key(numerator / rank_denominator(now - created_at)),
+      .active = rank_key(numerator / rank_denominator(now - uint_to_timestamp(stats.latest_comment()))),
+      .board = board_id
+    };
+    const auto old_rank = get_post_rank(txn, db.dbis[PostRank_Post], id);
+    if (old_rank && old_rank->hot == rank.hot && old_rank->active == rank.active && old_rank->board == rank.board) {
+      return;
+    }
+    if (old_rank) delete_rank(id, is_thread);
+    db_put(txn, db.dbis[is_thread ? ThreadsHot_Rank : CommentsHot_Rank], rank.hot, id);
+    db_put(txn, db.dbis[is_thread ? ThreadsActive_Rank : CommentsActive_Rank], rank.active, id);
+    db_put(txn, db.dbis[is_thread ? ThreadsHot_BoardRank : CommentsHot_BoardRank], Cursor(board_id, rank.hot), id);
+    db_put(txn, db.dbis[is_thread ? ThreadsActive_BoardRank : CommentsActive_BoardRank], Cursor(board_id, rank.active), id);
+    MDB_val kval{ sizeof(uint64_t), &id }, vval{ sizeof(PostRank), &rank };
+    db_put(txn, db.dbis[PostRank_Post], kval, vval);
+  }
+  auto WriteTxn::delete_rank(uint64_t id, bool is_thread) -> void {
+    const auto rank_opt = get_post_rank(txn, db.dbis[PostRank_Post], id);
+    if (!rank_opt) return;
+    const auto& rank = *rank_opt;
+    db_del(txn, db.dbis[is_thread ? ThreadsHot_Rank : CommentsHot_Rank], rank.hot, id);
+    db_del(txn, db.dbis[is_thread ? ThreadsActive_Rank : CommentsActive_Rank], rank.active, id);
+    db_del(txn, db.dbis[is_thread ? ThreadsHot_BoardRank : CommentsHot_BoardRank], Cursor(rank.board, rank.hot), id);
+    db_del(txn, db.dbis[is_thread ? ThreadsActive_BoardRank : CommentsActive_BoardRank], Cursor(rank.board, rank.active), id);
+    db_del(txn, db.dbis[PostRank_Post], id);
+  }
+  auto WriteTxn::rescore_ranks(
+    bool is_thread,
+    Timestamp since,
+    const optional<pair<Cursor, uint64_t>>& from,
+    size_t limit
+  ) -> optional<pair<Cursor, uint64_t>> {
+    const auto since_s = timestamp_to_uint(since);
+    vector<pair<uint64_t, uint64_t>> batch;
+    optional<pair<Cursor, uint64_t>> next;
+    {
+      auto iter = is_thread ? list_threads_new(from) : list_comments_new(from);
+      for (const auto id : iter) {
+        const auto created_at = iter.get_cursor()->int_field_0();
+        if (created_at < since_s) break;
+        if (batch.size() >= limit) {
+          next = pair(Cursor(created_at), id);
+          break;
+        }
+        batch.emplace_back(created_at, id);
+      }
+    }
+    const auto now = now_t();
+    for (const auto [created_at, id] : batch) {
+      uint64_t board_id;
+      if (is_thread) {
+        const auto thread = get_thread(id);
+        if (!thread) continue;
+        board_id = thread->get().board();
+      } else {
+        const auto comment = get_comment(id);
+        if (!comment) continue;
+        const auto thread = get_thread(comment->get().thread());
+        if (!thread) continue;
+        board_id = thread->get().board();
+      }
+      set_rank(id, board_id, uint_to_timestamp(created_at), is_thread, now);
+    }
+    return next;
+  }
+  auto WriteTxn::rescore_thread_ranks(Timestamp since, OptKV from, size_t limit) -> optional<pair<Cursor, uint64_t>> {
+    return rescore_ranks(true, since, from, limit);
+  }
+  auto WriteTxn::rescore_comment_ranks(Timestamp since, OptKV from, size_t limit) -> optional<pair<Cursor, uint64_t>> {
+    return rescore_ranks(false, since, from, limit);
+  }
+
+  auto WriteTxn::create_notification(flatbuffers::span<uint8_t> span, bool verified) -> uint64_t {
     using enum NotificationType;
     // Notification IDs are random.
     // There's a _tiny_ chance of ID collisions, but even if they happen they're harmless.
-    const auto& notification = get_fb<Notification>(span);
+    const auto& notification = get_fb<Notification>(span, verified);
     const uint64_t id = random_uint64(), user_id = notification.user(), created_at = notification.created_at();
     const auto& stats = get_local_user_stats(user_id);
     assert_fmt(!!stats, "create_notification: local user {:x} does not exist", user_id);
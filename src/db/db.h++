@@ -2,10 +2,13 @@
 #include "iter.h++"
 #include "util/common.h++"
 #include "util/jwt.h++"
+#include "util/metrics.h++"
 #include "services/event_bus.h++"
 #include "fbs/records.h++"
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <cmath>
 #include <queue>
 #include <__generator.hpp>
 #include <openssl/evp.h>
@@ -18,6 +21,30 @@ namespace Ludwig {
 
   static constexpr std::chrono::hours ACTIVE_COMMENT_MAX_AGE(48);
 
+  static constexpr size_t DUMP_ENTRY_MAX_SIZE = 4 * MiB;
+
+  static constexpr double RANK_GRAVITY = 1.8;
+
+  // Hot/Active ranks stop decaying at this age. Older posts keep a fixed rank,
+  // which is still ordered consistently with the ranks of newer posts, so the
+  // rank index never has to rescore the whole database.
+  static constexpr std::chrono::hours RANK_MAX_AGE(24 * 7);
+
+  // rescore_*_ranks only needs to visit posts whose ranks may still be
+  // decaying. Active ages from the latest comment, which can be up to
+  // ACTIVE_COMMENT_MAX_AGE after the post; the extra day rescores each post
+  // at least once after its rank stops changing, even if a rescore is missed.
+  static constexpr std::chrono::hours RANK_RESCORE_MAX_AGE =
+    RANK_MAX_AGE + ACTIVE_COMMENT_MAX_AGE + std::chrono::hours(24);
+
+  static inline auto rank_numerator(int64_t karma) -> double {
+    return std::log(std::max<int64_t>(1, 3 + karma));
+  }
+  static inline auto rank_denominator(std::chrono::duration<double> time_diff) -> double {
+    const auto hours = std::chrono::duration_cast<std::chrono::hours>(time_diff).count();
+    return std::pow(std::clamp<int64_t>(hours, 0, RANK_MAX_AGE.count()) + 2L, RANK_GRAVITY);
+  }
+
   class StringVal {
   private:
     const std::string str;
@@ -95,6 +122,32 @@ namespace Ludwig {
       std::runtime_error(message + ": " + std::string(mdb_strerror(mdb_error))) {}
   };
 
+  // Group commit: queued write transactions (see DB::open_write_txn) may be run
+  // as nested transactions inside one shared LMDB transaction, so that a burst
+  // of small writes pays for one commit (and one fsync) instead of many.
+  //
+  // Each queued transaction still commits or aborts independently, but its
+  // changes (and its queued events) only become visible to other transactions
+  // once the whole batch is committed. If the batch fails to commit, every
+  // transaction in it is lost, even though each WriteTxn::commit succeeded;
+  // callers that must not report success early should wait on the result of
+  // WriteTxn::commit.
+  struct WriteBatchOptions {
+    // Max queued transactions per batch; 1 disables group commit
+    size_t max_txns = 1;
+    // Max time a batch stays open. A batch never waits for more writes; it is
+    // committed as soon as the queue is empty or either limit is reached.
+    std::chrono::microseconds max_delay = std::chrono::milliseconds(10);
+    // If nonzero, commits do not fsync (MDB_NOSYNC), and DB::sync must be
+    // called at this interval to bound how much can be lost in a crash.
+    std::chrono::milliseconds sync_interval = std::chrono::milliseconds(0);
+  };
+
+  struct WriteQueueStats {
+    uint64_t txns, batches, failed_batches, max_batch_size, queue_depth, max_queue_depth;
+    std::chrono::microseconds total_queue_wait, max_queue_wait, total_commit_time;
+  };
+
   class DB {
   public:
     class PendingWriteTxn;
@@ -112,13 +165,35 @@ namespace Ludwig {
     std::mutex write_queue_lock;
     std::vector<PendingWriteTxnPtr> write_queue_vec;
     std::priority_queue<PendingWriteTxnPtr, std::vector<PendingWriteTxnPtr>, decltype(write_queue_cmp)*> write_queue;
+
+    // Current group commit batch; only touched by the holder of write_lock
+    WriteBatchOptions batch_options;
+    MDB_txn* batch_txn = nullptr;
+    size_t batch_size = 0;
+    std::chrono::steady_clock::time_point batch_start;
+    std::vector<std::pair<std::shared_ptr<EventBus>, std::vector<std::pair<Event, uint64_t>>>> batch_events;
+    std::vector<std::shared_ptr<CompletableOnce<bool>>> batch_commits;
+
+    std::atomic<uint64_t> stat_txns = 0, stat_batches = 0, stat_failed_batches = 0, stat_max_batch_size = 0,
+      stat_max_queue_depth = 0, stat_queue_wait_us = 0, stat_max_queue_wait_us = 0, stat_commit_us = 0;
+
+    // Shared by every DB in the process
+    static Metrics::Histogram &read_txn_metric, &write_txn_metric, &queue_wait_metric;
+
+    static inline auto record_max(std::atomic<uint64_t>& stat, uint64_t value) -> void {
+      for (auto max = stat.load(std::memory_order_relaxed);
+        value > max && !stat.compare_exchange_weak(max, value, std::memory_order_relaxed););
+    }
     auto init_env(const char* filename, MDB_txn** txn, bool fast) -> int;
     auto next_write() noexcept -> void;
+    auto begin_batch() -> MDB_txn*;
+    auto commit_batch() noexcept -> void;
   public:
     DB(
       const char* filename,
       size_t map_size_mb = 1024,
-      bool move_fast_and_break_things = false
+      bool move_fast_and_break_things = false,
+      WriteBatchOptions batch_options = {}
     );
     DB(const DB&) = delete;
     auto operator=(const DB&) = delete;
@@ -126,17 +201,37 @@ namespace Ludwig {
     auto operator=(DB&&) = delete;
     ~DB();
 
+    // Imports a database dump one entry at a time, calling `read` to fill a
+    // buffer with the next N bytes of the uncompressed dump.
     static auto import(
       const char* filename,
       std::function<size_t (uint8_t*, size_t)> read,
       size_t map_size_mb = 1024
     ) -> std::shared_ptr<DB>;
 
+    // Imports a database dump from batches of entries, in dump order, that
+    // have already been checked with verify_dump_entry; this lets decoding and
+    // verification run on other threads (see DumpController::import_dump).
+    // `next_batch` returns an empty span at the end of the dump, and each batch
+    // must stay valid until the next call.
+    static auto import_batched(
+      const char* filename,
+      std::function<std::span<const Dump* const> ()> next_batch,
+      size_t map_size_mb = 1024
+    ) -> std::shared_ptr<DB>;
+
+    // Verifies a size-prefixed Dump entry, throwing if it is invalid.
+    static auto verify_dump_entry(std::span<const uint8_t> buf) -> const Dump&;
+
     auto open_read_txn() -> ReadTxnImpl;
     auto open_write_txn_sync() -> WriteTxn;
     auto open_write_txn(WritePriority priority = WritePriority::Medium) -> PendingWriteTxnPtr;
     auto debug_print_settings() -> void;
 
+    // Flushes commits made with WriteBatchOptions::sync_interval to disk
+    auto sync() noexcept -> void;
+    auto write_queue_stats() -> WriteQueueStats;
+
     friend class ReadTxn;
     friend class ReadTxnImpl;
     friend class WriteTxn;
@@ -146,11 +241,12 @@ namespace Ludwig {
   protected:
     DB& db;
     MDB_txn* txn;
+    Metrics::Stopwatch opened;
     ReadTxn(DB& db) : db(db) {}
   public:
     ReadTxn(const ReadTxn& from) = delete;
     auto operator=(const ReadTxn&) = delete;
-    ReadTxn(ReadTxn&& from) : db(from.db), txn(from.txn) { from.txn = nullptr; }
+    ReadTxn(ReadTxn&& from) : db(from.db), txn(from.txn), opened(from.opened) { from.txn = nullptr; }
     ReadTxn& operator=(ReadTxn&& from) = delete;
     virtual ~ReadTxn() = default;
 
@@ -205,6 +301,10 @@ namespace Ludwig {
     auto list_threads_of_board_old(uint64_t board_id, OptKV cursor = {}) -> DBIter;
     auto list_threads_of_board_top(uint64_t board_id, OptKV cursor = {}) -> DBIter;
     auto list_threads_of_board_most_comments(uint64_t board_id, OptKV cursor = {}) -> DBIter;
+    auto list_threads_hot(OptKV cursor = {}) -> DBIter;
+    auto list_threads_active(OptKV cursor = {}) -> DBIter;
+    auto list_threads_of_board_hot(uint64_t board_id, OptKV cursor = {}) -> DBIter;
+    auto list_threads_of_board_active(uint64_t board_id, OptKV cursor = {}) -> DBIter;
     auto list_threads_of_user_new(uint64_t user_id, OptKV cursor = {}) -> DBIter;
     auto list_threads_of_user_old(uint64_t user_id, OptKV cursor = {}) -> DBIter;
     auto list_threads_of_user_top(uint64_t user_id, OptKV cursor = {}) -> DBIter;
@@ -221,6 +321,10 @@ namespace Ludwig {
     auto list_comments_of_board_old(uint64_t board_id, OptKV cursor = {}) -> DBIter;
     auto list_comments_of_board_top(uint64_t board_id, OptKV cursor = {}) -> DBIter;
     auto list_comments_of_board_most_comments(uint64_t board_id, OptKV cursor = {}) -> DBIter;
+    auto list_comments_hot(OptKV cursor = {}) -> DBIter;
+    auto list_comments_active(OptKV cursor = {}) -> DBIter;
+    auto list_comments_of_board_hot(uint64_t board_id, OptKV cursor = {}) -> DBIter;
+    auto list_comments_of_board_active(uint64_t board_id, OptKV cursor = {}) -> DBIter;
     auto list_comments_of_user_new(uint64_t user_id, OptKV cursor = {}) -> DBIter;
     auto list_comments_of_user_old(uint64_t user_id, OptKV cursor = {}) -> DBIter;
     auto list_comments_of_user_top(uint64_t user_id, OptKV cursor = {}) -> DBIter;
@@ -265,7 +369,10 @@ namespace Ludwig {
   public:
     ReadTxnImpl(ReadTxnImpl&& from) : ReadTxn(std::move(from)) {};
     ~ReadTxnImpl() {
-      if (txn != nullptr) mdb_txn_abort(txn);
+      if (txn != nullptr) {
+        mdb_txn_abort(txn);
+        DB::read_txn_metric.observe(opened);
+      }
     }
 
     friend class DB;
@@ -273,18 +380,34 @@ namespace Ludwig {
 
   class WriteTxn : public ReadTxn {
   private:
-    bool committed = false, holding_lock;
+    bool committed = false, holding_lock, batched = false;
     std::shared_ptr<EventBus> queued_event_bus = nullptr;
     std::vector<std::pair<Event, uint64_t>> queued_events;
     auto delete_child_comment(uint64_t id, uint64_t board_id) -> uint64_t;
+    auto set_rank(uint64_t id, uint64_t board_id, Timestamp created_at, bool is_thread, Timestamp now) -> void;
+    auto delete_rank(uint64_t id, bool is_thread) -> void;
+    auto rescore_ranks(
+      bool is_thread,
+      Timestamp since,
+      const std::optional<std::pair<Cursor, uint64_t>>& from,
+      size_t limit
+    ) -> std::optional<std::pair<Cursor, uint64_t>>;
 
     WriteTxn(DB& db, bool holding_lock): ReadTxn(db), holding_lock(holding_lock) {
-      if (auto err = mdb_txn_begin(db.env, nullptr, 0, &txn)) {
+      // Only queued transactions are batched; open_write_txn_sync always gets a top-level transaction
+      MDB_txn* parent = holding_lock ? db.begin_batch() : nullptr;
+      batched = parent != nullptr;
+      if (auto err = mdb_txn_begin(db.env, parent, 0, &txn)) {
         throw DBError("Failed to open write transaction", err);
       }
     };
   public:
-    WriteTxn(WriteTxn&& from) : ReadTxn(std::move(from)), committed(from.committed), holding_lock(from.holding_lock) {
+    WriteTxn(WriteTxn&& from) :
+      ReadTxn(std::move(from)),
+      committed(from.committed),
+      holding_lock(from.holding_lock),
+      batched(from.batched)
+    {
       from.committed = true;
       from.holding_lock = false;
     }
@@ -293,6 +416,7 @@ namespace Ludwig {
         spdlog::warn("Aborting uncommitted write transaction");
         if (txn != nullptr) mdb_txn_abort(txn);
       }
+      if (txn != nullptr) DB::write_txn_metric.observe(opened);
       if (holding_lock) db.next_write();
     }
 
@@ -318,32 +442,50 @@ namespace Ludwig {
     ) -> std::pair<uint64_t, uint64_t>;
     auto delete_session(uint64_t session) -> void;
 
+    // `sequential` records are newer than every existing record, so they can be
+    // appended without looking for an old version; `verified` records come
+    // from an import, have already been checked by DB::verify_dump_entry, and
+    // skip rank index updates, since the import rebuilds the index at the end
     auto create_user(flatbuffers::span<uint8_t> span) -> uint64_t;
-    auto set_user(uint64_t id, flatbuffers::span<uint8_t> span, bool sequential = false) -> void;
-    auto set_local_user(uint64_t id, flatbuffers::span<uint8_t> span, bool sequential = false) -> void;
+    auto set_user(uint64_t id, flatbuffers::span<uint8_t> span, bool sequential = false, bool verified = false) -> void;
+    auto set_local_user(uint64_t id, flatbuffers::span<uint8_t> span, bool sequential = false, bool verified = false) -> void;
     auto delete_user(uint64_t id) -> bool;
 
     auto create_board(flatbuffers::span<uint8_t> span) -> uint64_t;
-    auto set_board(uint64_t id, flatbuffers::span<uint8_t> span, bool sequential = false) -> void;
-    auto set_local_board(uint64_t id, flatbuffers::span<uint8_t> span, bool sequential = false) -> void;
+    auto set_board(uint64_t id, flatbuffers::span<uint8_t> span, bool sequential = false, bool verified = false) -> void;
+    auto set_local_board(uint64_t id, flatbuffers::span<uint8_t> span, bool sequential = false, bool verified = false) -> void;
     auto delete_board(uint64_t id) -> bool;
-    auto set_subscription(uint64_t user_id, uint64_t board_id, bool subscribed) -> void;
+    auto set_subscription(uint64_t user_id, uint64_t board_id, bool subscribed, bool sequential = false) -> void;
 
     auto create_thread(flatbuffers::span<uint8_t> span) -> uint64_t;
-    auto set_thread(uint64_t id, flatbuffers::span<uint8_t> span, bool sequential = false) -> void;
+    auto set_thread(uint64_t id, flatbuffers::span<uint8_t> span, bool sequential = false, bool verified = false) -> void;
     auto delete_thread(uint64_t id) -> bool;
 
     auto create_comment(flatbuffers::span<uint8_t> span) -> uint64_t;
-    auto set_comment(uint64_t id, flatbuffers::span<uint8_t> span, bool sequential = false) -> void;
+    auto set_comment(uint64_t id, flatbuffers::span<uint8_t> span, bool sequential = false, bool verified = false) -> void;
     auto delete_comment(uint64_t id) -> uint64_t;
 
     auto set_vote(uint64_t user_id, uint64_t post_id, Vote vote, bool sequential = false) -> void;
+
+    // Hot/Active ranks decay with time, so the rank index must be periodically
+    // recomputed. These rescore up to `limit` posts created after `since`,
+    // newest first, and return the cursor to resume from, or nullopt when done.
+    auto rescore_thread_ranks(
+      Timestamp since,
+      OptKV from = {},
+      size_t limit = std::numeric_limits<size_t>::max()
+    ) -> std::optional<std::pair<Cursor, uint64_t>>;
+    auto rescore_comment_ranks(
+      Timestamp since,
+      OptKV from = {},
+      size_t limit = std::numeric_limits<size_t>::max()
+    ) -> std::optional<std::pair<Cursor, uint64_t>>;
     auto set_save(uint64_t user_id, uint64_t post_id, bool saved) -> void;
     auto set_hide_post(uint64_t user_id, uint64_t post_id, bool hidden) -> void;
     auto set_hide_user(uint64_t user_id, uint64_t hidden_user_id, bool hidden) -> void;
     auto set_hide_board(uint64_t user_id, uint64_t board_id, bool hidden) -> void;
 
-    auto create_notification(flatbuffers::span<uint8_t> span) -> uint64_t;
+    auto create_notification(flatbuffers::span<uint8_t> span, bool verified = false) -> uint64_t;
     auto mark_notification_read(uint64_t user_id, uint64_t id) -> void;
     auto mark_reply_read(uint64_t user_id, uint64_t post_id) -> void;
     auto mark_mention_read(uint64_t user_id, uint64_t post_id) -> void;
@@ -356,15 +498,33 @@ namespace Ludwig {
     auto set_link_card(std::string_view url, flatbuffers::span<uint8_t> span) -> void;
     auto delete_link_card(std::string_view url) -> void;
 
-    inline auto commit() -> void {
+    // Commits this transaction, or throws if it cannot be committed.
+    //
+    // A batched transaction (see WriteBatchOptions) is not committed yet when
+    // this returns: it is lost if its batch later fails to commit. The result
+    // completes with true once the changes are committed, or false if they
+    // were lost; unbatched transactions complete immediately. Committed is not
+    // necessarily on disk: with a sync_interval (--sync-interval-ms), commits
+    // use MDB_NOSYNC and nothing is flushed until DB::sync. The batch can't be
+    // committed while this WriteTxn still holds the write lock, so wait on the
+    // result only after the WriteTxn is destroyed.
+    inline auto commit() -> std::shared_ptr<CompletableOnce<bool>> {
       auto err = mdb_txn_commit(txn);
       if (err) throw DBError("Failed to commit transaction", err);
       committed = true;
+      if (batched) {
+        // Events must wait until the batch they belong to is committed
+        if (queued_event_bus) db.batch_events.emplace_back(std::move(queued_event_bus), std::move(queued_events));
+        auto result = std::make_shared<CompletableOnce<bool>>();
+        db.batch_commits.push_back(result);
+        return result;
+      }
       if (queued_event_bus) {
         for (auto [event, subject_id] : queued_events) {
           queued_event_bus->dispatch(event, subject_id);
         }
       }
+      return std::make_shared<CompletableOnce<bool>>(true);
     }
 
     friend class DB;
@@ -373,8 +533,10 @@ namespace Ludwig {
   class DB::PendingWriteTxn : public CompletableOnce<WriteTxn> {
     uint64_t id;
     WritePriority priority;
+    std::chrono::steady_clock::time_point queued_at;
   public:
-    PendingWriteTxn(uint64_t id, WritePriority priority) : id(id), priority(priority) {}
+    PendingWriteTxn(uint64_t id, WritePriority priority) :
+      id(id), priority(priority), queued_at(std::chrono::steady_clock::now()) {}
     PendingWriteTxn(WriteTxn&& txn) : CompletableOnce<WriteTxn>(std::move(txn)) {}
     friend class DB;
   };
@@ -388,13 +550,18 @@ namespace Ludwig {
   }
 
   inline auto DB::open_write_txn(WritePriority priority) -> PendingWriteTxnPtr {
-    if (write_lock.try_acquire()) {
-      return std::make_shared<PendingWriteTxn>(WriteTxn(*this, true));
+    {
+      // write_lock is only released with write_queue_lock held (see next_write),
+      // so a transaction can't be queued just after the last one releases it
+      std::unique_lock<std::mutex> g(write_queue_lock);
+      if (!write_lock.try_acquire()) {
+        auto id = next_write_queue_id.fetch_add(1, std::memory_order_acq_rel);
+        auto pending = std::make_shared<PendingWriteTxn>(id, priority);
+        write_queue.push(pending);
+        record_max(stat_max_queue_depth, write_queue.size());
+        return pending;
+      }
     }
-    std::lock_guard<std::mutex> g(write_queue_lock);
-    auto id = next_write_queue_id.fetch_add(1, std::memory_order_acq_rel);
-    auto pending = std::make_shared<PendingWriteTxn>(id, priority);
-    write_queue.push(pending);
-    return pending;
+    return std::make_shared<PendingWriteTxn>(WriteTxn(*this, true));
   }
 }
@@ -3,6 +3,17 @@
 using std::optional, std::pair;
 
 namespace Ludwig {
+  // Positions a cursor at the last entry whose key is less than `key`. Used
+  // when the start key of a descending iterator is not in the database;
+  // MDB_PREV_NODUP alone would restart from the end, because a failed MDB_SET
+  // leaves the cursor unpositioned.
+  static inline auto seek_before(MDB_cursor* cur, MDB_val& key, MDB_val& value) -> int {
+    if (const auto err = mdb_cursor_get(cur, &key, &value, MDB_SET_RANGE)) {
+      return err == MDB_NOTFOUND ? mdb_cursor_get(cur, &key, &value, MDB_LAST) : err;
+    }
+    return mdb_cursor_get(cur, &key, &value, MDB_PREV_NODUP);
+  }
+
   DBIter::DBIter(
     MDB_dbi dbi,
     MDB_txn* txn,
@@ -21,7 +32,8 @@ namespace Ludwig {
         : (from_key ? MDB_SET : MDB_LAST)
       );
       if (err == MDB_NOTFOUND && dir == Dir::Desc && from_key) {
-        err = mdb_cursor_get(cur, &key, &value, MDB_PREV_NODUP);
+        key = *from_key;
+        err = seek_before(cur, key, value);
       }
       if (err) {
         if (err != MDB_NOTFOUND) {
@@ -29,7 +41,12 @@ namespace Ludwig {
           spdlog::error("Database error in iterator: {}", mdb_strerror(err));
         }
         done = true;
-      } else done = reached_to_key();
+      } else {
+        // MDB_SET and MDB_GET_BOTH don't update `key`, which would otherwise
+        // still point to the (temporary) search key
+        mdb_cursor_get(cur, &key, &value, MDB_GET_CURRENT);
+        done = reached_to_key();
+      }
     }
   }
 
@@ -54,7 +71,7 @@ namespace Ludwig {
         case Dir::Asc:
           if (!(err = mdb_cursor_get(cur, &key, &value, MDB_SET_RANGE))) {
             auto key_ref = from_kv.first.val(), value_ref = value_cur.val();
-            while (!err && !mdb_cmp(txn, dbi, &key, &key_ref) && mdb_cmp(txn, dbi, &value, &value_ref) < 0) {
+            while (!err && !mdb_cmp(txn, dbi, &key, &key_ref) && mdb_dcmp(txn, dbi, &value, &value_ref) < 0) {
               err = mdb_cursor_get(cur, &key, &value, MDB_NEXT);
             }
           }
@@ -63,11 +80,12 @@ namespace Ludwig {
           if (!(err = mdb_cursor_get(cur, &key, &value, MDB_SET))) {
             err = mdb_cursor_get(cur, &key, &value, MDB_LAST_DUP);
             auto key_ref = from_kv.first.val(), value_ref = value_cur.val();
-            while (!err && !mdb_cmp(txn, dbi, &key, &key_ref) && mdb_cmp(txn, dbi, &value, &value_ref) > 0) {
+            while (!err && !mdb_cmp(txn, dbi, &key, &key_ref) && mdb_dcmp(txn, dbi, &value, &value_ref) > 0) {
               err = mdb_cursor_get(cur, &key, &value, MDB_PREV);
             }
           } else if (err == MDB_NOTFOUND) {
-            err = mdb_cursor_get(cur, &key, &value, MDB_PREV_NODUP);
+            key = from_kv.first.val();
+            err = seek_before(cur, key, value);
           }
           break;
         }
@@ -78,7 +96,12 @@ namespace Ludwig {
           spdlog::error("Database error in iterator: {}", mdb_strerror(err));
         }
         done = true;
-      } else done = reached_to_key();
+      } else {
+        // MDB_SET and MDB_GET_BOTH don't update `key`, which would otherwise
+        // still point to the (temporary) search key
+        mdb_cursor_get(cur, &key, &value, MDB_GET_CURRENT);
+        done = reached_to_key();
+      }
     }
   }
 
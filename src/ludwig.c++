@@ -6,11 +6,13 @@
 #include "services/asio_http_client.h++"
 #include "services/asio_event_bus.h++"
 #include "services/lmdb_search_engine.h++"
+#include "services/rich_text_cache.h++"
 #include "controllers/board_controller.h++"
 #include "controllers/dump_controller.h++"
 #include "controllers/first_run_controller.h++"
 #include "controllers/lemmy_api_controller.h++"
 #include "controllers/post_controller.h++"
+#include "controllers/rank_controller.h++"
 #include "controllers/remote_media_controller.h++"
 #include "controllers/search_controller.h++"
 #include "controllers/session_controller.h++"
@@ -19,6 +21,7 @@
 #include "views/webapp/routes.h++"
 #include "views/media_routes.h++"
 #include "views/lemmy_api_routes.h++"
+#include "views/router_common.h++"
 #include "vips/vips.h"
 #include <uWebSockets/App.h>
 #include <asio.hpp>
@@ -84,6 +87,46 @@ int main(int argc, char** argv) {
     .type("INT")
     .help("max requests per 5 minutes from a single IP (default = 3000)")
     .set_default(3000);
+  parser.add_option("--html-cache-size")
+    .dest("html_cache_size")
+    .type("INT")
+    .help("memory used to cache rendered post content, in MiB; 0 disables the cache (default = 64)")
+    .set_default(64);
+  parser.add_option("--thumbnail-cache")
+    .dest("thumbnail_cache")
+    .type("FILE.mdb")
+    .help("thumbnail cache filename, will be created if it does not exist (default = thumbnails.mdb)")
+    .set_default("thumbnails.mdb");
+  parser.add_option("--thumbnail-cache-size")
+    .dest("thumbnail_cache_size")
+    .type("INT")
+    .help("disk space used to keep thumbnails across restarts, in MiB; 0 disables the thumbnail cache file (default = 512)")
+    .set_default(512);
+  parser.add_option("--thumbnail-threads")
+    .dest("thumbnail_threads")
+    .type("INT")
+    .help("number of threads that decode and resize images for thumbnails (default = 2)")
+    .set_default(2);
+  parser.add_option("--write-batch")
+    .dest("write_batch")
+    .type("INT")
+    .help("max queued database writes to commit together; writes only become visible once their batch commits, and are all lost if it fails (default = 1, no batching)")
+    .set_default(1);
+  parser.add_option("--write-batch-ms")
+    .dest("write_batch_ms")
+    .type("INT")
+    .help("max time a batch of database writes stays open, in milliseconds (default = 10)")
+    .set_default(10);
+  parser.add_option("--sync-interval-ms")
+    .dest("sync_interval_ms")
+    .type("INT")
+    .help("if nonzero, don't sync the database to disk on every commit, only at this interval; a crash may lose writes made since the last sync (default = 0)")
+    .set_default(0);
+  parser.add_option("--metrics-port")
+    .dest("metrics_port")
+    .type("INT")
+    .help("if nonzero, serve Prometheus metrics at /metrics on this port, on 127.0.0.1 only (default = 0, disabled)")
+    .set_default(0);
   parser.add_option("-t", "--threads")
     .dest("threads")
     .type("INT")
@@ -103,6 +146,14 @@ int main(int argc, char** argv) {
   const auto dbfile = options["db"].c_str();
   const auto map_size = stoull(options["map_size"]);
   const auto rate_limit = (double)stoull(options["rate_limit"]);
+  const auto html_cache_size = stoull(options["html_cache_size"]);
+  const auto thumbnail_cache_size = stoull(options["thumbnail_cache_size"]);
+  const auto thumbnail_threads = std::max(1ULL, stoull(options["thumbnail_threads"]));
+  const WriteBatchOptions write_batch {
+    .max_txns = std::max(1ULL, stoull(options["write_batch"])),
+    .max_delay = std::chrono::milliseconds(stoull(options["write_batch_ms"])),
+    .sync_interval = std::chrono::milliseconds(stoull(options["sync_interval_ms"]))
+  };
   auto threads = stoull(options["threads"]);
   if (!threads) {
 #   ifdef LUDWIG_DEBUG
@@ -115,9 +166,10 @@ int main(int argc, char** argv) {
   spdlog::set_level(spdlog::level::from_str(log_level));
 
   shared_ptr<SearchEngine> search_engine = nullptr;
+  shared_ptr<LmdbSearchEngine> lmdb_search_engine = nullptr;
   if (options["search"].starts_with("lmdb:")) {
     const auto filename = options["search"].substr(5);
-    search_engine = make_shared<LmdbSearchEngine>(filename, map_size);
+    search_engine = lmdb_search_engine = make_shared<LmdbSearchEngine>(filename, map_size);
   } else if (options["search"] != "none") {
     spdlog::critical(R"(Invalid --search option: {} (must be "none" or "lmdb:filename.mdb"))", options["search"]);
     return EXIT_FAILURE;
@@ -144,6 +196,7 @@ int main(int argc, char** argv) {
     try {
       spdlog::info("Importing database dump from {}", importfile);
       DumpController::import_dump(dbfile, f.get(), file_size, search_engine, map_size);
+      if (lmdb_search_engine) lmdb_search_engine->set_reindex_required(false);
       spdlog::info("Import complete. You can now start Ludwig without --import.");
       return EXIT_SUCCESS;
     } catch (const runtime_error& e) {
@@ -152,7 +205,7 @@ int main(int argc, char** argv) {
     }
   }
 
-  auto db = make_shared<DB>(dbfile, map_size);
+  auto db = make_shared<DB>(dbfile, map_size, false, write_batch);
   auto dump_controller = make_shared<DumpController>();
   if (options.is_set_by_user("export")) {
     const auto exportfile = options["export"];
@@ -163,8 +216,7 @@ int main(int argc, char** argv) {
     }
     try {
       spdlog::info("Exporting database dump to {}", exportfile);
-      auto txn = db->open_read_txn();
-      for (auto chunk : dump_controller->export_dump(txn)) {
+      for (auto chunk : dump_controller->export_dump(*db)) {
         fwrite(chunk.data(), 1, chunk.size(), f.get());
       };
       spdlog::info("Export complete.");
@@ -204,6 +256,15 @@ int main(int argc, char** argv) {
     spdlog::critical("Invalid port: {}", options["port"]);
     return EXIT_FAILURE;
   }
+  auto metrics_port = std::stoi(options["metrics_port"]);
+  if (metrics_port < 0 || metrics_port > 65535 || metrics_port == port) {
+    spdlog::critical("Invalid metrics port: {}", options["metrics_port"]);
+    return EXIT_FAILURE;
+  }
+  if (metrics_port && !Metrics::enabled) {
+    spdlog::warn("Ludwig was built without metrics (-Dmetrics=false), ignoring --metrics-port");
+    metrics_port = 0;
+  }
 
   optional<SecretString> first_run_admin_password = {};
   if (first_run) {
@@ -240,16 +301,80 @@ int main(int argc, char** argv) {
   auto board_c = make_shared<BoardController>(site_c, event_bus);
   auto user_c = make_shared<UserController>(site_c, event_bus);
   auto post_c = make_shared<PostController>(site_c, event_bus);
+  auto rank_c = make_shared<RankController>(db);
+  auto rich_text_cache = html_cache_size ? make_shared<RichTextCache>(html_cache_size * MiB, event_bus) : nullptr;
   auto search_c = make_shared<SearchController>(db, search_engine, event_bus);
+  if (lmdb_search_engine && lmdb_search_engine->reindex_required()) {
+    spdlog::info("Rebuilding search index, this may take a while...");
+    search_c->index_all();
+    lmdb_search_engine->set_reindex_required(false);
+    spdlog::info("Search index rebuilt");
+  }
   auto session_c = make_shared<SessionController>(db, site_c, user_c, std::move(first_run_admin_password));
   auto first_run_c = make_shared<FirstRunController>(user_c, board_c, site_c);
   auto dump_c = make_shared<DumpController>();
   auto api_c = make_shared<Lemmy::ApiController>(site_c, user_c, session_c, board_c, post_c, search_c, first_run_c);
+  auto thumbnail_store = thumbnail_cache_size
+    ? make_shared<ThumbnailStore>(options["thumbnail_cache"], thumbnail_cache_size * MiB)
+    : nullptr;
+  // Each queued decode holds a downloaded image, so the queue is kept short
+  auto thumbnail_workers = make_shared<ThumbnailWorkers>(thumbnail_threads, thumbnail_threads * 16);
   auto remote_media_c = make_shared<RemoteMediaController>(
     pool.io, db, http_client, xml_ctx, event_bus,
-    [&pool](auto f) { pool.post(std::move(f)); }
+    [thumbnail_workers](auto f) { return thumbnail_workers->try_post(std::move(f)); },
+    thumbnail_store
   );
 
+  if constexpr (Metrics::enabled) {
+    // Stats that DB and RichTextCache already keep are only read on request
+    using Metrics::Type;
+    Metrics::callback("ludwig_db_write_queue_depth", "Write transactions waiting for the write lock", Type::Gauge,
+      [db] { return (double)db->write_queue_stats().queue_depth; });
+    Metrics::callback("ludwig_db_write_txns_total", "Queued write transactions run", Type::Counter,
+      [db] { return (double)db->write_queue_stats().txns; });
+    Metrics::callback("ludwig_db_write_batches_total", "Group commit batches committed", Type::Counter,
+      [db] { return (double)db->write_queue_stats().batches; });
+    Metrics::callback("ludwig_db_write_batches_failed_total", "Group commit batches that failed to commit", Type::Counter,
+      [db] { return (double)db->write_queue_stats().failed_batches; });
+    Metrics::callback("ludwig_db_write_batch_commit_seconds_total", "Time spent committing group commit batches", Type::Counter,
+      [db] { return std::chrono::duration<double>(db->write_queue_stats().total_commit_time).count(); });
+    if (rich_text_cache) {
+      Metrics::callback("ludwig_html_cache_hits_total", "Rendered post HTML cache hits", Type::Counter,
+        [rich_text_cache] { return (double)rich_text_cache->stats().hits; });
+      Metrics::callback("ludwig_html_cache_misses_total", "Rendered post HTML cache misses", Type::Counter,
+        [rich_text_cache] { return (double)rich_text_cache->stats().misses; });
+      Metrics::callback("ludwig_html_cache_evictions_total", "Rendered post HTML cache evictions", Type::Counter,
+        [rich_text_cache] { return (double)rich_text_cache->stats().evictions; });
+      Metrics::callback("ludwig_html_cache_bytes", "Approximate size of the rendered post HTML cache", Type::Gauge,
+        [rich_text_cache] { return (double)rich_text_cache->stats().bytes; });
+    }
+    Metrics::callback("ludwig_thumbnail_decode_queue_depth", "Thumbnail decodes waiting for a thread", Type::Gauge,
+      [thumbnail_workers] { return (double)thumbnail_workers->queued(); });
+    if (thumbnail_store) {
+      Metrics::callback("ludwig_thumbnail_store_hits_total", "Thumbnails found in the thumbnail cache file", Type::Counter,
+        [thumbnail_store] { return (double)thumbnail_store->stats().hits; });
+      Metrics::callback("ludwig_thumbnail_store_misses_total", "Thumbnails not found in the thumbnail cache file", Type::Counter,
+        [thumbnail_store] { return (double)thumbnail_store->stats().misses; });
+      Metrics::callback("ludwig_thumbnail_store_evictions_total", "Thumbnails evicted from the thumbnail cache file", Type::Counter,
+        [thumbnail_store] { return (double)thumbnail_store->stats().evictions; });
+      Metrics::callback("ludwig_thumbnail_store_entries", "Thumbnails in the thumbnail cache file", Type::Gauge,
+        [thumbnail_store] { return (double)thumbnail_store->stats().entries; });
+      Metrics::callback("ludwig_thumbnail_store_bytes", "Approximate size of the thumbnails in the thumbnail cache file", Type::Gauge,
+        [thumbnail_store] { return (double)thumbnail_store->stats().bytes; });
+    }
+  }
+
+  asio::co_spawn(*pool.io, rank_c->rescore_loop(), asio::detached);
+  if (write_batch.sync_interval.count() > 0) {
+    asio::co_spawn(*pool.io, [db, interval = write_batch.sync_interval]() -> Async<void> {
+      for (;;) {
+        asio::steady_timer timer(co_await asio::this_coro::executor, interval);
+        co_await timer.async_wait(asio::deferred);
+        db->sync();
+      }
+    }, asio::detached);
+  }
+
   struct sigaction sigint_handler { .sa_flags = 0 }, sigterm_handler { .sa_flags = 0 };
   sigint_handler.sa_handler = signal_handler;
   sigterm_handler.sa_handler = signal_handler;
@@ -261,7 +386,7 @@ int main(int argc, char** argv) {
 
   vector<thread> running_threads(threads - 1);
   auto run = [&] {
-    uWS::App app;
+    uWS::App app, metrics_app;
     define_media_routes(app, remote_media_c);
     define_webapp_routes(
       app,
@@ -274,21 +399,39 @@ int main(int argc, char** argv) {
       search_c,
       first_run_c,
       dump_c,
-      rate_limiter
+      rate_limiter,
+      rich_text_cache
     );
     Lemmy::define_api_routes(app, db, api_c, rate_limiter);
-    app.listen(port, [port, app = &app](auto *listen_socket) {
+    bool listening = false;
+    app.listen(port, [port, app = &app, &listening](auto *listen_socket) {
       if (listen_socket) {
         lock_guard<mutex> lock(on_close_mutex);
         on_close.push_back([app] { app->close(); });
         spdlog::info("Thread listening on port {}", port);
+        listening = true;
       }
-    }).run();
+    });
+    // Metrics are served on a separate, loopback-only listener, so they are
+    // never exposed on the public port
+    if (listening && metrics_port) {
+      define_metrics_route(metrics_app);
+      metrics_app.listen("127.0.0.1", metrics_port, [metrics_port, app = &metrics_app](auto *listen_socket) {
+        if (listen_socket) {
+          lock_guard<mutex> lock(on_close_mutex);
+          on_close.push_back([app] { app->close(); });
+        } else {
+          spdlog::error("Failed to listen for metrics on 127.0.0.1:{}", metrics_port);
+        }
+      });
+    }
+    app.run();
   };
   for (size_t i = 1; i < threads; i++) running_threads.emplace_back(run);
   run();
   pool.stop();
   for (auto& th : running_threads) if (th.joinable()) th.join();
+  thumbnail_workers->stop();
   vips_shutdown();
 
   if (!on_close.empty()) {
@@ -1,11 +1,45 @@
 #include "asio_event_bus.h++"
+#include "util/metrics.h++"
+#include <array>
 
 using std::make_shared, std::pair, std::shared_lock, std::shared_mutex,
     std::unique_lock;
 
 namespace Ludwig {
 
+  static constexpr std::array<std::string_view, (size_t)Event::MAX> event_names {
+    "SiteUpdate",
+    "UserUpdate",
+    "UserStatsUpdate",
+    "LocalUserUpdate",
+    "UserDelete",
+    "BoardUpdate",
+    "BoardStatsUpdate",
+    "LocalBoardUpdate",
+    "BoardDelete",
+    "ThreadFetchLinkCard",
+    "ThreadUpdate",
+    "ThreadDelete",
+    "CommentUpdate",
+    "CommentDelete",
+    "PostStatsUpdate",
+    "Notification",
+  };
+
+  static const auto dispatch_metrics = [] {
+    std::array<Metrics::Counter*, (size_t)Event::MAX> counters;
+    for (size_t i = 0; i < counters.size(); i++) {
+      counters[i] = &Metrics::counter(
+        "ludwig_events_dispatched_total",
+        "Events dispatched on the event bus, by event type",
+        {{"event", event_names[i]}}
+      );
+    }
+    return counters;
+  }();
+
   auto AsioEventBus::dispatch(Event event, uint64_t subject_id) -> void {
+    dispatch_metrics[(size_t)event]->inc();
     shared_lock<shared_mutex> lock(listener_lock);
     if (event == Event::SiteUpdate) subject_id = 0;
     auto range = event_listeners.equal_range({ event, 0 });
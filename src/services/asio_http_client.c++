@@ -26,6 +26,12 @@ namespace Ludwig {
     },
     cert_file_name = "ca-certificates.crt";
 
+  static constexpr string_view REQUEST_METRIC = "ludwig_http_client_request_duration_seconds",
+    REQUEST_HELP = "Time taken by outgoing HTTP requests, including redirects, by whether they got a response";
+  static Metrics::Histogram
+    &response_metric = Metrics::histogram(REQUEST_METRIC, REQUEST_HELP, Metrics::Unit::Seconds, {{"result", "response"}}),
+    &error_metric = Metrics::histogram(REQUEST_METRIC, REQUEST_HELP, Metrics::Unit::Seconds, {{"result", "error"}});
+
   AsioHttpClient::AsioHttpClient(
     shared_ptr<io_context> io,
     uint32_t req_per_5min,
@@ -255,7 +261,8 @@ namespace Ludwig {
     asio::co_spawn(
       io->get_executor(),
       [this, req = std::move(from_req)] mutable { return fetch(std::move(req)); },
-      [callback = std::move(callback)](exception_ptr ep, auto rsp) mutable {
+      [callback = std::move(callback), stopwatch = Metrics::Stopwatch()](exception_ptr ep, auto rsp) mutable {
+        (ep ? error_metric : response_metric).observe(stopwatch);
         if (ep) {
           try { rethrow_exception(ep); }
           catch (const runtime_error& e) { callback(make_unique<ErrorHttpClientResponse>(e.what())); }
@@ -1,21 +1,144 @@
 #include "lmdb_search_engine.h++"
 #include "services/search_engine.h++"
 #include "util/rich_text.h++"
+#include "util/metrics.h++"
 #include "static/en.wiki.bpe.vs200000.model.h++"
+#include <bit>
+#include <cmath>
+#include <queue>
+#include <utility>
 
-using std::inserter, std::make_shared, std::make_unique, std::optional, std::pair,
-    std::runtime_error, std::string, std::string_view, std::vector, phmap::flat_hash_set;
+using std::array, std::make_shared, std::min, std::optional, std::pair,
+    std::priority_queue, std::runtime_error, std::string, std::string_view,
+    std::vector, phmap::flat_hash_map, phmap::flat_hash_set;
 
 namespace Ludwig {
+  // The search database contains four DBIs:
+  //
+  // - Meta:     "version" -> uint32; [type] -> TypeStats
+  // - Docs:     [type][id] -> DocHeader, DocTerm[]  (forward index)
+  // - Terms:    [type][term] -> TermStats
+  // - Postings: [type][term][last doc key] -> compressed block of postings
+  //
+  // Integers in keys are big-endian, so that the default LMDB comparator sorts
+  // them. Posting lists are sorted by doc key, which is the bitwise NOT of the
+  // ID, so that the newest documents come first. Each block of a posting list
+  // is keyed by its last doc key, so the B-tree doubles as a skip list:
+  // MDB_SET_RANGE on [type][term][target] finds the only block that can
+  // contain `target`.
+  //
+  // Version 1 (one DUPSORT DBI per result type, without term frequencies or
+  // document metadata) cannot be migrated in place; it is dropped and
+  // reindex_required() is set.
+
+  static constexpr uint32_t VERSION = 2;
+  static constexpr size_t BLOCK_SIZE = 128, MAX_QUERY_TERMS = 32;
+  static constexpr uint64_t END = std::numeric_limits<uint64_t>::max();
+  static const MDB_val
+    VERSION_KEY { .mv_size = 7, .mv_data = const_cast<char*>("version") },
+    REINDEX_KEY { .mv_size = 7, .mv_data = const_cast<char*>("reindex") };
+
+  // Filter terms are indexed like tokens (SentencePiece IDs are < 2^31), with
+  // no frequency or length, so that filters can use the same skipping as
+  // query terms
+  static constexpr uint64_t BOARD_TERM = 1ULL << 63, CW_TERM = 1ULL << 62;
+
+  // BM25 parameters
+  static constexpr double K1 = 1.2, B = 0.75;
+
+  // Top has no index by karma, so it reads the karma of every match. Keys are
+  // newest-first, so for queries with more matches than this (per tokenization
+  // of the query), Top only ranks the newest TOP_MAX_MATCHES of them: an older,
+  // higher-karma match past that limit is never returned.
+  static constexpr size_t TOP_MAX_MATCHES = 10'000;
+
+  static constexpr std::string_view QUERY_METRIC = "ludwig_search_query_duration_seconds",
+    QUERY_HELP = "Time taken by LmdbSearchEngine queries, by sort order";
+  // Indexed by SearchResultSort
+  static const array<Metrics::Histogram*, 3> query_metrics {
+    &Metrics::histogram(QUERY_METRIC, QUERY_HELP, Metrics::Unit::Seconds, {{"sort", "Relevant"}}),
+    &Metrics::histogram(QUERY_METRIC, QUERY_HELP, Metrics::Unit::Seconds, {{"sort", "Top"}}),
+    &Metrics::histogram(QUERY_METRIC, QUERY_HELP, Metrics::Unit::Seconds, {{"sort", "New"}}),
+  };
+
+  struct TypeStats {
+    uint64_t doc_count, total_length;
+  };
+
+  struct TermStats {
+    uint64_t doc_count;
+    // Upper bounds, for WAND; never decreased when documents are removed
+    uint32_t max_tf, min_length;
+  };
+
+  struct DocHeader {
+    uint64_t board_id;
+    int64_t karma;
+    uint32_t length, term_count;
+    bool cw;
+  };
+
+  struct DocTerm {
+    uint64_t term, tf;
+  };
+
+  struct LmdbSearchEngine::Doc {
+    flat_hash_map<uint64_t, uint32_t> terms;
+    uint32_t length = 0;
+    uint64_t board_id = 0;
+    bool cw = false;
+  };
+
   static inline auto int_val(uint64_t* i) -> MDB_val {
     return { .mv_size = sizeof(uint64_t), .mv_data = reinterpret_cast<void*>(i) };
   }
 
+  template <typename T> static inline auto struct_val(T* t) -> MDB_val {
+    return { .mv_size = sizeof(T), .mv_data = reinterpret_cast<void*>(t) };
+  }
+
+  template <typename T> static inline auto read_val(const MDB_val& v, size_t offset = 0) -> T {
+    assert(v.mv_size >= offset + sizeof(T));
+    T t;
+    memcpy(&t, reinterpret_cast<const uint8_t*>(v.mv_data) + offset, sizeof(T));
+    return t;
+  }
+
+  static inline auto doc_key(uint64_t id) -> uint64_t { return ~id; }
+
+  struct Key {
+    uint8_t bytes[17];
+    size_t size;
+
+    static auto put_be(uint8_t* p, uint64_t x) -> void {
+      for (int i = 7; i >= 0; i--, x >>= 8) p[i] = (uint8_t)x;
+    }
+
+    Key(SearchResultType type, uint64_t a) : size(9) {
+      bytes[0] = (uint8_t)type;
+      put_be(bytes + 1, a);
+    }
+    Key(SearchResultType type, uint64_t a, uint64_t b) : size(17) {
+      bytes[0] = (uint8_t)type;
+      put_be(bytes + 1, a);
+      put_be(bytes + 9, b);
+    }
+
+    auto val() -> MDB_val { return { .mv_size = size, .mv_data = bytes }; }
+
+    // True if `k` is a posting list key with the same type and term as this key
+    auto same_list(const MDB_val& k) const -> bool {
+      return k.mv_size == 17 && !memcmp(k.mv_data, bytes, 9);
+    }
+  };
+
   struct LmdbSearchEngine::Txn {
     MDB_txn* txn;
     bool committed = false;
     Txn(MDB_env* env, unsigned flags) {
-      mdb_txn_begin(env, nullptr, flags, &txn);
+      if (auto err = mdb_txn_begin(env, nullptr, flags, &txn)) {
+        throw runtime_error(fmt::format("Search database transaction failed: {}", mdb_strerror(err)));
+      }
     }
     ~Txn() {
       if (!committed) mdb_txn_abort(txn);
@@ -27,49 +150,429 @@ namespace Ludwig {
       committed = true;
       return 0;
     }
-    auto get_all(MDB_dbi dbi, uint64_t key) -> flat_hash_set<uint64_t> {
-      flat_hash_set<uint64_t> set;
-      MDB_cursor* cur;
-      MDB_val k = int_val(&key), v;
-      if (mdb_cursor_open(txn, dbi, &cur)) goto done;
-      if (mdb_cursor_get(cur, &k, &v, MDB_SET)) goto done;
-      while (!mdb_cursor_get(cur, &k, &v, MDB_NEXT_MULTIPLE)) {
-        assert(v.mv_size % sizeof(uint64_t) == 0);
-        const size_t n = v.mv_size / sizeof(uint64_t);
-        for (size_t i = 0; i < n; i++) {
-          set.emplace_hint(set.end(), reinterpret_cast<uint64_t*>(v.mv_data)[i]);
-        }
+  };
+
+  ////////////////////////////////////////////////////////////////////////////
+  // Posting list blocks
+  //
+  // A block holds up to BLOCK_SIZE postings. It is stored as a BlockHeader,
+  // followed by three bit-packed arrays: the gaps between consecutive doc keys
+  // (minus 1), term frequencies (minus 1), and document lengths. Each array
+  // uses the minimum bit width for its largest value.
+
+  struct BlockHeader {
+    uint16_t count;
+    uint8_t gap_bits, tf_bits, length_bits;
+    uint32_t max_tf, min_length;
+    uint64_t first_key;
+  };
+
+  static constexpr size_t MAX_BLOCK_WORDS = (BLOCK_SIZE * 3 * 64) / 64 + 1;
+
+  struct Block {
+    uint32_t count = 0, max_tf = 0, min_length = 0;
+    // One extra slot, so that a full block can be split after an insert
+    array<uint64_t, BLOCK_SIZE + 1> keys;
+    array<uint32_t, BLOCK_SIZE + 1> tfs, lengths;
+
+    auto last() const -> uint64_t { return keys[count - 1]; }
+
+    auto find(uint64_t key) const -> uint32_t {
+      return (uint32_t)(std::lower_bound(keys.begin(), keys.begin() + count, key) - keys.begin());
+    }
+
+    auto insert(uint32_t i, uint64_t key, uint32_t tf, uint32_t length) -> void {
+      assert(count <= BLOCK_SIZE);
+      memmove(&keys[i + 1], &keys[i], (count - i) * sizeof(uint64_t));
+      memmove(&tfs[i + 1], &tfs[i], (count - i) * sizeof(uint32_t));
+      memmove(&lengths[i + 1], &lengths[i], (count - i) * sizeof(uint32_t));
+      keys[i] = key;
+      tfs[i] = tf;
+      lengths[i] = length;
+      count++;
+    }
+
+    auto erase(uint32_t i, uint32_t n = 1) -> void {
+      assert(i + n <= count);
+      count -= n;
+      memmove(&keys[i], &keys[i + n], (count - i) * sizeof(uint64_t));
+      memmove(&tfs[i], &tfs[i + n], (count - i) * sizeof(uint32_t));
+      memmove(&lengths[i], &lengths[i + n], (count - i) * sizeof(uint32_t));
+    }
+  };
+
+  static inline auto pack(uint64_t* words, size_t& bit, uint64_t value, uint8_t width) -> void {
+    if (!width) return;
+    const size_t w = bit / 64, o = bit % 64;
+    words[w] |= value << o;
+    if (o + width > 64) words[w + 1] |= value >> (64 - o);
+    bit += width;
+  }
+
+  static inline auto unpack(const uint64_t* words, size_t& bit, uint8_t width) -> uint64_t {
+    if (!width) return 0;
+    const size_t w = bit / 64, o = bit % 64;
+    uint64_t value = words[w] >> o;
+    if (o + width > 64) value |= words[w + 1] << (64 - o);
+    bit += width;
+    return width == 64 ? value : value & ((1ULL << width) - 1);
+  }
+
+  static auto encode_block(const Block& b, string& out) -> MDB_val {
+    assert(b.count > 0 && b.count <= BLOCK_SIZE);
+    uint64_t max_gap = 0;
+    uint32_t max_tf = 1, max_length = 0, min_length = std::numeric_limits<uint32_t>::max();
+    for (uint32_t i = 0; i < b.count; i++) {
+      if (i) max_gap = std::max(max_gap, b.keys[i] - b.keys[i - 1] - 1);
+      max_tf = std::max(max_tf, b.tfs[i]);
+      max_length = std::max(max_length, b.lengths[i]);
+      min_length = min(min_length, b.lengths[i]);
+    }
+    const BlockHeader header {
+      .count = (uint16_t)b.count,
+      .gap_bits = (uint8_t)std::bit_width(max_gap),
+      .tf_bits = (uint8_t)std::bit_width(max_tf - 1),
+      .length_bits = (uint8_t)std::bit_width(max_length),
+      .max_tf = max_tf,
+      .min_length = min_length,
+      .first_key = b.keys[0]
+    };
+    const size_t bits = (b.count - 1) * header.gap_bits + b.count * (header.tf_bits + header.length_bits),
+      words = (bits + 63) / 64;
+    uint64_t packed[MAX_BLOCK_WORDS] = {0};
+    size_t bit = 0;
+    for (uint32_t i = 1; i < b.count; i++) pack(packed, bit, b.keys[i] - b.keys[i - 1] - 1, header.gap_bits);
+    for (uint32_t i = 0; i < b.count; i++) pack(packed, bit, b.tfs[i] - 1, header.tf_bits);
+    for (uint32_t i = 0; i < b.count; i++) pack(packed, bit, b.lengths[i], header.length_bits);
+    out.resize(sizeof(BlockHeader) + words * sizeof(uint64_t));
+    memcpy(out.data(), &header, sizeof(BlockHeader));
+    memcpy(out.data() + sizeof(BlockHeader), packed, words * sizeof(uint64_t));
+    return { .mv_size = out.size(), .mv_data = out.data() };
+  }
+
+  static auto decode_block(const MDB_val& v, Block& b) -> void {
+    const auto header = read_val<BlockHeader>(v);
+    assert(header.count > 0 && header.count <= BLOCK_SIZE);
+    // LMDB values are not 8-byte aligned, so copy the packed words out first
+    uint64_t packed[MAX_BLOCK_WORDS];
+    const size_t words = (v.mv_size - sizeof(BlockHeader)) / sizeof(uint64_t);
+    assert(words <= MAX_BLOCK_WORDS);
+    memcpy(packed, reinterpret_cast<const uint8_t*>(v.mv_data) + sizeof(BlockHeader), words * sizeof(uint64_t));
+    b.count = header.count;
+    b.max_tf = header.max_tf;
+    b.min_length = header.min_length;
+    size_t bit = 0;
+    b.keys[0] = header.first_key;
+    for (uint32_t i = 1; i < b.count; i++) b.keys[i] = b.keys[i - 1] + unpack(packed, bit, header.gap_bits) + 1;
+    for (uint32_t i = 0; i < b.count; i++) b.tfs[i] = (uint32_t)unpack(packed, bit, header.tf_bits) + 1;
+    for (uint32_t i = 0; i < b.count; i++) b.lengths[i] = (uint32_t)unpack(packed, bit, header.length_bits);
+  }
+
+  static auto put_or_throw(MDB_txn* txn, MDB_dbi dbi, MDB_val k, MDB_val v) -> void {
+    if (auto err = mdb_put(txn, dbi, &k, &v, 0)) {
+      throw runtime_error(fmt::format("Search database write failed: {}", mdb_strerror(err)));
+    }
+  }
+
+  static auto put_block(MDB_txn* txn, MDB_dbi dbi, SearchResultType type, uint64_t term, const Block& b) -> void {
+    thread_local string buf;
+    Key key(type, term, b.last());
+    MDB_val k = key.val(), v = encode_block(b, buf);
+    if (auto err = mdb_put(txn, dbi, &k, &v, 0)) {
+      throw runtime_error(fmt::format("Search database write failed: {}", mdb_strerror(err)));
+    }
+  }
+
+  static auto del_block(MDB_txn* txn, MDB_dbi dbi, SearchResultType type, uint64_t term, uint64_t last) -> void {
+    Key key(type, term, last);
+    MDB_val k = key.val();
+    if (auto err = mdb_del(txn, dbi, &k, nullptr)) {
+      throw runtime_error(fmt::format("Search database delete failed: {}", mdb_strerror(err)));
+    }
+  }
+
+  // Inserts or replaces the posting for `key` in a posting list.
+  //
+  // New documents have the lowest keys, so most inserts go at the front of a
+  // list. A full block is split in half, unless the insert is at one end of
+  // it; then a new block is started instead, so that sequential inserts still
+  // produce full blocks.
+  static auto posting_insert(
+    MDB_txn* txn,
+    MDB_dbi dbi,
+    SearchResultType type,
+    uint64_t term,
+    uint64_t key,
+    uint32_t tf,
+    uint32_t length
+  ) -> void {
+    MDB_cursor* cur;
+    if (auto err = mdb_cursor_open(txn, dbi, &cur)) {
+      throw runtime_error(fmt::format("Search database write failed: {}", mdb_strerror(err)));
+    }
+    std::unique_ptr<MDB_cursor, void(*)(MDB_cursor*)> cur_guard(cur, mdb_cursor_close);
+    Key seek(type, term, key);
+    MDB_val k = seek.val(), v;
+    Block b;
+    int err = mdb_cursor_get(cur, &k, &v, MDB_SET_RANGE);
+    if (!err && seek.same_list(k)) {
+      decode_block(v, b);
+      const auto i = b.find(key);
+      if (i < b.count && b.keys[i] == key) {
+        b.tfs[i] = tf;
+        b.lengths[i] = length;
+        put_block(txn, dbi, type, term, b);
+        return;
+      }
+      if (b.count < BLOCK_SIZE) {
+        b.insert(i, key, tf, length);
+        put_block(txn, dbi, type, term, b);
+        return;
+      }
+      if (i > 0) {
+        b.insert(i, key, tf, length);
+        Block first;
+        first.count = b.count / 2;
+        std::copy_n(b.keys.begin(), first.count, first.keys.begin());
+        std::copy_n(b.tfs.begin(), first.count, first.tfs.begin());
+        std::copy_n(b.lengths.begin(), first.count, first.lengths.begin());
+        b.erase(0, first.count);
+        put_block(txn, dbi, type, term, first);
+        put_block(txn, dbi, type, term, b);
+        return;
+      }
+      // Inserting before a full block: try the end of the previous block
+      err = mdb_cursor_get(cur, &k, &v, MDB_PREV);
+    } else {
+      // Past the end of the list: try the end of its last block
+      err = mdb_cursor_get(cur, &k, &v, err == MDB_NOTFOUND ? MDB_LAST : MDB_PREV);
+    }
+    if (!err && seek.same_list(k)) {
+      decode_block(v, b);
+      if (b.count < BLOCK_SIZE) {
+        const auto old_last = b.last();
+        b.insert(b.count, key, tf, length);
+        del_block(txn, dbi, type, term, old_last);
+        put_block(txn, dbi, type, term, b);
+        return;
+      }
+    }
+    b.count = 0;
+    b.insert(0, key, tf, length);
+    put_block(txn, dbi, type, term, b);
+  }
+
+  static auto posting_remove(MDB_txn* txn, MDB_dbi dbi, SearchResultType type, uint64_t term, uint64_t key) -> void {
+    Key seek(type, term, key);
+    MDB_cursor* cur;
+    if (auto err = mdb_cursor_open(txn, dbi, &cur)) {
+      throw runtime_error(fmt::format("Search database write failed: {}", mdb_strerror(err)));
+    }
+    std::unique_ptr<MDB_cursor, void(*)(MDB_cursor*)> cur_guard(cur, mdb_cursor_close);
+    MDB_val k = seek.val(), v;
+    if (mdb_cursor_get(cur, &k, &v, MDB_SET_RANGE) || !seek.same_list(k)) return;
+    Block b;
+    decode_block(v, b);
+    const auto i = b.find(key);
+    if (i >= b.count || b.keys[i] != key) return;
+    const auto old_last = b.last();
+    b.erase(i);
+    if (!b.count || i == b.count) del_block(txn, dbi, type, term, old_last);
+    if (b.count) put_block(txn, dbi, type, term, b);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+  // Query evaluation
+
+  static inline auto bm25(double idf, double avg_length, uint32_t tf, uint32_t length) -> double {
+    return idf * (tf * (K1 + 1)) / (tf + K1 * (1 - B + B * length / avg_length));
+  }
+
+  class PostingCursor {
+    std::unique_ptr<MDB_cursor, void(*)(MDB_cursor*)> cur;
+    Key prefix;
+    Block block;
+    uint32_t i = 0;
+    bool done = false;
+
+    auto load(MDB_val k, MDB_cursor_op op) -> bool {
+      MDB_val v;
+      if (mdb_cursor_get(cur.get(), &k, &v, op) || !prefix.same_list(k)) {
+        done = true;
+        return false;
       }
-    done:
-      mdb_cursor_close(cur);
-      return set;
+      decode_block(v, block);
+      i = 0;
+      return true;
     }
-    auto del_vals_in_key(MDB_dbi dbi, uint64_t key, flat_hash_set<uint64_t> vals) -> void {
-      MDB_cursor* cur;
-      MDB_val k = int_val(&key), v;
-      if (mdb_cursor_open(txn, dbi, &cur)) goto done;
-      for (auto value : vals) {
-        v = int_val(&value);
-        if (!mdb_cursor_get(cur, &k, &v, MDB_GET_BOTH)) mdb_cursor_del(cur, 0);
+  public:
+    // Set by the caller, for ordering and BM25 scoring
+    uint64_t doc_count = 0;
+    double idf = 0, avg_length = 1, max_score = 0;
+
+    PostingCursor(MDB_txn* txn, MDB_dbi dbi, SearchResultType type, uint64_t term) :
+      cur(nullptr, mdb_cursor_close), prefix(type, term, 0) {
+      MDB_cursor* c;
+      if (mdb_cursor_open(txn, dbi, &c)) {
+        done = true;
+        return;
       }
-    done:
-      mdb_cursor_close(cur);
+      cur.reset(c);
+      load(prefix.val(), MDB_SET_RANGE);
     }
-    auto del_val_for_all_keys(MDB_dbi dbi, flat_hash_set<uint64_t> keys, uint64_t value) -> void {
-      MDB_cursor* cur;
-      MDB_val k, v = int_val(&value);
-      if (mdb_cursor_open(txn, dbi, &cur)) goto done;
-      for (auto key : keys) {
-        k = int_val(&key);
-        if (!mdb_cursor_get(cur, &k, &v, MDB_GET_BOTH)) mdb_cursor_del(cur, 0);
+
+    auto doc() const -> uint64_t { return done ? END : block.keys[i]; }
+    auto score() const -> double { return bm25(idf, avg_length, block.tfs[i], block.lengths[i]); }
+    // Upper bound on the score of any posting in the current block
+    auto block_max_score() const -> double { return bm25(idf, avg_length, block.max_tf, block.min_length); }
+
+    auto next() -> void {
+      if (done) return;
+      if (++i >= block.count) {
+        MDB_val k {};
+        load(k, MDB_NEXT);
       }
-    done:
-      mdb_cursor_close(cur);
+    }
+
+    // Advances to the first posting >= target
+    auto seek(uint64_t target) -> void {
+      if (done || block.keys[i] >= target) return;
+      if (block.last() < target) {
+        Key k(prefix);
+        Key::put_be(k.bytes + 9, target);
+        if (!load(k.val(), MDB_SET_RANGE) || block.keys[0] >= target) return;
+      }
+      // Gallop: double the step until passing target, then binary search the last step
+      uint32_t bound = 1;
+      while (i + bound < block.count && block.keys[i + bound] < target) bound *= 2;
+      const auto first = block.keys.begin() + i + bound / 2,
+        last = block.keys.begin() + min(i + bound + 1, block.count);
+      i = (uint32_t)(std::lower_bound(first, last, target) - block.keys.begin());
+    }
+  };
+
+  // Board and CW filters on a single result type. The board filter is a
+  // required term and the CW filter is an excluded term; both only move
+  // forward, because candidates are visited in key order.
+  struct Filters {
+    optional<PostingCursor> board, cw;
+
+    // Returns 0 if `key` passes, otherwise the next key that might pass
+    auto check(uint64_t key) -> uint64_t {
+      if (board) {
+        board->seek(key);
+        if (board->doc() != key) return board->doc();
+      }
+      if (cw) {
+        cw->seek(key);
+        if (cw->doc() == key) return key + 1;
+      }
+      return 0;
+    }
+  };
+
+  // Calls `on_match` with every key that is in all of `cursors` and passes
+  // `filters`, in key order, until it returns false. `cursors` should be
+  // sorted by ascending document frequency.
+  template <typename F>
+  static auto conjunction(vector<PostingCursor>& cursors, Filters& filters, F&& on_match) -> void {
+    if (cursors.empty()) return;
+    uint64_t candidate = cursors[0].doc();
+    while (candidate != END) {
+      bool aligned = true;
+      for (auto& c : cursors) {
+        c.seek(candidate);
+        if (c.doc() != candidate) {
+          candidate = c.doc();
+          aligned = false;
+          break;
+        }
+      }
+      if (!aligned) continue;
+      if (const auto skip = filters.check(candidate)) {
+        candidate = skip;
+        continue;
+      }
+      if (!on_match(candidate)) return;
+      cursors[0].next();
+      candidate = cursors[0].doc();
+    }
+  }
+
+  using ScoredKey = pair<double, uint64_t>;
+
+  struct WorseScore {
+    // Min-heap on score, preferring newer (lower) keys on ties
+    auto operator()(const ScoredKey& a, const ScoredKey& b) const -> bool {
+      return a.first > b.first || (a.first == b.first && a.second < b.second);
     }
   };
 
-  constexpr unsigned DBI_FLAGS =
-    MDB_CREATE | MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_REVERSEDUP;
+  // Top-k disjunctive BM25 with WAND: cursors are kept sorted by current doc,
+  // and the first doc ("pivot") whose preceding upper bounds could beat the
+  // k-th best score is the next candidate. Candidates are also checked against
+  // the block-max bounds before scoring.
+  static auto wand(vector<PostingCursor>& cursors, Filters& filters, size_t k) -> vector<ScoredKey> {
+    priority_queue<ScoredKey, vector<ScoredKey>, WorseScore> top;
+    if (!k) return {};
+    const auto threshold = [&] { return top.size() < k ? 0.0 : top.top().first; };
+    vector<PostingCursor*> order;
+    for (auto& c : cursors) order.push_back(&c);
+    while (true) {
+      std::sort(order.begin(), order.end(), [](auto* a, auto* b) { return a->doc() < b->doc(); });
+      double bound = 0;
+      size_t pivot = order.size();
+      for (size_t j = 0; j < order.size() && order[j]->doc() != END; j++) {
+        bound += order[j]->max_score;
+        if (bound > threshold()) {
+          pivot = j;
+          break;
+        }
+      }
+      if (pivot == order.size()) break;
+      const auto pivot_doc = order[pivot]->doc();
+      if (order[0]->doc() != pivot_doc) {
+        // No doc before the pivot can make the top k
+        for (size_t j = 0; j < pivot && order[j]->doc() < pivot_doc; j++) order[j]->seek(pivot_doc);
+        continue;
+      }
+      if (const auto skip = filters.check(pivot_doc)) {
+        for (auto* c : order) c->seek(skip);
+        continue;
+      }
+      double block_bound = 0, score = 0;
+      for (auto* c : order) {
+        if (c->doc() != pivot_doc) break;
+        block_bound += c->block_max_score();
+      }
+      if (block_bound > threshold()) {
+        for (auto* c : order) {
+          if (c->doc() != pivot_doc) break;
+          score += c->score();
+        }
+        if (score > threshold()) {
+          top.emplace(score, pivot_doc);
+          if (top.size() > k) top.pop();
+        }
+      }
+      for (auto* c : order) {
+        if (c->doc() != pivot_doc) break;
+        c->next();
+      }
+    }
+    vector<ScoredKey> results;
+    results.reserve(top.size());
+    while (!top.empty()) {
+      results.push_back(top.top());
+      top.pop();
+    }
+    std::reverse(results.begin(), results.end());
+    return results;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+
+  constexpr unsigned LEGACY_DBI_FLAGS = MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_REVERSEDUP;
 
   LmdbSearchEngine::LmdbSearchEngine(std::filesystem::path filename, size_t map_size_mb)
     : map_size(map_size_mb * MiB - (map_size_mb * MiB) % (size_t)sysconf(_SC_PAGESIZE)) {
@@ -77,18 +580,48 @@ namespace Ludwig {
     int err;
     if ((err =
       mdb_env_create(&env) ||
-      mdb_env_set_maxdbs(env, 6) ||
+      mdb_env_set_maxdbs(env, 9) ||
       mdb_env_set_mapsize(env, map_size) ||
       mdb_env_open(env, filename.c_str(), MDB_NOSUBDIR | MDB_NOSYNC, 0600) ||
       mdb_txn_begin(env, nullptr, 0, &txn) ||
-      mdb_dbi_open(txn, "Id_Tokens", DBI_FLAGS, &Id_Tokens) ||
-      mdb_dbi_open(txn, "Token_Users", DBI_FLAGS, &Token_Users) ||
-      mdb_dbi_open(txn, "Token_Boards", DBI_FLAGS, &Token_Boards) ||
-      mdb_dbi_open(txn, "Token_Threads", DBI_FLAGS, &Token_Threads) ||
-      mdb_dbi_open(txn, "Token_Comments", DBI_FLAGS, &Token_Comments) ||
-      mdb_txn_commit(txn)
+      mdb_dbi_open(txn, "Meta", MDB_CREATE, &Meta) ||
+      mdb_dbi_open(txn, "Docs", MDB_CREATE, &Docs) ||
+      mdb_dbi_open(txn, "Terms", MDB_CREATE, &Terms) ||
+      mdb_dbi_open(txn, "Postings", MDB_CREATE, &Postings)
     )) throw runtime_error(fmt::format("Search database initialization failed: {}", mdb_strerror(err)));
 
+    for (const char* name : {"Id_Tokens", "Token_Users", "Token_Boards", "Token_Threads", "Token_Comments"}) {
+      MDB_dbi legacy;
+      if (!mdb_dbi_open(txn, name, LEGACY_DBI_FLAGS, &legacy)) {
+        mdb_drop(txn, legacy, 1);
+        needs_reindex = true;
+      }
+    }
+    MDB_val k = VERSION_KEY, v;
+    if (!mdb_get(txn, Meta, &k, &v) && read_val<uint32_t>(v) != VERSION) {
+      mdb_drop(txn, Meta, 0);
+      mdb_drop(txn, Docs, 0);
+      mdb_drop(txn, Terms, 0);
+      mdb_drop(txn, Postings, 0);
+      needs_reindex = true;
+    }
+    uint32_t version = VERSION;
+    v = struct_val(&version);
+    if ((err = mdb_put(txn, Meta, &k, &v, 0))) {
+      throw runtime_error(fmt::format("Search database initialization failed: {}", mdb_strerror(err)));
+    }
+    k = REINDEX_KEY;
+    if (needs_reindex) {
+      spdlog::warn("Search database is from an older version of Ludwig and has been cleared");
+      v = { .mv_size = 0, .mv_data = nullptr };
+      err = mdb_put(txn, Meta, &k, &v, 0);
+    } else {
+      needs_reindex = !mdb_get(txn, Meta, &k, &v);
+    }
+    if (err || (err = mdb_txn_commit(txn))) {
+      throw runtime_error(fmt::format("Search database initialization failed: {}", mdb_strerror(err)));
+    }
+
     const auto status = processor.LoadFromSerializedProto(en_wiki_bpe_vs200000_model_str());
     if (!status.ok()) {
       throw runtime_error("Search tokenizer initialization failed: " + status.ToString());
@@ -99,146 +632,327 @@ namespace Ludwig {
     mdb_env_close(env);
   }
 
-  template <typename T, typename V> static inline auto into_set(flat_hash_set<T>& to, const V& from) -> void {
-    std::copy(from.begin(), from.end(), inserter(to, to.end()));
+  auto LmdbSearchEngine::set_reindex_required(bool required) -> void {
+    Txn txn(env, 0);
+    MDB_val k = REINDEX_KEY, v { .mv_size = 0, .mv_data = nullptr };
+    if (required) put_or_throw(txn, Meta, k, v);
+    else mdb_del(txn, Meta, &k, nullptr);
+    if (auto err = txn.commit()) {
+      throw runtime_error(fmt::format("Search database commit failed: {}", mdb_strerror(err)));
+    }
+    needs_reindex = required;
   }
 
-  auto LmdbSearchEngine::index_tokens(Txn&& txn, uint64_t id, MDB_dbi dbi, flat_hash_set<uint64_t>& tokens) -> void {
-    flat_hash_set<uint64_t> existing = txn.get_all(Id_Tokens, id);
-    MDB_val id_val = int_val(&id), token_val;
-    if (!existing.empty()) {
-      flat_hash_set<uint64_t> to_insert, to_remove;
-      set_difference(tokens.begin(), tokens.end(), existing.begin(), existing.end(), inserter(to_insert, to_insert.begin()));
-      set_difference(existing.begin(), existing.end(), tokens.begin(), tokens.end(), inserter(to_remove, to_remove.begin()));
-      txn.del_vals_in_key(Id_Tokens, id, to_remove);
-      txn.del_val_for_all_keys(dbi, to_remove, id);
-      to_insert.swap(tokens);
+  auto LmdbSearchEngine::tokenize(Doc& doc, string_view text) -> void {
+    for (const auto token : processor.EncodeAsIds(text)) {
+      doc.terms[(uint64_t)token]++;
+      doc.length++;
     }
-    for (auto token : tokens) {
-      token_val = int_val(&token);
-      if (auto err = mdb_put(txn, Id_Tokens, &id_val, &token_val, 0)) {
-        spdlog::warn("Search database write failed: {}", mdb_strerror(err));
+  }
+
+  static inline auto stats_key(const SearchResultType& type) -> MDB_val {
+    return { .mv_size = 1, .mv_data = const_cast<SearchResultType*>(&type) };
+  }
+
+  static auto read_type_stats(MDB_txn* txn, MDB_dbi dbi, SearchResultType type) -> TypeStats {
+    MDB_val k = stats_key(type), v;
+    if (mdb_get(txn, dbi, &k, &v)) return {0, 0};
+    return read_val<TypeStats>(v);
+  }
+
+  static auto read_doc_terms(const MDB_val& v, const DocHeader& header) -> vector<DocTerm> {
+    vector<DocTerm> terms(header.term_count);
+    assert(v.mv_size >= sizeof(DocHeader) + header.term_count * sizeof(DocTerm));
+    memcpy(terms.data(), reinterpret_cast<const uint8_t*>(v.mv_data) + sizeof(DocHeader), header.term_count * sizeof(DocTerm));
+    return terms;
+  }
+
+  // Removes a document from the posting list of `term`, and decrements the
+  // term's document frequency
+  static auto remove_term(MDB_txn* txn, MDB_dbi terms, MDB_dbi postings, SearchResultType type, uint64_t term, uint64_t key) -> void {
+    posting_remove(txn, postings, type, term, key);
+    Key tk(type, term);
+    MDB_val k = tk.val(), v;
+    if (mdb_get(txn, terms, &k, &v)) return;
+    auto stats = read_val<TermStats>(v);
+    if (--stats.doc_count) put_or_throw(txn, terms, k, struct_val(&stats));
+    else mdb_del(txn, terms, &k, nullptr);
+  }
+
+  auto LmdbSearchEngine::index_doc(SearchResultType type, uint64_t id, Doc& doc) -> void {
+    Txn txn(env, 0);
+    const auto key = doc_key(id);
+    Key dk(type, id);
+    MDB_val k = dk.val(), v;
+    auto type_stats = read_type_stats(txn, Meta, type);
+    DocHeader header {
+      .board_id = doc.board_id,
+      .karma = 0,
+      .length = doc.length,
+      .term_count = (uint32_t)doc.terms.size(),
+      .cw = doc.cw
+    };
+
+    // Remove postings for terms that are no longer in the document
+    flat_hash_set<uint64_t> old_terms;
+    if (!mdb_get(txn, Docs, &k, &v)) {
+      const auto old = read_val<DocHeader>(v);
+      header.karma = old.karma;
+      type_stats.doc_count--;
+      type_stats.total_length -= old.length;
+      for (const auto t : read_doc_terms(v, old)) {
+        if (doc.terms.contains(t.term)) old_terms.insert(t.term);
+        else remove_term(txn, Terms, Postings, type, t.term, key);
       }
-      if (auto err = mdb_put(txn, dbi, &token_val, &id_val, 0)) {
-        spdlog::warn("Search database write failed: {}", mdb_strerror(err));
+      if (old.board_id && old.board_id != doc.board_id) posting_remove(txn, Postings, type, BOARD_TERM | old.board_id, key);
+      if (old.cw && !doc.cw) posting_remove(txn, Postings, type, CW_TERM, key);
+    }
+
+    // Insert or replace postings for all current terms
+    string buf(sizeof(DocHeader), '\0');
+    memcpy(buf.data(), &header, sizeof(DocHeader));
+    buf.reserve(sizeof(DocHeader) + doc.terms.size() * sizeof(DocTerm));
+    for (const auto& [term, tf] : doc.terms) {
+      posting_insert(txn, Postings, type, term, key, tf, doc.length);
+      Key tk(type, term);
+      MDB_val tk_val = tk.val(), ts_val;
+      TermStats stats { .doc_count = 0, .max_tf = tf, .min_length = doc.length };
+      if (!mdb_get(txn, Terms, &tk_val, &ts_val)) {
+        stats = read_val<TermStats>(ts_val);
+        stats.max_tf = std::max(stats.max_tf, tf);
+        stats.min_length = min(stats.min_length, doc.length);
       }
+      if (!old_terms.contains(term)) stats.doc_count++;
+      put_or_throw(txn, Terms, tk_val, struct_val(&stats));
+      const DocTerm dt { .term = term, .tf = tf };
+      buf.append(reinterpret_cast<const char*>(&dt), sizeof(DocTerm));
+    }
+    if (doc.board_id) posting_insert(txn, Postings, type, BOARD_TERM | doc.board_id, key, 1, 0);
+    if (doc.cw) posting_insert(txn, Postings, type, CW_TERM, key, 1, 0);
+
+    type_stats.doc_count++;
+    type_stats.total_length += doc.length;
+    put_or_throw(txn, Meta, stats_key(type), struct_val(&type_stats));
+    put_or_throw(txn, Docs, k, { .mv_size = buf.size(), .mv_data = buf.data() });
+    if (auto err = txn.commit()) {
+      throw runtime_error(fmt::format("Search database commit failed: {}", mdb_strerror(err)));
     }
-    txn.commit();
   }
 
   auto LmdbSearchEngine::index(uint64_t id, const User& user) -> void {
-    Txn txn(env, 0);
-    flat_hash_set<uint64_t> tokens;
-    into_set(tokens, processor.EncodeAsIds(user.name()->string_view()));
+    Doc doc;
+    tokenize(doc, user.name()->string_view());
     if (user.display_name_type() && user.display_name_type()->size()) {
-      into_set(tokens, processor.EncodeAsIds(rich_text_to_plain_text(user.display_name_type(), user.display_name())));
+      tokenize(doc, rich_text_to_plain_text(user.display_name_type(), user.display_name()));
     }
     if (user.bio_type() && user.bio_type()->size()) {
-      into_set(tokens, processor.EncodeAsIds(rich_text_to_plain_text(user.bio_type(), user.bio())));
+      tokenize(doc, rich_text_to_plain_text(user.bio_type(), user.bio()));
     }
-    index_tokens(std::move(txn), id, Token_Users, tokens);
+    index_doc(SearchResultType::User, id, doc);
   }
 
   auto LmdbSearchEngine::index(uint64_t id, const Board& board) -> void {
-    Txn txn(env, 0);
-    flat_hash_set<uint64_t> tokens;
-    into_set(tokens, processor.EncodeAsIds(board.name()->string_view()));
+    Doc doc;
+    tokenize(doc, board.name()->string_view());
     if (board.display_name_type() && board.display_name_type()->size()) {
-      into_set(tokens, processor.EncodeAsIds(rich_text_to_plain_text(board.display_name_type(), board.display_name())));
+      tokenize(doc, rich_text_to_plain_text(board.display_name_type(), board.display_name()));
     }
     if (board.description_type() && board.description_type()->size()) {
-      into_set(tokens, processor.EncodeAsIds(rich_text_to_plain_text(board.description_type(), board.description())));
+      tokenize(doc, rich_text_to_plain_text(board.description_type(), board.description()));
     }
-    index_tokens(std::move(txn), id, Token_Boards, tokens);
+    doc.cw = board.content_warning() && board.content_warning()->size();
+    index_doc(SearchResultType::Board, id, doc);
   }
 
   auto LmdbSearchEngine::index(uint64_t id, const Thread& thread, optional<std::reference_wrapper<const LinkCard>> card_opt) -> void {
-    Txn txn(env, 0);
-    flat_hash_set<uint64_t> tokens;
-    into_set(tokens, processor.EncodeAsIds(rich_text_to_plain_text(thread.title_type(), thread.title())));
+    Doc doc;
+    tokenize(doc, rich_text_to_plain_text(thread.title_type(), thread.title()));
     if (thread.content_text_type() && thread.content_text_type()->size()) {
-      into_set(tokens, processor.EncodeAsIds(rich_text_to_plain_text(thread.content_text_type(), thread.content_text())));
+      tokenize(doc, rich_text_to_plain_text(thread.content_text_type(), thread.content_text()));
     }
     if (card_opt) {
       const auto& card = card_opt->get();
-      if (card.title()) {
-        into_set(tokens, processor.EncodeAsIds(card.title()->string_view()));
-      }
-      if (card.description()) {
-        into_set(tokens, processor.EncodeAsIds(card.description()->string_view()));
-      }
+      if (card.title()) tokenize(doc, card.title()->string_view());
+      if (card.description()) tokenize(doc, card.description()->string_view());
     }
-    index_tokens(std::move(txn), id, Token_Threads, tokens);
+    doc.board_id = thread.board();
+    doc.cw = thread.content_warning() && thread.content_warning()->size();
+    index_doc(SearchResultType::Thread, id, doc);
+  }
+
+  auto LmdbSearchEngine::index(uint64_t id, const Comment& comment, const Thread& thread) -> void {
+    Doc doc;
+    tokenize(doc, rich_text_to_plain_text(comment.content_type(), comment.content()));
+    doc.board_id = thread.board();
+    doc.cw = (comment.content_warning() && comment.content_warning()->size()) ||
+      (thread.content_warning() && thread.content_warning()->size());
+    index_doc(SearchResultType::Comment, id, doc);
   }
 
-  auto LmdbSearchEngine::index(uint64_t id, const Comment& comment) -> void {
+  auto LmdbSearchEngine::update_karma(uint64_t id, SearchResultType type, int64_t karma) -> void {
     Txn txn(env, 0);
-    flat_hash_set<uint64_t> tokens;
-    into_set(tokens, processor.EncodeAsIds(rich_text_to_plain_text(comment.content_type(), comment.content())));
-    index_tokens(std::move(txn), id, Token_Comments, tokens);
+    Key dk(type, id);
+    MDB_val k = dk.val(), v;
+    if (mdb_get(txn, Docs, &k, &v)) return;
+    auto header = read_val<DocHeader>(v);
+    if (header.karma == karma) return;
+    header.karma = karma;
+    string buf(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+    memcpy(buf.data(), &header, sizeof(DocHeader));
+    put_or_throw(txn, Docs, k, { .mv_size = buf.size(), .mv_data = buf.data() });
+    if (auto err = txn.commit()) {
+      throw runtime_error(fmt::format("Search database commit failed: {}", mdb_strerror(err)));
+    }
   }
 
   auto LmdbSearchEngine::unindex(uint64_t id, SearchResultType type) -> void {
-    using enum SearchResultType;
     Txn txn(env, 0);
-    auto tokens = txn.get_all(Id_Tokens, id);
-    MDB_val id_val = int_val(&id);
-    if (auto err = mdb_del(txn, Id_Tokens, &id_val, nullptr)) {
-      spdlog::warn("Search database delete failed: {}", mdb_strerror(err));
+    const auto key = doc_key(id);
+    Key dk(type, id);
+    MDB_val k = dk.val(), v;
+    if (mdb_get(txn, Docs, &k, &v)) return;
+    const auto header = read_val<DocHeader>(v);
+    for (const auto t : read_doc_terms(v, header)) {
+      remove_term(txn, Terms, Postings, type, t.term, key);
     }
-    MDB_dbi dbi;
-    switch (type) {
-      case User: dbi = Token_Users; break;
-      case Board: dbi = Token_Boards; break;
-      case Thread: dbi = Token_Threads; break;
-      case Comment: dbi = Token_Comments; break;
+    if (header.board_id) posting_remove(txn, Postings, type, BOARD_TERM | header.board_id, key);
+    if (header.cw) posting_remove(txn, Postings, type, CW_TERM, key);
+    auto type_stats = read_type_stats(txn, Meta, type);
+    type_stats.doc_count--;
+    type_stats.total_length -= header.length;
+    put_or_throw(txn, Meta, stats_key(type), struct_val(&type_stats));
+    if (auto err = mdb_del(txn, Docs, &k, nullptr)) {
+      spdlog::warn("Search database delete failed: {}", mdb_strerror(err));
     }
-    txn.del_val_for_all_keys(dbi, tokens, id);
-    txn.commit();
-  }
-
-  using MatchMap = phmap::flat_hash_map<uint64_t, pair<SearchResultType, uint64_t>>;
-
-  static inline auto into_match_map(MatchMap& mm, SearchResultType type, flat_hash_set<uint64_t> ids) {
-    for (auto id : ids) {
-      const auto [it, inserted] = mm.insert({ id, { type, 1 } });
-      if (!inserted) it->second.second++;
+    if (auto err = txn.commit()) {
+      throw runtime_error(fmt::format("Search database commit failed: {}", mdb_strerror(err)));
     }
   }
 
   auto LmdbSearchEngine::search(SearchQuery query) -> std::shared_ptr<CompletableOnce<vector<SearchResult>>> {
     using enum SearchResultType;
-    flat_hash_set<int> tokens;
-    MatchMap matches;
-
-    // string-start tokens are different from mid-string tokens
-    into_set(tokens, processor.EncodeAsIds(query.query));
-    into_set(tokens, processor.EncodeAsIds(" " + string(query.query)));
+    const Metrics::ScopedTimer timer(*query_metrics[(size_t)query.sort]);
+    const size_t k = query.offset + query.limit;
 
-    Txn txn(env, MDB_RDONLY);
-    for (const auto token : tokens) {
-      if (query.include_users) into_match_map(matches, User, txn.get_all(Token_Users, (uint64_t)token));
-      if (query.include_boards) into_match_map(matches, Board, txn.get_all(Token_Boards, (uint64_t)token));
-      if (query.include_threads) into_match_map(matches, Thread, txn.get_all(Token_Threads, (uint64_t)token));
-      if (query.include_comments) into_match_map(matches, Comment, txn.get_all(Token_Comments, (uint64_t)token));
+    // string-start tokens are different from mid-string tokens, so a query has
+    // two tokenizations; a document matches if it contains all of the tokens
+    // of either one, or (for Relevant) any token of either one
+    array<flat_hash_set<uint64_t>, 2> tokenizations;
+    for (auto token : processor.EncodeAsIds(query.query)) {
+      if (tokenizations[0].size() < MAX_QUERY_TERMS) tokenizations[0].insert((uint64_t)token);
+    }
+    for (auto token : processor.EncodeAsIds(" " + string(query.query))) {
+      if (tokenizations[1].size() < MAX_QUERY_TERMS) tokenizations[1].insert((uint64_t)token);
     }
-    if (matches.size() <= query.offset) {
+    const size_t n_tokenizations = tokenizations[0] == tokenizations[1] ? 1 : 2;
+    if (!k || tokenizations[0].empty()) {
       return make_shared<CompletableOnce<vector<SearchResult>>>(vector<SearchResult>{});
     }
 
-    // TODO: Filter and sort
+    vector<SearchResultType> types;
+    if (query.include_users && !query.board_id) types.push_back(User);
+    if (query.include_boards && !query.board_id) types.push_back(Board);
+    if (query.include_threads) types.push_back(Thread);
+    if (query.include_comments) types.push_back(Comment);
 
-    auto buf = make_unique<pair<uint64_t, pair<SearchResultType, uint64_t>>[]>(query.offset + query.limit);
-    std::partial_sort_copy(matches.begin(), matches.end(), buf.get(), buf.get() + query.offset + query.limit, [](auto a, auto b) {
-      return a.second.second > b.second.second;
-    });
-    const auto n = std::min(matches.size() - query.offset, query.limit);
-    vector<SearchResult> results;
-    results.reserve(n);
-    for (size_t i = 0; i < n; i++) {
-      results.emplace_back(buf[query.offset + i].second.first, buf[query.offset + i].first);
+    struct Candidate {
+      double rank;
+      uint64_t key;
+      SearchResultType type;
+    };
+    vector<Candidate> candidates;
+    Txn txn(env, MDB_RDONLY);
+    for (const auto type : types) {
+      const auto type_stats = read_type_stats(txn, Meta, type);
+      if (!type_stats.doc_count) continue;
+      const double avg_length = std::max(1.0, (double)type_stats.total_length / (double)type_stats.doc_count);
+      const auto open_cursor = [&](uint64_t term) -> optional<PostingCursor> {
+        Key tk(type, term);
+        MDB_val tk_val = tk.val(), v;
+        if (mdb_get(txn, Terms, &tk_val, &v)) return {};
+        const auto stats = read_val<TermStats>(v);
+        optional<PostingCursor> c;
+        c.emplace(txn, Postings, type, term);
+        c->doc_count = stats.doc_count;
+        c->avg_length = avg_length;
+        c->idf = std::log(1.0 + ((double)type_stats.doc_count - (double)stats.doc_count + 0.5) / ((double)stats.doc_count + 0.5));
+        c->max_score = bm25(c->idf, avg_length, stats.max_tf, stats.min_length);
+        return c;
+      };
+      const auto make_filters = [&] {
+        Filters filters;
+        if (query.board_id) filters.board.emplace(txn, Postings, type, BOARD_TERM | query.board_id);
+        if (!query.include_cws) filters.cw.emplace(txn, Postings, type, CW_TERM);
+        return filters;
+      };
+
+      if (query.sort == SearchResultSort::Relevant) {
+        vector<PostingCursor> cursors;
+        flat_hash_set<uint64_t> terms(tokenizations[0]);
+        terms.insert(tokenizations[1].begin(), tokenizations[1].end());
+        for (const auto term : terms) {
+          if (auto c = open_cursor(term)) cursors.push_back(std::move(*c));
+        }
+        auto filters = make_filters();
+        for (const auto& [score, key] : wand(cursors, filters, k)) candidates.push_back({score, key, type});
+        continue;
+      }
+
+      priority_queue<ScoredKey, vector<ScoredKey>, WorseScore> top;
+      // Both tokenizations can match the same post; it must take only one slot
+      flat_hash_set<uint64_t> in_top;
+      for (size_t t = 0; t < n_tokenizations; t++) {
+        vector<PostingCursor> cursors;
+        for (const auto term : tokenizations[t]) {
+          auto c = open_cursor(term);
+          if (!c) goto next_tokenization;
+          cursors.push_back(std::move(*c));
+        }
+        std::sort(cursors.begin(), cursors.end(), [](const auto& a, const auto& b) { return a.doc_count < b.doc_count; });
+        {
+          auto filters = make_filters();
+          if (query.sort == SearchResultSort::New) {
+            // Keys are in newest-first order, so stop after the first k
+            size_t n = 0;
+            conjunction(cursors, filters, [&](uint64_t key) {
+              candidates.push_back({0, key, type});
+              return ++n < k;
+            });
+          } else {
+            size_t n = 0;
+            conjunction(cursors, filters, [&](uint64_t key) {
+              if (!in_top.insert(key).second) return ++n < TOP_MAX_MATCHES;
+              Key dk(type, ~key);
+              MDB_val dk_val = dk.val(), v;
+              if (mdb_get(txn, Docs, &dk_val, &v)) return true;
+              top.emplace((double)read_val<DocHeader>(v).karma, key);
+              if (top.size() > k) top.pop();
+              return ++n < TOP_MAX_MATCHES;
+            });
+          }
+        }
+      next_tokenization:;
+      }
+      for (; !top.empty(); top.pop()) candidates.push_back({top.top().first, top.top().second, type});
+    }
+
+    if (query.sort == SearchResultSort::New) {
+      std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+        return a.key < b.key || (a.key == b.key && a.type < b.type);
+      });
+    } else {
+      std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+        return a.rank > b.rank || (a.rank == b.rank && (a.key < b.key || (a.key == b.key && a.type < b.type)));
+      });
     }
+    candidates.erase(std::unique(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+      return a.key == b.key && a.type == b.type;
+    }), candidates.end());
 
+    vector<SearchResult> results;
+    for (size_t i = query.offset; i < min(candidates.size(), k); i++) {
+      results.push_back({ .type = candidates[i].type, .id = ~candidates[i].key });
+    }
     return make_shared<CompletableOnce<vector<SearchResult>>>(std::move(results));
   }
 }
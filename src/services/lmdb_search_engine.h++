@@ -10,18 +10,28 @@ namespace Ludwig {
   private:
     size_t map_size;
     MDB_env* env;
-    MDB_dbi Id_Tokens, Token_Users, Token_Boards, Token_Threads, Token_Comments;
+    MDB_dbi Meta, Docs, Terms, Postings;
     sentencepiece::SentencePieceProcessor processor;
+    bool needs_reindex = false;
     struct Txn;
-    auto index_tokens(Txn&& txn, uint64_t id, MDB_dbi dbi, phmap::flat_hash_set<uint64_t>& tokens) -> void;
+    struct Doc;
+    auto tokenize(Doc& doc, std::string_view text) -> void;
+    auto index_doc(SearchResultType type, uint64_t id, Doc& doc) -> void;
   public:
     LmdbSearchEngine(std::filesystem::path filename, size_t map_size_mb = 1024);
     ~LmdbSearchEngine();
     auto index(uint64_t id, const User& user) -> void;
     auto index(uint64_t id, const Board& board) -> void;
     auto index(uint64_t id, const Thread& thread, std::optional<std::reference_wrapper<const LinkCard>> card_opt) -> void;
-    auto index(uint64_t id, const Comment& comment) -> void;
+    auto index(uint64_t id, const Comment& comment, const Thread& thread) -> void;
+    auto update_karma(uint64_t id, SearchResultType type, int64_t karma) -> void;
     auto unindex(uint64_t id, SearchResultType type) -> void;
     auto search(SearchQuery query) -> std::shared_ptr<CompletableOnce<std::vector<SearchResult>>>;
+
+    // True if the search database was created by an older version of Ludwig
+    // and has been cleared; everything must be reindexed (see
+    // SearchController::index_all), then set_reindex_required(false) called.
+    auto reindex_required() const -> bool { return needs_reindex; }
+    auto set_reindex_required(bool required) -> void;
   };
 }
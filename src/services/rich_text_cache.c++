@@ -0,0 +1,93 @@
+#include "rich_text_cache.h++"
+
+using std::function, std::lock_guard, std::make_shared, std::mutex,
+    std::shared_ptr, std::string;
+
+namespace Ludwig {
+
+RichTextCache::RichTextCache(size_t max_bytes, shared_ptr<EventBus> event_bus) :
+  max_shard_bytes(max_bytes / SHARDS),
+  event_bus(event_bus),
+  sub_thread_update(event_bus->on_event(Event::ThreadUpdate, [&](Event, uint64_t id) { invalidate(id); })),
+  sub_comment_update(event_bus->on_event(Event::CommentUpdate, [&](Event, uint64_t id) { invalidate(id); })),
+  sub_thread_delete(event_bus->on_event(Event::ThreadDelete, [&](Event, uint64_t id) { invalidate(id); })),
+  sub_comment_delete(event_bus->on_event(Event::CommentDelete, [&](Event, uint64_t id) { invalidate(id); }))
+{
+  assert(event_bus != nullptr);
+}
+
+auto RichTextCache::get(
+  uint64_t post_id,
+  uint8_t variant,
+  uint64_t generation,
+  const function<string ()>& render
+) -> shared_ptr<const string> {
+  assert(variant < VARIANTS);
+  auto& s = shard(post_id);
+  const Key key(post_id, variant);
+  {
+    lock_guard<mutex> g(s.lock);
+    if (auto it = s.index.find(key); it != s.index.end()) {
+      s.lru.splice(s.lru.begin(), s.lru, it->second);
+      hits.fetch_add(1, std::memory_order_relaxed);
+      return it->second->html;
+    }
+  }
+  misses.fetch_add(1, std::memory_order_relaxed);
+
+  // Render without holding the lock; a concurrent miss on the same key may
+  // render it twice, but only one copy is kept
+  auto html = make_shared<const string>(render());
+  const auto bytes = html->size() + ENTRY_OVERHEAD;
+  if (bytes > max_shard_bytes) return html;
+
+  lock_guard<mutex> g(s.lock);
+  // Invalidated after the caller's transaction was opened, so the caller may
+  // have rendered content that has since been edited
+  if (s.generation > generation) return html;
+  if (auto it = s.index.find(key); it != s.index.end()) return it->second->html;
+  s.lru.push_front({key, html});
+  s.index.emplace(key, s.lru.begin());
+  s.bytes += bytes;
+  while (s.bytes > max_shard_bytes) {
+    const auto& last = s.lru.back();
+    s.bytes -= last.html->size() + ENTRY_OVERHEAD;
+    s.index.erase(last.key);
+    s.lru.pop_back();
+    evictions.fetch_add(1, std::memory_order_relaxed);
+  }
+  return html;
+}
+
+auto RichTextCache::invalidate(uint64_t post_id) -> void {
+  auto& s = shard(post_id);
+  lock_guard<mutex> g(s.lock);
+  s.generation = current_generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+  for (uint8_t variant = 0; variant < VARIANTS; variant++) {
+    if (auto it = s.index.find(Key(post_id, variant)); it != s.index.end()) {
+      s.bytes -= it->second->html->size() + ENTRY_OVERHEAD;
+      s.lru.erase(it->second);
+      s.index.erase(it);
+    }
+  }
+  invalidations.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto RichTextCache::stats() -> Stats {
+  Stats stats {
+    .hits = hits.load(std::memory_order_relaxed),
+    .misses = misses.load(std::memory_order_relaxed),
+    .evictions = evictions.load(std::memory_order_relaxed),
+    .invalidations = invalidations.load(std::memory_order_relaxed),
+    .entries = 0,
+    .bytes = 0
+  };
+  for (auto& s : shards) {
+    lock_guard<mutex> g(s.lock);
+    stats.entries += s.index.size();
+    stats.bytes += s.bytes;
+  }
+  return stats;
+}
+
+}
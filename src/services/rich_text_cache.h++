@@ -0,0 +1,81 @@
+#pragma once
+#include "services/event_bus.h++"
+#include <array>
+#include <list>
+#include <mutex>
+#include <parallel_hashmap/phmap.h>
+
+namespace Ludwig {
+
+// Caches the rendered HTML of post content (thread and comment bodies), which
+// would otherwise be re-rendered from rich text on every page view.
+//
+// Entries are keyed by post ID plus a small variant number identifying the
+// render options, and are dropped when a ThreadUpdate, CommentUpdate,
+// ThreadDelete, or CommentDelete event is dispatched for the post. The cache
+// is split into independently locked shards, each with an equal share of the
+// byte budget and its own LRU list.
+//
+// Those events are dispatched after the edit commits, so a reader whose
+// transaction predates the edit may render the old content after the entry
+// was dropped. To keep that HTML out of the cache, callers read generation()
+// before opening the transaction they render from, and get() only inserts if
+// the post's shard has not been invalidated since.
+class RichTextCache {
+public:
+  static constexpr uint8_t VARIANTS = 8;
+
+  struct Stats {
+    uint64_t hits, misses, evictions, invalidations, entries, bytes;
+  };
+private:
+  static constexpr size_t SHARD_BITS = 4, SHARDS = 1 << SHARD_BITS;
+  // Rough size of the list node, map slot, and string header of an entry
+  static constexpr size_t ENTRY_OVERHEAD = 96;
+
+  using Key = std::pair<uint64_t, uint8_t>;
+  struct Entry {
+    Key key;
+    std::shared_ptr<const std::string> html;
+  };
+  struct Shard {
+    std::mutex lock;
+    std::list<Entry> lru; // most recently used first
+    phmap::flat_hash_map<Key, std::list<Entry>::iterator> index;
+    size_t bytes = 0;
+    // Value of RichTextCache::generation at this shard's last invalidation
+    uint64_t generation = 0;
+  };
+
+  std::array<Shard, SHARDS> shards;
+  size_t max_shard_bytes;
+  std::atomic<uint64_t> hits = 0, misses = 0, evictions = 0, invalidations = 0;
+  std::atomic<uint64_t> current_generation = 0;
+  std::shared_ptr<EventBus> event_bus;
+  EventBus::Subscription sub_thread_update, sub_comment_update, sub_thread_delete, sub_comment_delete;
+
+  auto shard(uint64_t post_id) -> Shard& {
+    return shards[(post_id * 0x9e3779b97f4a7c15ULL) >> (64 - SHARD_BITS)];
+  }
+public:
+  RichTextCache(size_t max_bytes, std::shared_ptr<EventBus> event_bus = std::make_shared<DummyEventBus>());
+  RichTextCache(const RichTextCache&) = delete;
+  auto operator=(const RichTextCache&) = delete;
+
+  // Incremented by every invalidation
+  auto generation() const noexcept -> uint64_t {
+    return current_generation.load(std::memory_order_acquire);
+  }
+  // `generation` must have been read (with generation()) before the
+  // transaction that `render` reads from was opened
+  auto get(
+    uint64_t post_id,
+    uint8_t variant,
+    uint64_t generation,
+    const std::function<std::string ()>& render
+  ) -> std::shared_ptr<const std::string>;
+  auto invalidate(uint64_t post_id) -> void;
+  auto stats() -> Stats;
+};
+
+}
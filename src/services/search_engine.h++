@@ -15,6 +15,8 @@ namespace Ludwig {
     std::string_view query;
     bool include_users, include_boards, include_threads, include_comments, include_cws;
     SearchResultSort sort;
+    // 0 searches all boards; otherwise, users and boards are excluded and only
+    // threads and comments in this board are returned
     uint64_t board_id;
     size_t offset, limit;
   };
@@ -30,7 +32,8 @@ namespace Ludwig {
     virtual auto index( uint64_t id, const User& user) -> void = 0;
     virtual auto index(uint64_t id, const Board& board) -> void = 0;
     virtual auto index(uint64_t id, const Thread& thread, std::optional<std::reference_wrapper<const LinkCard>> card_opt = {}) -> void = 0;
-    virtual auto index(uint64_t id, const Comment& comment) -> void = 0;
+    virtual auto index(uint64_t id, const Comment& comment, const Thread& thread) -> void = 0;
+    virtual auto update_karma(uint64_t id, SearchResultType type, int64_t karma) -> void = 0;
     virtual auto unindex(uint64_t id, SearchResultType type) -> void = 0;
     virtual auto search(SearchQuery query) -> std::shared_ptr<CompletableOnce<std::vector<SearchResult>>> = 0;
   };
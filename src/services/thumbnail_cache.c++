@@ -1,5 +1,6 @@
 #include "thumbnail_cache.h++"
 #include "util/common.h++"
+#include "util/metrics.h++"
 #include <vips/conversion.h>
 
 using std::make_shared, std::nullopt, std::optional,
@@ -8,39 +9,102 @@ using std::make_shared, std::nullopt, std::optional,
 
 namespace Ludwig {
 
+static constexpr std::string_view LOOKUPS_METRIC = "ludwig_thumbnail_cache_lookups_total",
+  LOOKUPS_HELP = "ThumbnailCache lookups, by whether the thumbnail was cached in memory, already being fetched, stored on disk, or fetched";
+static Metrics::Counter
+  &hit_metric = Metrics::counter(LOOKUPS_METRIC, LOOKUPS_HELP, {{"result", "hit"}}),
+  &in_flight_metric = Metrics::counter(LOOKUPS_METRIC, LOOKUPS_HELP, {{"result", "in_flight"}}),
+  &stored_metric = Metrics::counter(LOOKUPS_METRIC, LOOKUPS_HELP, {{"result", "stored"}}),
+  &miss_metric = Metrics::counter(LOOKUPS_METRIC, LOOKUPS_HELP, {{"result", "miss"}}),
+  &rejected_metric = Metrics::counter("ludwig_thumbnail_decodes_rejected_total",
+    "Thumbnail decodes refused because the decode queue was full");
+
+ThumbnailWorkers::ThumbnailWorkers(size_t thread_count, size_t max_queued) : max_queued(max_queued) {
+  threads.reserve(thread_count);
+  for (size_t i = 0; i < thread_count; i++) {
+    threads.emplace_back([this] {
+      for (;;) {
+        uWS::MoveOnlyFunction<void()> job;
+        {
+          std::unique_lock<std::mutex> g(lock);
+          cv.wait(g, [this] { return stopping || !queue.empty(); });
+          if (stopping) return;
+          job = std::move(queue.front());
+          queue.pop_front();
+        }
+        job();
+      }
+    });
+  }
+}
+
+auto ThumbnailWorkers::try_post(uWS::MoveOnlyFunction<void()>&& job) -> bool {
+  {
+    std::lock_guard<std::mutex> g(lock);
+    if (stopping || queue.size() >= max_queued) return false;
+    queue.push_back(std::move(job));
+  }
+  cv.notify_one();
+  return true;
+}
+
+auto ThumbnailWorkers::queued() -> size_t {
+  std::lock_guard<std::mutex> g(lock);
+  return queue.size();
+}
+
+auto ThumbnailWorkers::stop() -> void {
+  {
+    std::lock_guard<std::mutex> g(lock);
+    if (stopping) return;
+    stopping = true;
+    queue.clear();
+  }
+  cv.notify_all();
+  for (auto& th : threads) if (th.joinable()) th.join();
+}
+
 ThumbnailCache::ThumbnailCache(
   shared_ptr<HttpClient> http_client,
   size_t cache_size,
   uint16_t thumbnail_width,
   uint16_t thumbnail_height,
-  Dispatcher dispatcher
+  Dispatcher dispatcher,
+  shared_ptr<ThumbnailStore> store
 ) : cache([](const string&)->Entry{return Promise{};}, cache_size), http_client(http_client), dispatcher(dispatcher),
-    w(thumbnail_width), h(thumbnail_height ? thumbnail_height : thumbnail_width) {}
+    store(store), w(thumbnail_width), h(thumbnail_height ? thumbnail_height : thumbnail_width) {}
+
+auto ThumbnailCache::load_stored(const string& url) -> ImageRef {
+  ImageRef img;
+  if (store) {
+    store->get(ThumbnailStore::key(url, w, h), [&](string_view data, uint64_t hash) {
+      // The stored bytes only live as long as the read transaction, so they
+      // are copied once here; from then on the thumbnail is served from memory
+      img = ImageRef(vips_blob_copy(data.data(), data.length()), hash);
+    });
+  }
+  return img;
+}
 
-auto ThumbnailCache::fetch_thumbnail(string url, Entry& entry_cell) -> Entry& {
-  auto sync_flag = make_shared<std::monostate>();
+auto ThumbnailCache::store_thumbnail(const string& url, const ImageRef& img) -> void {
+  if (store && img) store->put(ThumbnailStore::key(url, w, h), img, img.hash());
+}
+
+auto ThumbnailCache::fetch_thumbnail(string url, Entry& entry_cell) -> optional<ImageRef> {
+  auto sync_result = make_shared<optional<ImageRef>>();
   http_client->get(url)
     .header("Accept", "image/*")
-    .dispatch([this, url, &entry_cell, maybe_sync_flag = weak_ptr(sync_flag)](auto&& rsp){
-      dispatcher([this, rsp = std::move(rsp), url, &entry_cell, maybe_sync_flag] mutable {
-        const auto mimetype = rsp->header("content-type");
-        ImageRef img = nullptr;
-        if (rsp->error()) {
-          spdlog::warn("Failed to fetch image at {}: {}", url, *rsp->error());
-        } else {
-          try {
-            img = generate_thumbnail(
-              mimetype.empty() ? nullopt : optional(mimetype), rsp->body(), w, h
-            );
-          } catch (const runtime_error& e) {
-            spdlog::warn("Failed to generate thumbnail for {}: {}", url, e.what());
-          }
-        }
-        if (maybe_sync_flag.lock()) {
+    .dispatch([this, url, &entry_cell, maybe_sync_result = weak_ptr(sync_result)](auto&& rsp){
+      // `retry` leaves the entry unfetched, so that the next request for this
+      // image tries again instead of getting the cached failure
+      auto finish = [this, url, &entry_cell, maybe_sync_result](ImageRef img, bool retry) {
+        if (const auto sync = maybe_sync_result.lock()) {
           // If this callback was synchronous, the shared_ptr cell will still
-          // exist; overwrite it so that the ::thumbnail callback will work.
+          // exist; return the result through it, since nothing is waiting on
+          // entry_cell yet.
           spdlog::debug("Got synchronous response for image {}", url);
-          entry_cell.emplace<ImageRef>(img);
+          if (!retry) entry_cell.emplace<ImageRef>(img);
+          sync->emplace(img);
           return;
         }
         Promise completables;
@@ -48,18 +112,42 @@ auto ThumbnailCache::fetch_thumbnail(string url, Entry& entry_cell) -> Entry& {
           auto handle = cache[url];
           auto& value = handle.value();
           visit(overload{
-            [&](Promise p) { std::swap(p, completables); },
+            [&](Promise& p) { std::swap(p, completables); },
             [&](ImageRef&) {
               spdlog::warn("Overwrote cached thumbnail for {}, this is probably a race condition and shouldn't happen!", url);
             }
           }, value);
-          value.emplace<ImageRef>(img);
+          if (retry) value.emplace<Promise>();
+          else value.emplace<ImageRef>(img);
         }
         spdlog::debug("Got thumbnail for {}, dispatching {:d} callbacks", url, completables.size());
         for (auto& c : completables) c->complete(img);
+      };
+      if (rsp->error()) {
+        spdlog::warn("Failed to fetch image at {}: {}", url, *rsp->error());
+        finish({}, false);
+        return;
+      }
+      const bool accepted = dispatcher([this, rsp = std::move(rsp), url, finish] mutable {
+        const auto mimetype = rsp->header("content-type");
+        ImageRef img = nullptr;
+        try {
+          img = generate_thumbnail(
+            mimetype.empty() ? nullopt : optional(mimetype), rsp->body(), w, h
+          );
+        } catch (const runtime_error& e) {
+          spdlog::warn("Failed to generate thumbnail for {}: {}", url, e.what());
+        }
+        store_thumbnail(url, img);
+        finish(img, false);
       });
+      if (!accepted) {
+        spdlog::debug("Thumbnail decode queue is full, dropping {}", url);
+        rejected_metric.inc();
+        finish({}, true);
+      }
     });
-  return entry_cell;
+  return std::move(*sync_result);
 }
 
 auto ThumbnailCache::thumbnail(string url) -> shared_ptr<CompletableOnce<ImageRef>> {
@@ -68,17 +156,27 @@ auto ThumbnailCache::thumbnail(string url) -> shared_ptr<CompletableOnce<ImageRe
   auto c = make_shared<CompletableOnce<ImageRef>>();
   visit(overload{
     [&](Promise& p) {
-      if (p.empty()) {
-        visit(overload{
-          [&](Promise& p) { p.push_back(c); },
-          [&](ImageRef i) { c->complete(i); }
-        }, fetch_thumbnail(url, value));
-      } else {
+      if (!p.empty()) {
         spdlog::debug("Adding callback to in-flight thumbnail request for {}", url);
+        in_flight_metric.inc();
         p.push_back(c);
+      } else if (auto img = load_stored(url)) {
+        stored_metric.inc();
+        value.emplace<ImageRef>(img);
+        c->complete(img);
+      } else {
+        miss_metric.inc();
+        if (const auto img = fetch_thumbnail(url, value)) c->complete(*img);
+        else visit(overload{
+          [&](Promise& p) { p.push_back(c); },
+          [&](ImageRef i) { c->complete(i); }
+        }, value);
       }
     },
-    [&](ImageRef i) { c->complete(i); }
+    [&](ImageRef i) {
+      hit_metric.inc();
+      c->complete(i);
+    }
   }, value);
   return c;
 }
@@ -86,9 +184,9 @@ auto ThumbnailCache::thumbnail(string url) -> shared_ptr<CompletableOnce<ImageRe
 auto ThumbnailCache::set_thumbnail(string url, string_view mimetype, string_view data) -> bool {
   auto handle = cache[url];
   try {
-    handle.value().emplace<ImageRef>(generate_thumbnail(
-      mimetype.empty() ? nullopt : optional(mimetype), data, w, h
-    ));
+    const auto img = generate_thumbnail(mimetype.empty() ? nullopt : optional(mimetype), data, w, h);
+    handle.value().emplace<ImageRef>(img);
+    store_thumbnail(url, img);
     return true;
   } catch (const runtime_error& e) {
     spdlog::warn("Failed to generate thumbnail for {}: {}", url, e.what());
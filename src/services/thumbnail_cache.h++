@@ -1,6 +1,10 @@
 #pragma once
 #include "services/http_client.h++"
+#include "services/thumbnail_store.h++"
 #include <concurrent_lru_cache.h>
+#include <condition_variable>
+#include <deque>
+#include <thread>
 #include <variant>
 #include <vips/vips8>
 #include <xxhash.h>
@@ -16,6 +20,9 @@ public:
   ImageRef(VipsBlob* blob) :
     area(blob ? &blob->area : nullptr),
     _hash(area ? XXH3_64bits(area->data, area->length) : 0) {}
+  ImageRef(VipsBlob* blob, uint64_t hash) :
+    area(blob ? &blob->area : nullptr),
+    _hash(area ? hash : 0) {}
   ~ImageRef() {
     if (area) vips_area_unref(area);
   }
@@ -56,17 +63,50 @@ public:
   }
 };
 
+// Dedicated threads for decoding and resizing thumbnails, so that libvips
+// doesn't compete with request handling. At most `max_queued` jobs can wait at
+// once; past that, try_post refuses new jobs instead of letting the backlog
+// (and the downloaded images it holds) grow without bound.
+class ThumbnailWorkers {
+private:
+  std::mutex lock;
+  std::condition_variable cv;
+  std::deque<uWS::MoveOnlyFunction<void()>> queue;
+  std::vector<std::thread> threads;
+  size_t max_queued;
+  bool stopping = false;
+public:
+  ThumbnailWorkers(size_t thread_count, size_t max_queued);
+  ~ThumbnailWorkers() { stop(); }
+  ThumbnailWorkers(const ThumbnailWorkers&) = delete;
+  auto operator=(const ThumbnailWorkers&) = delete;
+  auto try_post(uWS::MoveOnlyFunction<void()>&& job) -> bool;
+  auto queued() -> size_t;
+  // Drops any jobs that haven't started yet, and waits for the rest to finish
+  auto stop() -> void;
+};
+
+// Thumbnails of remote images, generated on first use and kept in an in-memory
+// LRU cache, and optionally in a ThumbnailStore on disk. Concurrent requests
+// for the same image share a single fetch and decode.
 class ThumbnailCache {
 public:
   using Callback = uWS::MoveOnlyFunction<void (ImageRef)>;
-  using Dispatcher = std::function<void (uWS::MoveOnlyFunction<void()>)>;
+  // Runs a decode job, or returns false if the job was refused because too
+  // many are already queued
+  using Dispatcher = std::function<bool (uWS::MoveOnlyFunction<void()>)>;
 private:
   using Promise = std::list<std::shared_ptr<CompletableOnce<ImageRef>>>;
   using Entry = std::variant<Promise, ImageRef>;
-  auto fetch_thumbnail(std::string url, Entry& entry_cell) -> Entry&;
+  // Returns the thumbnail if the fetch finished synchronously; otherwise
+  // `entry_cell` is completed later
+  auto fetch_thumbnail(std::string url, Entry& entry_cell) -> std::optional<ImageRef>;
+  auto load_stored(const std::string& url) -> ImageRef;
+  auto store_thumbnail(const std::string& url, const ImageRef& img) -> void;
   tbb::concurrent_lru_cache<std::string, Entry, Entry(*)(const std::string&)> cache;
   std::shared_ptr<HttpClient> http_client;
   Dispatcher dispatcher;
+  std::shared_ptr<ThumbnailStore> store;
   uint16_t w, h;
 public:
   ThumbnailCache(
@@ -74,14 +114,16 @@ public:
     size_t cache_size,
     uint16_t thumbnail_width,
     uint16_t thumbnail_height,
-    Dispatcher dispatcher = [](auto f) { f(); }
+    Dispatcher dispatcher = [](auto f) { f(); return true; },
+    std::shared_ptr<ThumbnailStore> store = nullptr
   );
   ThumbnailCache(
     std::shared_ptr<HttpClient> http_client,
     size_t cache_size,
     uint16_t thumbnail_size,
-    Dispatcher dispatcher = [](auto f) { f(); }
-  ) : ThumbnailCache(http_client, cache_size, thumbnail_size, thumbnail_size, dispatcher) {}
+    Dispatcher dispatcher = [](auto f) { f(); return true; },
+    std::shared_ptr<ThumbnailStore> store = nullptr
+  ) : ThumbnailCache(http_client, cache_size, thumbnail_size, thumbnail_size, dispatcher, store) {}
   auto thumbnail(std::string url) -> std::shared_ptr<CompletableOnce<ImageRef>>;
   auto set_thumbnail(std::string url, std::string_view mimetype, std::string_view data) -> bool;
   static auto generate_thumbnail(
@@ -0,0 +1,257 @@
+#include "thumbnail_store.h++"
+#include "util/common.h++"
+#include <xxhash.h>
+
+using std::function, std::lock_guard, std::mutex, std::runtime_error,
+    std::string_view, std::unique_ptr;
+
+namespace Ludwig {
+
+// Meta is keyed by these, so the totals don't have to be recounted on open
+static constexpr uint64_t META_BYTES = 0, META_ENTRIES = 1;
+
+static inline auto int_val(uint64_t* i) -> MDB_val {
+  return { .mv_size = sizeof(uint64_t), .mv_data = reinterpret_cast<void*>(i) };
+}
+
+static inline auto read_u64(const MDB_val& v) -> uint64_t {
+  assert(v.mv_size >= sizeof(uint64_t));
+  uint64_t n;
+  memcpy(&n, v.mv_data, sizeof(uint64_t));
+  return n;
+}
+
+struct MdbError : public runtime_error {
+  int code;
+  MdbError(int code) : runtime_error(mdb_strerror(code)), code(code) {}
+};
+
+static inline auto check(int err) -> void {
+  if (err) throw MdbError(err);
+}
+
+// Any other error (such as MDB_MAP_FULL) leaves the txn unusable
+static inline auto check_del(int err) -> void {
+  if (err != MDB_NOTFOUND) check(err);
+}
+
+static inline auto now_min() -> uint64_t {
+  return now_s() / 60;
+}
+
+static auto get_meta(MDB_txn* txn, MDB_dbi dbi, uint64_t key) -> uint64_t {
+  MDB_val k = int_val(&key), v;
+  return mdb_get(txn, dbi, &k, &v) ? 0 : read_u64(v);
+}
+
+static auto set_meta(MDB_txn* txn, MDB_dbi dbi, uint64_t key, uint64_t value) -> void {
+  MDB_val k = int_val(&key), v = int_val(&value);
+  check(mdb_put(txn, dbi, &k, &v, 0));
+}
+
+ThumbnailStore::ThumbnailStore(std::filesystem::path filename, size_t max_bytes) : max_bytes(max_bytes) {
+  // The map needs room beyond the stored bytes for page headers, partly
+  // filled overflow pages, and pages that older readers still hold
+  const auto os_page_size = (size_t)sysconf(_SC_PAGESIZE);
+  auto map_size = max_bytes * 2 + 16 * MiB;
+  map_size -= map_size % os_page_size;
+  MDB_txn* txn = nullptr;
+  int err = mdb_env_create(&env);
+  if (!err && !(err = mdb_env_set_maxdbs(env, 4)) && !(err = mdb_env_set_mapsize(env, map_size)) &&
+      !(err = mdb_env_open(env, filename.c_str(), MDB_NOSUBDIR | MDB_NOSYNC, 0600)) &&
+      !(err = mdb_txn_begin(env, nullptr, 0, &txn)) &&
+      !(err = mdb_dbi_open(txn, "Meta", MDB_CREATE | MDB_INTEGERKEY, &Meta)) &&
+      !(err = mdb_dbi_open(txn, "Images", MDB_CREATE | MDB_INTEGERKEY, &Images)) &&
+      !(err = mdb_dbi_open(txn, "Access", MDB_CREATE | MDB_INTEGERKEY, &Access)) &&
+      !(err = mdb_dbi_open(txn, "ByAccess",
+        MDB_CREATE | MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP, &ByAccess))) {
+    MDB_stat stat;
+    mdb_env_stat(env, &stat);
+    page_size = stat.ms_psize;
+    bytes = get_meta(txn, Meta, META_BYTES);
+    entries = get_meta(txn, Meta, META_ENTRIES);
+    err = mdb_txn_commit(txn);
+    txn = nullptr;
+  }
+  if (err) {
+    if (txn) mdb_txn_abort(txn);
+    mdb_env_close(env);
+    throw runtime_error(fmt::format("Thumbnail cache initialization failed: {}", mdb_strerror(err)));
+  }
+  spdlog::info("Opened thumbnail cache {}: {:d} thumbnails, {:d} KiB", filename.string(), entries.load(), bytes.load() / 1024);
+}
+
+ThumbnailStore::~ThumbnailStore() {
+  mdb_env_sync(env, 1);
+  mdb_env_close(env);
+}
+
+auto ThumbnailStore::key(string_view url, uint16_t width, uint16_t height) -> uint64_t {
+  return XXH3_64bits_withSeed(url.data(), url.length(), (uint64_t)width << 16 | height);
+}
+
+auto ThumbnailStore::get(uint64_t key, const function<void (string_view, uint64_t)>& fn) -> bool {
+  MDB_txn* txn;
+  if (const auto err = mdb_txn_begin(env, nullptr, MDB_RDONLY, &txn)) {
+    spdlog::warn("Thumbnail cache read failed: {}", mdb_strerror(err));
+    return false;
+  }
+  unique_ptr<MDB_txn, void(*)(MDB_txn*)> txn_guard(txn, mdb_txn_abort);
+  MDB_val k = int_val(&key), v;
+  if (mdb_get(txn, Images, &k, &v) || v.mv_size < sizeof(uint64_t)) {
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  fn(string_view((const char*)v.mv_data + sizeof(uint64_t), v.mv_size - sizeof(uint64_t)), read_u64(v));
+  hits.fetch_add(1, std::memory_order_relaxed);
+  const auto now = now_min();
+  if (MDB_val a; mdb_get(txn, Access, &k, &a) || read_u64(a) != now) {
+    lock_guard<mutex> g(touched_lock);
+    touched[key] = now;
+  }
+  return true;
+}
+
+auto ThumbnailStore::entry_size(size_t value_size) const noexcept -> size_t {
+  // Values over half a page go on their own overflow pages, which are only
+  // ever used whole
+  if (value_size + ENTRY_OVERHEAD > page_size / 2) {
+    return (value_size + PAGE_HEADER_SIZE + page_size - 1) / page_size * page_size + ENTRY_OVERHEAD;
+  }
+  return value_size + ENTRY_OVERHEAD;
+}
+
+auto ThumbnailStore::put(uint64_t key, string_view data, uint64_t hash) noexcept -> void {
+  const auto size = entry_size(sizeof(uint64_t) + data.length());
+  if (size > max_bytes) return;
+  phmap::flat_hash_map<uint64_t, uint64_t> to_touch;
+  {
+    lock_guard<mutex> g(touched_lock);
+    std::swap(touched, to_touch);
+  }
+  const Put thumbnail { .key = key, .data = data, .hash = hash };
+  try {
+    evict_and_put(max_bytes, to_touch, &thumbnail);
+    return;
+  } catch (const MdbError& e) {
+    if (e.code != MDB_MAP_FULL) {
+      spdlog::warn("Thumbnail cache write failed: {}", e.what());
+      return;
+    }
+  } catch (const runtime_error& e) {
+    spdlog::warn("Thumbnail cache write failed: {}", e.what());
+    return;
+  }
+  // Freed pages can't be reused while older readers still hold them, so the
+  // map can fill up before the byte budget does. Pages freed by evicting are
+  // only reusable once the eviction commits, so evict in a txn of its own,
+  // then try again with a smaller budget.
+  for (size_t budget = max_bytes / 2; budget >= size; budget /= 2) {
+    spdlog::debug("Thumbnail cache map is full, evicting down to {:d} KiB", budget / 1024);
+    try {
+      evict_and_put(budget, to_touch, nullptr);
+      evict_and_put(budget, {}, &thumbnail);
+      return;
+    } catch (const MdbError& e) {
+      if (e.code != MDB_MAP_FULL) {
+        spdlog::warn("Thumbnail cache write failed: {}", e.what());
+        return;
+      }
+    } catch (const runtime_error& e) {
+      spdlog::warn("Thumbnail cache write failed: {}", e.what());
+      return;
+    }
+  }
+  spdlog::warn("Thumbnail cache write failed: {}", mdb_strerror(MDB_MAP_FULL));
+}
+
+auto ThumbnailStore::evict_and_put(
+  size_t budget,
+  const phmap::flat_hash_map<uint64_t, uint64_t>& to_touch,
+  const Put* put
+) -> void {
+  const auto size = put ? entry_size(sizeof(uint64_t) + put->data.length()) : 0;
+  MDB_txn* txn;
+  check(mdb_txn_begin(env, nullptr, 0, &txn));
+  unique_ptr<MDB_txn, void(*)(MDB_txn*)> txn_guard(txn, mdb_txn_abort);
+  uint64_t n_bytes = get_meta(txn, Meta, META_BYTES), n_entries = get_meta(txn, Meta, META_ENTRIES), n_evicted = 0;
+
+  // Moves `k` from its old access time to `t` in ByAccess
+  const auto set_access = [&](uint64_t k, uint64_t t) {
+    MDB_val kv = int_val(&k), v;
+    if (!mdb_get(txn, Access, &kv, &v)) {
+      uint64_t old = read_u64(v);
+      if (old == t) return;
+      MDB_val old_k = int_val(&old), old_v = int_val(&k);
+      check_del(mdb_del(txn, ByAccess, &old_k, &old_v));
+    }
+    MDB_val tk = int_val(&t), tv = int_val(&k);
+    v = int_val(&t);
+    check(mdb_put(txn, Access, &kv, &v, 0));
+    check(mdb_put(txn, ByAccess, &tk, &tv, 0));
+  };
+  const auto remove = [&](uint64_t k) {
+    MDB_val kv = int_val(&k), v;
+    if (!mdb_get(txn, Images, &kv, &v)) {
+      n_bytes -= std::min<uint64_t>(n_bytes, entry_size(v.mv_size));
+      if (n_entries) n_entries--;
+      check(mdb_del(txn, Images, &kv, nullptr));
+    }
+    if (!mdb_get(txn, Access, &kv, &v)) {
+      uint64_t t = read_u64(v);
+      MDB_val tk = int_val(&t), tv = int_val(&k);
+      check_del(mdb_del(txn, ByAccess, &tk, &tv));
+      check(mdb_del(txn, Access, &kv, nullptr));
+    }
+  };
+
+  for (const auto [k, t] : to_touch) {
+    MDB_val kv = int_val(const_cast<uint64_t*>(&k)), v;
+    if (!mdb_get(txn, Images, &kv, &v)) set_access(k, t);
+  }
+  if (put) remove(put->key);
+
+  // Evict the least recently used thumbnails until the new one fits
+  if (n_bytes + size > budget) {
+    MDB_cursor* cur;
+    check(mdb_cursor_open(txn, ByAccess, &cur));
+    unique_ptr<MDB_cursor, void(*)(MDB_cursor*)> cur_guard(cur, mdb_cursor_close);
+    MDB_val k, v;
+    while (n_bytes + size > budget && !mdb_cursor_get(cur, &k, &v, MDB_FIRST)) {
+      remove(read_u64(v));
+      n_evicted++;
+    }
+  }
+
+  if (put) {
+    uint64_t key = put->key;
+    MDB_val k = int_val(&key), v { .mv_size = sizeof(uint64_t) + put->data.length(), .mv_data = nullptr };
+    check(mdb_put(txn, Images, &k, &v, MDB_RESERVE));
+    memcpy(v.mv_data, &put->hash, sizeof(uint64_t));
+    memcpy((uint8_t*)v.mv_data + sizeof(uint64_t), put->data.data(), put->data.length());
+    set_access(key, now_min());
+    n_bytes += size;
+    n_entries++;
+  }
+  set_meta(txn, Meta, META_BYTES, n_bytes);
+  set_meta(txn, Meta, META_ENTRIES, n_entries);
+  check(mdb_txn_commit(txn_guard.release()));
+
+  bytes.store(n_bytes, std::memory_order_relaxed);
+  entries.store(n_entries, std::memory_order_relaxed);
+  if (put) puts.fetch_add(1, std::memory_order_relaxed);
+  evictions.fetch_add(n_evicted, std::memory_order_relaxed);
+}
+
+auto ThumbnailStore::stats() -> Stats {
+  return {
+    .hits = hits.load(std::memory_order_relaxed),
+    .misses = misses.load(std::memory_order_relaxed),
+    .puts = puts.load(std::memory_order_relaxed),
+    .evictions = evictions.load(std::memory_order_relaxed),
+    .entries = entries.load(std::memory_order_relaxed),
+    .bytes = bytes.load(std::memory_order_relaxed)
+  };
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <lmdb.h>
+#include <parallel_hashmap/phmap.h>
+
+namespace Ludwig {
+
+// On-disk second tier for ThumbnailCache, so that thumbnails survive restarts
+// and eviction from memory without being fetched and decoded again.
+//
+// Encoded thumbnails are stored in their own LMDB file, keyed by a hash of the
+// source URL and thumbnail size, along with the hash of their contents (used
+// as the Etag). The total size, counted in whole pages for thumbnails big
+// enough to need overflow pages, is capped at `max_bytes`; adding a thumbnail
+// that would go over it evicts the least recently used ones first. Access
+// times are tracked to the minute, and are only written with the next put, so
+// that reads never need a write transaction.
+class ThumbnailStore {
+public:
+  struct Stats {
+    uint64_t hits, misses, puts, evictions, entries, bytes;
+  };
+private:
+  // Rough size of the keys and index entries of a stored thumbnail
+  static constexpr size_t ENTRY_OVERHEAD = 64;
+  // LMDB's page header, which overflow pages also have
+  static constexpr size_t PAGE_HEADER_SIZE = 16;
+
+  MDB_env* env;
+  MDB_dbi Meta, Images, Access, ByAccess;
+  size_t max_bytes, page_size = 4096;
+  std::atomic<uint64_t> hits = 0, misses = 0, puts = 0, evictions = 0, entries = 0, bytes = 0;
+  std::mutex touched_lock;
+  phmap::flat_hash_map<uint64_t, uint64_t> touched;
+
+  // Bytes of the map that a value of this size takes up, counted in whole
+  // pages if it needs overflow pages
+  auto entry_size(size_t value_size) const noexcept -> size_t;
+  struct Put {
+    uint64_t key;
+    std::string_view data;
+    uint64_t hash;
+  };
+  // In one write txn, records access times, evicts until the total (with
+  // `put`, if any) is at most `budget`, then adds `put`. Throws on errors,
+  // including MDB_MAP_FULL.
+  auto evict_and_put(
+    size_t budget,
+    const phmap::flat_hash_map<uint64_t, uint64_t>& to_touch,
+    const Put* put
+  ) -> void;
+public:
+  ThumbnailStore(std::filesystem::path filename, size_t max_bytes);
+  ~ThumbnailStore();
+  ThumbnailStore(const ThumbnailStore&) = delete;
+  auto operator=(const ThumbnailStore&) = delete;
+
+  static auto key(std::string_view url, uint16_t width, uint16_t height) -> uint64_t;
+
+  // Calls `fn` with the stored thumbnail and its hash, if there is one.
+  // `data` points into the database map, and is only valid during the call.
+  auto get(
+    uint64_t key,
+    const std::function<void (std::string_view data, uint64_t hash)>& fn
+  ) -> bool;
+  // Errors are logged, not thrown; a thumbnail that isn't stored will just be
+  // generated again the next time it's needed
+  auto put(uint64_t key, std::string_view data, uint64_t hash) noexcept -> void;
+  auto stats() -> Stats;
+};
+
+}
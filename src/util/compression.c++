@@ -0,0 +1,114 @@
+#include "compression.h++"
+#include <memory>
+#include <string>
+#include <zlib.h>
+#include <zstd.h>
+#ifdef LUDWIG_BROTLI
+#include <brotli/encode.h>
+#endif
+
+using std::nullopt, std::optional, std::string, std::string_view, std::unique_ptr;
+
+namespace Ludwig {
+
+// Dynamic responses are compressed on the request thread, so favor speed
+static constexpr int ZSTD_LEVEL = 3, GZIP_LEVEL = 6;
+#ifdef LUDWIG_BROTLI
+static constexpr int BROTLI_QUALITY = 4;
+#endif
+
+static inline auto trim(string_view s) -> string_view {
+  const auto start = s.find_first_not_of(" \t");
+  if (start == string_view::npos) return {};
+  return s.substr(start, s.find_last_not_of(" \t") - start + 1);
+}
+
+auto negotiate_content_encoding(string_view accept_encoding) noexcept -> ContentEncoding {
+  using enum ContentEncoding;
+  auto best = Identity;
+  double best_q = 0;
+  while (!accept_encoding.empty()) {
+    const auto comma = accept_encoding.find(',');
+    const auto item = accept_encoding.substr(0, comma);
+    accept_encoding = comma == string_view::npos ? "" : accept_encoding.substr(comma + 1);
+    const auto semicolon = item.find(';');
+    const auto name = trim(item.substr(0, semicolon));
+    double q = 1;
+    if (semicolon != string_view::npos) {
+      const auto params = trim(item.substr(semicolon + 1));
+      if (params.starts_with("q=")) q = std::strtod(string(params.substr(2)).c_str(), nullptr);
+    }
+    ContentEncoding encoding;
+    if (name == "zstd") encoding = Zstd;
+#   ifdef LUDWIG_BROTLI
+    else if (name == "br") encoding = Brotli;
+#   endif
+    else if (name == "gzip" || name == "x-gzip") encoding = Gzip;
+    else continue;
+    // Enum order is preference order, for encodings with equal q-values
+    if (q > best_q || (q > 0 && q == best_q && encoding > best)) {
+      best = encoding;
+      best_q = q;
+    }
+  }
+  return best;
+}
+
+namespace {
+  struct GzipStream {
+    z_stream stream {};
+    bool ok;
+    GzipStream() : ok(deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK) {}
+    ~GzipStream() { if (ok) deflateEnd(&stream); }
+  };
+}
+
+auto compress_response(ContentEncoding encoding, string_view src) noexcept -> optional<string_view> {
+  if (encoding == ContentEncoding::Identity || src.length() < COMPRESS_MIN_SIZE) return nullopt;
+  thread_local string out;
+  try {
+    switch (encoding) {
+      case ContentEncoding::Zstd: {
+        thread_local unique_ptr<ZSTD_CCtx, size_t(*)(ZSTD_CCtx*)> ctx(ZSTD_createCCtx(), &ZSTD_freeCCtx);
+        if (!ctx) return nullopt;
+        out.resize_and_overwrite(ZSTD_compressBound(src.length()), [&](char* buf, size_t cap) -> size_t {
+          const auto size = ZSTD_compressCCtx(ctx.get(), buf, cap, src.data(), src.length(), ZSTD_LEVEL);
+          return ZSTD_isError(size) ? 0 : size;
+        });
+        break;
+      }
+      case ContentEncoding::Gzip: {
+        thread_local GzipStream gzip;
+        if (!gzip.ok || deflateReset(&gzip.stream) != Z_OK) return nullopt;
+        out.resize_and_overwrite(deflateBound(&gzip.stream, src.length()), [&](char* buf, size_t cap) -> size_t {
+          gzip.stream.next_in = (Bytef*)src.data();
+          gzip.stream.avail_in = (uInt)src.length();
+          gzip.stream.next_out = (Bytef*)buf;
+          gzip.stream.avail_out = (uInt)cap;
+          return deflate(&gzip.stream, Z_FINISH) == Z_STREAM_END ? gzip.stream.total_out : 0;
+        });
+        break;
+      }
+#     ifdef LUDWIG_BROTLI
+      case ContentEncoding::Brotli:
+        // The one-shot encoder has no reusable state, so there is no context to keep
+        out.resize_and_overwrite(BrotliEncoderMaxCompressedSize(src.length()), [&](char* buf, size_t cap) -> size_t {
+          size_t size = cap;
+          return BrotliEncoderCompress(
+            BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+            src.length(), (const uint8_t*)src.data(), &size, (uint8_t*)buf
+          ) ? size : 0;
+        });
+        break;
+#     endif
+      default:
+        return nullopt;
+    }
+  } catch (...) {
+    return nullopt;
+  }
+  if (out.empty() || out.length() >= src.length()) return nullopt;
+  return out;
+}
+
+}
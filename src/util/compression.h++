@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace Ludwig {
+
+enum class ContentEncoding : uint8_t {
+  Identity, Gzip, Brotli, Zstd
+};
+
+// Responses smaller than this aren't worth the CPU time to compress
+static constexpr size_t COMPRESS_MIN_SIZE = 1024;
+
+static constexpr auto content_encoding_name(ContentEncoding e) -> std::string_view {
+  switch (e) {
+    case ContentEncoding::Gzip: return "gzip";
+    case ContentEncoding::Brotli: return "br";
+    case ContentEncoding::Zstd: return "zstd";
+    default: return "identity";
+  }
+}
+
+// Picks the best supported encoding from an Accept-Encoding header, by
+// q-value and then by preference (zstd, then br, then gzip). Brotli is only
+// supported if built with -Dbrotli=true.
+auto negotiate_content_encoding(std::string_view accept_encoding) noexcept -> ContentEncoding;
+
+// Compresses `src` with a compression context reused by the calling thread.
+// The returned view points into a per-thread buffer, and is only valid until
+// the next call on the same thread. Returns nullopt if `src` should be sent
+// uncompressed (Identity, too small, or the compressor failed).
+auto compress_response(ContentEncoding encoding, std::string_view src) noexcept -> std::optional<std::string_view>;
+
+}
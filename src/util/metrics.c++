@@ -0,0 +1,153 @@
+#include "metrics.h++"
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <variant>
+#include <fmt/format.h>
+
+using std::function, std::lock_guard, std::map, std::mutex, std::string, std::string_view, std::unique_ptr;
+
+namespace Ludwig::Metrics {
+
+namespace {
+  struct Callback {
+    function<double ()> fn;
+  };
+
+  using Series = std::variant<unique_ptr<Counter>, unique_ptr<Histogram>, Callback>;
+
+  struct Family {
+    string help;
+    std::string_view type;
+    // Keyed by formatted labels, so the output is in a stable order
+    map<string, Series> series;
+  };
+
+  struct Registry {
+    mutex lock;
+    map<string, Family, std::less<>> families;
+  };
+
+  auto registry() -> Registry& {
+    static Registry r;
+    return r;
+  }
+
+  auto format_labels(Labels labels) -> string {
+    string out;
+    for (const auto& [k, v] : labels) {
+      if (!out.empty()) out.push_back(',');
+      fmt::format_to(std::back_inserter(out), R"({}=")", k);
+      for (const char c : v) {
+        switch (c) {
+          case '\\': out += R"(\\)"; break;
+          case '"': out += R"(\")"; break;
+          case '\n': out += R"(\n)"; break;
+          default: out.push_back(c);
+        }
+      }
+      out.push_back('"');
+    }
+    return out;
+  }
+
+  template <typename Fn>
+  auto find_or_add(string_view name, string_view help, string_view type, Labels labels, Fn make) -> Series& {
+    auto& r = registry();
+    lock_guard<mutex> g(r.lock);
+    auto family = r.families.find(name);
+    if (family == r.families.end()) {
+      family = r.families.emplace(string(name), Family{ .help = string(help), .type = type }).first;
+    } else if (family->second.type != type) {
+      throw std::runtime_error(fmt::format("Metric {} registered twice with different types", name));
+    }
+    auto [it, inserted] = family->second.series.try_emplace(format_labels(labels));
+    if (inserted) it->second = make();
+    return it->second;
+  }
+
+  auto write_series(string& out, string_view name, string_view suffix, string_view labels, string_view extra_label = {}) -> void {
+    fmt::format_to(std::back_inserter(out), "{}{}", name, suffix);
+    if (!labels.empty() || !extra_label.empty()) {
+      out.push_back('{');
+      out += labels;
+      if (!labels.empty() && !extra_label.empty()) out.push_back(',');
+      out += extra_label;
+      out.push_back('}');
+    }
+    out.push_back(' ');
+  }
+}
+
+auto assign_shard() noexcept -> size_t {
+  static std::atomic<size_t> next = 0;
+  return next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+}
+
+auto Counter::value() const noexcept -> uint64_t {
+  uint64_t n = 0;
+  for (const auto& s : shards) n += s.n.load(std::memory_order_relaxed);
+  return n;
+}
+
+auto counter(string_view name, string_view help, Labels labels) -> Counter& {
+  return *std::get<unique_ptr<Counter>>(find_or_add(name, help, "counter", labels, [] {
+    return Series(std::make_unique<Counter>());
+  }));
+}
+
+auto histogram(string_view name, string_view help, Unit unit, Labels labels) -> Histogram& {
+  return *std::get<unique_ptr<Histogram>>(find_or_add(name, help, "histogram", labels, [unit] {
+    return Series(std::make_unique<Histogram>(unit));
+  }));
+}
+
+auto callback(string_view name, string_view help, Type type, function<double ()> fn, Labels labels) -> void {
+  std::get<Callback>(find_or_add(name, help, type == Type::Counter ? "counter" : "gauge", labels, [&] {
+    return Series(Callback{ std::move(fn) });
+  }));
+}
+
+auto to_prometheus() -> string {
+  auto& r = registry();
+  lock_guard<mutex> g(r.lock);
+  string out;
+  for (const auto& [name, family] : r.families) {
+    fmt::format_to(std::back_inserter(out), "# HELP {} {}\n# TYPE {} {}\n", name, family.help, name, family.type);
+    for (const auto& [labels, series] : family.series) {
+      if (const auto* c = std::get_if<unique_ptr<Counter>>(&series)) {
+        write_series(out, name, "", labels);
+        fmt::format_to(std::back_inserter(out), "{}\n", (*c)->value());
+      } else if (const auto* h = std::get_if<unique_ptr<Histogram>>(&series)) {
+        // Sum the shards first, so that buckets, _count, and _sum agree
+        std::array<uint64_t, Histogram::BUCKETS> buckets = {};
+        uint64_t sum = 0;
+        for (const auto& s : (*h)->shards) {
+          for (size_t i = 0; i < Histogram::BUCKETS; i++) buckets[i] += s.buckets[i].load(std::memory_order_relaxed);
+          sum += s.sum.load(std::memory_order_relaxed);
+        }
+        uint64_t count = 0;
+        for (size_t i = 0; i < Histogram::BUCKETS; i++) {
+          count += buckets[i];
+          const auto le = i == Histogram::BUCKETS - 1
+            ? string("+Inf")
+            : fmt::format("{}", std::ldexp((*h)->scale, (*h)->min_bits + (int)i));
+          write_series(out, name, "_bucket", labels, fmt::format(R"(le="{}")", le));
+          fmt::format_to(std::back_inserter(out), "{}\n", count);
+        }
+        write_series(out, name, "_sum", labels);
+        fmt::format_to(std::back_inserter(out), "{}\n", (double)sum * (*h)->scale);
+        write_series(out, name, "_count", labels);
+        fmt::format_to(std::back_inserter(out), "{}\n", count);
+      } else {
+        write_series(out, name, "", labels);
+        fmt::format_to(std::back_inserter(out), "{}\n", std::get<Callback>(series).fn());
+      }
+    }
+  }
+  return out;
+}
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Process-wide counters and histograms, exported in Prometheus text format at
+// /metrics (see define_metrics_route in views/router_common.h++).
+//
+// Metrics are registered once, by name and labels, and live until the process
+// exits; recording a value is a relaxed atomic add on one of SHARDS
+// cache-line-aligned slots, picked per thread, so threads don't contend with
+// each other. Build with -Dmetrics=false to compile recording out entirely.
+namespace Ludwig::Metrics {
+
+#ifdef LUDWIG_METRICS
+static constexpr bool enabled = true;
+#else
+static constexpr bool enabled = false;
+#endif
+
+static constexpr size_t SHARDS = 16;
+
+// Each thread gets the next shard, round-robin, the first time it records
+auto assign_shard() noexcept -> size_t;
+constinit inline thread_local size_t thread_shard = SIZE_MAX;
+
+static inline auto shard_index() noexcept -> size_t {
+  if (thread_shard == SIZE_MAX) [[unlikely]] thread_shard = assign_shard();
+  return thread_shard;
+}
+
+// Measures elapsed time; doesn't even read the clock if metrics are disabled
+class Stopwatch {
+  std::chrono::steady_clock::time_point start;
+public:
+  Stopwatch() noexcept {
+    if constexpr (enabled) start = std::chrono::steady_clock::now();
+  }
+  auto elapsed_ns() const noexcept -> uint64_t {
+    if constexpr (!enabled) return 0;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start
+    ).count();
+  }
+};
+
+class Counter {
+  struct alignas(64) Shard { std::atomic<uint64_t> n = 0; };
+  std::array<Shard, enabled ? SHARDS : 0> shards;
+public:
+  auto inc(uint64_t n = 1) noexcept -> void {
+    if constexpr (enabled) shards[shard_index()].n.fetch_add(n, std::memory_order_relaxed);
+  }
+  auto value() const noexcept -> uint64_t;
+};
+
+enum class Unit : uint8_t { Seconds, Bytes };
+
+// Bucket bounds are powers of 2, starting at ~1µs for Seconds (values are
+// recorded in nanoseconds) and at 64 bytes for Bytes, so that picking a bucket
+// is just a bit_width.
+class Histogram {
+public:
+  static constexpr size_t BUCKETS = 24;
+private:
+  struct alignas(64) Shard {
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets = {};
+    std::atomic<uint64_t> sum = 0;
+  };
+  std::array<Shard, enabled ? SHARDS : 0> shards;
+  uint8_t min_bits;
+  double scale;
+public:
+  Histogram(Unit unit) : min_bits(unit == Unit::Seconds ? 10 : 6), scale(unit == Unit::Seconds ? 1e-9 : 1.0) {}
+
+  // `value` is in nanoseconds for Seconds, or in bytes for Bytes
+  auto observe(uint64_t value) noexcept -> void {
+    if constexpr (enabled) {
+      const auto bits = (size_t)std::bit_width(value);
+      const size_t bucket = bits <= min_bits ? 0 : std::min(bits - min_bits, BUCKETS - 1);
+      auto& shard = shards[shard_index()];
+      shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+      shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+  }
+  auto observe(const Stopwatch& stopwatch) noexcept -> void {
+    if constexpr (enabled) observe(stopwatch.elapsed_ns());
+  }
+
+  friend auto to_prometheus() -> std::string;
+};
+
+// Records the time until it goes out of scope
+class ScopedTimer {
+  Histogram& histogram;
+  Stopwatch stopwatch;
+public:
+  ScopedTimer(Histogram& histogram) noexcept : histogram(histogram) {}
+  ScopedTimer(const ScopedTimer&) = delete;
+  auto operator=(const ScopedTimer&) = delete;
+  ~ScopedTimer() { histogram.observe(stopwatch); }
+};
+
+using Labels = std::initializer_list<std::pair<std::string_view, std::string_view>>;
+
+// Registering the same name and labels again returns the existing metric, so
+// per-thread setup code (like route definitions) can register freely. The
+// returned references are valid for the lifetime of the process.
+auto counter(std::string_view name, std::string_view help, Labels labels = {}) -> Counter&;
+auto histogram(std::string_view name, std::string_view help, Unit unit, Labels labels = {}) -> Histogram&;
+
+// For values that are already tracked elsewhere (like DB::write_queue_stats),
+// and are only read when /metrics is requested. `fn` must stay valid for the
+// lifetime of the process.
+enum class Type : uint8_t { Counter, Gauge };
+auto callback(std::string_view name, std::string_view help, Type type, std::function<double ()> fn, Labels labels = {}) -> void;
+
+auto to_prometheus() -> std::string;
+
+}
@@ -8,6 +8,17 @@ RateLimiter::RateLimiter(double permits_per_second, uint32_t max_permits)
   if (permits_per_second <= 0) throw std::runtime_error("RateLimiter: permits_per_second must be > 0");
 }
 
+Metrics::Counter& KeyedRateLimiter::allowed_metric = Metrics::counter(
+  "ludwig_rate_limiter_requests_total",
+  "Requests checked against a KeyedRateLimiter, by result",
+  {{"result", "allowed"}}
+);
+Metrics::Counter& KeyedRateLimiter::rejected_metric = Metrics::counter(
+  "ludwig_rate_limiter_requests_total",
+  "Requests checked against a KeyedRateLimiter, by result",
+  {{"result", "rejected"}}
+);
+
 // Based on https://github.com/mfycheng/ratelimiter, Apache 2.0 license
 auto RateLimiter::claim_next(uint32_t count) noexcept -> std::chrono::microseconds {
   using namespace std::chrono;
@@ -1,5 +1,6 @@
 #pragma once
 #include "util/asio_common.h++"
+#include "util/metrics.h++"
 #include <concurrent_lru_cache.h>
 
 namespace Ludwig {
@@ -55,12 +56,17 @@ public:
 class KeyedRateLimiter {
 private:
   tbb::concurrent_lru_cache<std::string, RateLimiter, std::function<RateLimiter (std::string_view)>> by_key;
+  static Metrics::Counter &allowed_metric, &rejected_metric;
+  static inline auto record(bool allowed) noexcept -> bool {
+    (allowed ? allowed_metric : rejected_metric).inc();
+    return allowed;
+  }
 public:
   KeyedRateLimiter(double permits_per_second, uint32_t max_permits, size_t max_keys = 65536)
     : by_key([permits_per_second, max_permits](std::string_view)->RateLimiter{ return RateLimiter(permits_per_second, max_permits); }, max_keys) {}
   auto try_acquire(std::string key, uint32_t permits = 1) -> bool {
     auto handle = by_key[key];
-    return handle.value().try_acquire(permits);
+    return record(handle.value().try_acquire(permits));
   }
   auto try_acquire_or_block(std::string key, std::chrono::steady_clock::duration timeout, uint32_t permits = 1) -> bool {
     using namespace std::chrono;
@@ -69,11 +75,11 @@ public:
     {
       auto handle = by_key[key];
       const auto now = duration_cast<microseconds>(steady_clock::now().time_since_epoch());
-      if (handle.value().next_free > now + timeout) return false;
+      if (handle.value().next_free > now + timeout) return record(false);
       wait = handle.value().claim_next(permits);
     }
     std::this_thread::sleep_for(wait);
-    return true;
+    return record(true);
   }
   auto try_acquire_or_asio_await(std::string key, std::chrono::steady_clock::duration timeout, uint32_t permits = 1) -> Async<bool> {
     using namespace std::chrono;
@@ -82,13 +88,13 @@ public:
     {
       auto handle = by_key[key];
       const auto now = duration_cast<microseconds>(steady_clock::now().time_since_epoch());
-      if (handle.value().next_free > now + timeout) co_return false;
+      if (handle.value().next_free > now + timeout) co_return record(false);
       wait = handle.value().claim_next(permits);
-      if (wait == microseconds::zero()) co_return true;
+      if (wait == microseconds::zero()) co_return record(true);
     }
     asio::steady_timer timer(co_await asio::this_coro::executor, wait);
     co_await timer.async_wait(asio::deferred);
-    co_return true;
+    co_return record(true);
   }
 };
 
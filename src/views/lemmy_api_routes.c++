@@ -2,6 +2,7 @@
 #include "util/rate_limiter.h++"
 #include "router_common.h++"
 #include <flatbuffers/minireflect.h>
+#include <xxhash.h>
 
 using std::make_shared, std::nullopt, std::optional, std::shared_ptr, std::string,
     std::string_view;
@@ -12,17 +13,29 @@ template <bool SSL>
 struct Context : public RequestContext<SSL, std::shared_ptr<KeyedRateLimiter>> {
   optional<SecretString> auth;
   string ip;
+  ContentEncoding encoding = ContentEncoding::Identity;
+  string if_none_match;
+  uint64_t auth_hash = 0;
+  uWS::HttpResponse<SSL>* rsp = nullptr;
+  // Set by write_json; sent by flush
+  optional<string> json_body;
+  bool etag_from_body = false;
 
   void pre_request(uWS::HttpResponse<SSL>* rsp, uWS::HttpRequest* req, std::shared_ptr<KeyedRateLimiter> rate_limiter) override {
+    this->rsp = rsp;
     ip = get_ip(rsp, req);
     if (rate_limiter && !rate_limiter->try_acquire(ip, this->method == "get" ? 1 : 10)) {
       throw ApiError("Rate limited, try again later", 429);
     }
     const auto auth_header = req->getHeader("authorization");
     auth = auth_header.starts_with("Bearer ") ? optional(SecretString(auth_header.substr(7))) : nullopt;
+    auth_hash = XXH3_64bits(auth_header.data(), auth_header.length());
+    encoding = negotiate_content_encoding(req->getHeader("accept-encoding"));
+    if_none_match = req->getHeader("if-none-match");
   }
 
   void error_response(const ApiError& err, uWS::HttpResponse<SSL>* rsp) noexcept override {
+    json_body.reset();
     string s;
     Error e { err.message, err.http_status };
     JsonSerialize<Error>::to_json(e, s);
@@ -32,6 +45,35 @@ struct Context : public RequestContext<SSL, std::shared_ptr<KeyedRateLimiter>> {
       ->end(s);
   }
 
+  // Sends the response with an ETag derived from its body, or sends 304 Not
+  // Modified instead if the client's copy has the same ETag.
+  auto cache_by_etag() noexcept -> void {
+    etag_from_body = true;
+  }
+
+  auto flush() -> void override {
+    if (!json_body) return;
+    const auto body = std::move(*json_body);
+    json_body.reset();
+    if (etag_from_body) {
+      // Query-string auth is part of the URL, so only header auth is hashed into it
+      const auto etag = weak_etag(body, auth_hash);
+      if (etag_matches(if_none_match, etag)) {
+        rsp->writeStatus(http_status(304))
+          ->writeHeader("Etag", etag)
+          ->writeHeader("Cache-Control", "private, no-cache")
+          ->writeHeader("Access-Control-Allow-Origin", "*")
+          ->end();
+        return;
+      }
+      rsp->writeHeader("Etag", etag)
+        ->writeHeader("Cache-Control", "private, no-cache");
+    }
+    rsp->writeHeader("Content-Type", "application/json; charset=utf-8")
+      ->writeHeader("Access-Control-Allow-Origin", "*");
+    end_with_encoding(rsp, encoding, body);
+  }
+
   auto header_or_query_auth(QueryString<uWS::HttpRequest*>& q) -> optional<SecretString> {
     if (auth) return std::move(auth);
     return q.optional_string("auth").transform([](auto s){return SecretString(s);});
@@ -45,13 +87,13 @@ static inline auto write_no_content(uWS::HttpResponse<SSL>* rsp) {
     ->end();
 }
 
+// Serializes the response; it is compressed and sent by ctx.flush(), after the
+// route's transactions are closed
 template <bool SSL, typename T>
-static inline auto write_json(uWS::HttpResponse<SSL>* rsp, T&& t) -> void {
+static inline auto write_json(uWS::HttpResponse<SSL>*, Context<SSL>& ctx, T&& t) -> void {
   string s;
   JsonSerialize<T>::to_json(t, s);
-  rsp->writeHeader("Content-Type", "application/json; charset=utf-8")
-    ->writeHeader("Access-Control-Allow-Origin", "*")
-    ->end(s);
+  ctx.json_body = std::move(s);
 }
 
 template <class Fn, bool SSL, class In, class Out>
@@ -73,9 +115,16 @@ struct JsonRequestBuilder {
     router.template post_json<In>(pattern, parser, [db = db, handler = std::move(handler)](auto* rsp, auto c, auto body) -> RouterCoroutine<Context<SSL>> {
       auto& ctx = co_await c;
       auto form = co_await body;
-      auto txn = co_await db->open_write_txn();
-      write_json<SSL, Out>(rsp, handler(form, ctx, txn));
-      txn.commit();
+      std::optional<Out> out;
+      shared_ptr<CompletableOnce<bool>> committed;
+      {
+        auto txn = co_await db->open_write_txn();
+        out.emplace(handler(form, ctx, txn));
+        committed = txn.commit();
+      }
+      // Only report success once the write is committed (see WriteTxn::commit)
+      if (!co_await committed) throw ApiError("Failed to save changes", 500);
+      write_json<SSL, Out>(rsp, ctx, std::move(*out));
     }, max_size);
   }
 
@@ -84,9 +133,16 @@ struct JsonRequestBuilder {
     router.template put_json<In>(pattern, parser, [db = db, handler = std::move(handler)](auto* rsp, auto c, auto body) -> RouterCoroutine<Context<SSL>> {
       auto& ctx = co_await c;
       auto form = co_await body;
-      auto txn = co_await db->open_write_txn();
-      write_json<SSL, Out>(rsp, handler(form, ctx, txn));
-      txn.commit();
+      std::optional<Out> out;
+      shared_ptr<CompletableOnce<bool>> committed;
+      {
+        auto txn = co_await db->open_write_txn();
+        out.emplace(handler(form, ctx, txn));
+        committed = txn.commit();
+      }
+      // Only report success once the write is committed (see WriteTxn::commit)
+      if (!co_await committed) throw ApiError("Failed to save changes", 500);
+      write_json<SSL, Out>(rsp, ctx, std::move(*out));
     }, max_size);
   }
 };
@@ -111,17 +167,24 @@ void define_api_routes(
   router.get("/api/v3/site", [db, controller](auto* rsp, auto* req, auto& ctx) {
     QueryString q(req);
     auto txn = db->open_read_txn();
-    write_json<SSL>(rsp, controller->get_site(txn, ctx.header_or_query_auth(q)));
+    ctx.cache_by_etag();
+    write_json<SSL>(rsp, ctx, controller->get_site(txn, ctx.header_or_query_auth(q)));
   });
   router.template post_json<CreateSite>("/api/v3/site", parser, [db, controller](auto* rsp, auto c, auto body) -> Coro {
     auto& ctx = co_await c;
     auto form = co_await body;
-    write_json<SSL, SiteResponse>(rsp, controller->create_site(co_await db->open_write_txn(), form, std::move(ctx.auth)));
+    const auto committed = controller->create_site(co_await db->open_write_txn(), form, std::move(ctx.auth));
+    if (!co_await committed) throw ApiError("Failed to save changes", 500);
+    auto txn = db->open_read_txn();
+    write_json<SSL, SiteResponse>(rsp, ctx, { .site_view = controller->get_site_view(txn), .taglines = {} });
   });
   router.template put_json<EditSite>("/api/v3/site", parser, [db, controller](auto* rsp, auto c, auto body) -> Coro {
     auto& ctx = co_await c;
     auto form = co_await body;
-    write_json<SSL, SiteResponse>(rsp, controller->edit_site(co_await db->open_write_txn(), form, std::move(ctx.auth)));
+    const auto committed = controller->edit_site(co_await db->open_write_txn(), form, std::move(ctx.auth));
+    if (!co_await committed) throw ApiError("Failed to save changes", 500);
+    auto txn = db->open_read_txn();
+    write_json<SSL, SiteResponse>(rsp, ctx, { .site_view = controller->get_site_view(txn), .taglines = {} });
   });
   // TODO: /api/v3/site/block
 
@@ -139,7 +202,8 @@ void define_api_routes(
   router.get("/api/v3/community", [db, controller](auto* rsp, auto* req, auto& ctx) {
     QueryString q(req);
     auto txn = db->open_read_txn();
-    write_json<SSL>(rsp, controller->get_community(txn,
+    ctx.cache_by_etag();
+    write_json<SSL>(rsp, ctx, controller->get_community(txn,
       {.id=q.optional_uint("id").value_or(0),.name=q.optional_string("name").value_or("")},
       ctx.header_or_query_auth(q))
     );
@@ -154,7 +218,8 @@ void define_api_routes(
   router.get("/api/v3/community/list", [db, controller](auto* rsp, auto* req, auto& ctx) {
     QueryString q(req);
     auto txn = db->open_read_txn();
-    write_json<SSL>(rsp, controller->list_communities(txn, {
+    ctx.cache_by_etag();
+    write_json<SSL>(rsp, ctx, controller->list_communities(txn, {
       .sort = parse_board_sort_type(q.string("sort")),
       .limit = (uint16_t)q.optional_uint("limit").value_or(0),
       .page = (uint16_t)q.optional_uint("page").value_or(1),
@@ -179,7 +244,8 @@ void define_api_routes(
   router.get("/api/v3/post", [db, controller](auto* rsp, auto* req, auto& ctx) {
     QueryString q(req);
     auto txn = db->open_read_txn();
-    write_json<SSL>(rsp, controller->get_post(txn, {
+    ctx.cache_by_etag();
+    write_json<SSL>(rsp, ctx, controller->get_post(txn, {
       .id = q.optional_uint("id").value_or(0),
       .comment_id = q.optional_uint("comment_id").value_or(0)
     }, ctx.header_or_query_auth(q)));
@@ -193,7 +259,8 @@ void define_api_routes(
   router.get("/api/v3/post/list", [db, controller](auto* rsp, auto* req, auto& ctx) {
     QueryString q(req);
     auto txn = db->open_read_txn();
-    write_json<SSL>(rsp, controller->get_posts(txn, {
+    ctx.cache_by_etag();
+    write_json<SSL>(rsp, ctx, controller->get_posts(txn, {
       .type = q.optional_string("type").or_else([&](){return q.optional_string("type_");}).transform(parse_listing_type),
       .sort = q.optional_string("sort").value_or(""),
       .community_name = q.optional_string("community_name").value_or(""),
@@ -232,7 +299,8 @@ void define_api_routes(
   router.get("/api/v3/comment", [db, controller](auto* rsp, auto* req, auto& ctx) {
     QueryString q(req);
     auto txn = db->open_read_txn();
-    write_json<SSL>(rsp, controller->get_comment(txn, {.id=q.required_hex_id("id")}, ctx.header_or_query_auth(q)));
+    ctx.cache_by_etag();
+    write_json<SSL>(rsp, ctx, controller->get_comment(txn, {.id=q.required_hex_id("id")}, ctx.header_or_query_auth(q)));
   });
   JSON_ROUTE("/api/v3/comment", CreateComment, CommentResponse).post([controller](auto& form, auto& ctx, auto&& txn) {
     return controller->create_comment(txn, form, std::move(ctx.auth));
@@ -243,7 +311,8 @@ void define_api_routes(
   router.get("/api/v3/comment/list", [db, controller](auto* rsp, auto* req, auto& ctx) {
     QueryString q(req);
     auto txn = db->open_read_txn();
-    write_json<SSL>(rsp, controller->get_comments(txn, {
+    ctx.cache_by_etag();
+    write_json<SSL>(rsp, ctx, controller->get_comments(txn, {
       .type = q.optional_string("type").or_else([&](){return q.optional_string("type_");}).transform(parse_listing_type),
       .sort = q.optional_string("sort").value_or(""),
       .community_name = q.optional_string("community_name").value_or(""),
@@ -287,7 +356,8 @@ void define_api_routes(
   router.get("/api/v3/user", [db, controller](auto* rsp, auto* req, auto& ctx) {
     QueryString q(req);
     auto txn = db->open_read_txn();
-    write_json<SSL>(rsp, controller->get_person_details(txn, {
+    ctx.cache_by_etag();
+    write_json<SSL>(rsp, ctx, controller->get_person_details(txn, {
       .username = q.optional_string("username").value_or(""),
       .community_id = q.optional_uint("community_id").value_or(0),
       .person_id = q.optional_uint("person_id").value_or(0),
@@ -304,10 +374,16 @@ void define_api_routes(
       .username_or_email = form.username,
       .password = SecretString(form.password.data)
     };
-    auto txn = co_await db->open_write_txn();
-    controller->register_account(txn, form, ctx.ip, ctx.user_agent);
-    write_json<SSL, LoginResponse>(rsp, controller->login(txn, login, ctx.ip, ctx.user_agent));
-    txn.commit();
+    optional<LoginResponse> out;
+    shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await db->open_write_txn();
+      controller->register_account(txn, form, ctx.ip, ctx.user_agent);
+      out.emplace(controller->login(txn, login, ctx.ip, ctx.user_agent));
+      committed = txn.commit();
+    }
+    if (!co_await committed) throw ApiError("Failed to save changes", 500);
+    write_json<SSL, LoginResponse>(rsp, ctx, std::move(*out));
   });
   // TODO: /api/v3/user/get_captcha
   router.get("/api/v3/user/mentions", [db, controller](auto* rsp, auto* req, auto& ctx) {
@@ -315,7 +391,8 @@ void define_api_routes(
     auto auth = ctx.header_or_query_auth(q);
     if (!auth) throw ApiError("Auth required", 401);
     auto txn = db->open_read_txn();
-    write_json<SSL>(rsp,controller->get_person_mentions(txn, {
+    ctx.cache_by_etag();
+    write_json<SSL>(rsp, ctx, controller->get_person_mentions(txn, {
       .sort = parse_user_post_sort_type(q.optional_string("sort").value_or("")),
       .limit = (uint16_t)q.optional_uint("limit").value_or(0),
       .page = (uint16_t)q.optional_uint("page").value_or(1),
@@ -330,7 +407,8 @@ void define_api_routes(
     auto auth = ctx.header_or_query_auth(q);
     if (!auth) throw ApiError("Auth required", 401);
     auto txn = db->open_read_txn();
-    write_json<SSL>(rsp, controller->get_replies(txn, {
+    ctx.cache_by_etag();
+    write_json<SSL>(rsp, ctx, controller->get_replies(txn, {
       .sort = parse_user_post_sort_type(q.optional_string("sort").value_or("")),
       .limit = (uint16_t)q.optional_uint("limit").value_or(0),
       .page = (uint16_t)q.optional_uint("page").value_or(1),
@@ -345,21 +423,33 @@ void define_api_routes(
   });
   router.template post_json<DeleteAccount>("/api/v3/user/delete_account", parser, [db, controller](auto* rsp, auto ctx, auto body) -> Coro {
     auto form = co_await body;
-    auto txn = co_await db->open_write_txn();
-    controller->delete_account(txn, form, std::move((co_await ctx).auth));
-    txn.commit();
+    shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await db->open_write_txn();
+      controller->delete_account(txn, form, std::move((co_await ctx).auth));
+      committed = txn.commit();
+    }
+    if (!co_await committed) throw ApiError("Failed to save changes", 500);
     write_no_content(rsp);
   }).template post_json<PasswordReset>("/api/v3/user/password_reset", parser, [db, controller](auto* rsp, auto, auto body) -> Coro {
     auto form = co_await body;
-    auto txn = co_await db->open_write_txn();
-    controller->password_reset(txn, form);
-    txn.commit();
+    shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await db->open_write_txn();
+      controller->password_reset(txn, form);
+      committed = txn.commit();
+    }
+    if (!co_await committed) throw ApiError("Failed to save changes", 500);
     write_no_content(rsp);
   }).template post_json<PasswordChangeAfterReset>("/api/v3/user/password_change", parser, [db, controller](auto* rsp, auto, auto body) -> Coro {
     auto form = co_await body;
-    auto txn = co_await db->open_write_txn();
-    controller->password_change_after_reset(txn, form);
-    txn.commit();
+    shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await db->open_write_txn();
+      controller->password_change_after_reset(txn, form);
+      committed = txn.commit();
+    }
+    if (!co_await committed) throw ApiError("Failed to save changes", 500);
     write_no_content(rsp);
   });
   JSON_ROUTE("/api/v3/user/mention/mark_all_as_read", MarkAllAsRead, GetRepliesResponse).post([controller](auto& form, auto& ctx, auto&& txn) {
@@ -381,9 +471,13 @@ void define_api_routes(
   });
   router.template post_json<VerifyEmail>("/api/v3/user/verify_email", parser, [db, controller](auto* rsp, auto, auto body) -> Coro {
     auto form = co_await body;
-    auto txn = co_await db->open_write_txn();
-    controller->verify_email(txn, form);
-    txn.commit();
+    shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await db->open_write_txn();
+      controller->verify_email(txn, form);
+      committed = txn.commit();
+    }
+    if (!co_await committed) throw ApiError("Failed to save changes", 500);
     write_no_content(rsp);
   });
   // TODO: /api/v3/user/leave_admin
@@ -399,9 +493,13 @@ void define_api_routes(
   }).post("/api/v3/user/logout", [db, controller](auto* rsp, auto _ctx, auto body) -> Coro {
     auto& ctx = co_await _ctx;
     co_await body;
-    auto txn = co_await db->open_write_txn();
-    if (ctx.auth) controller->logout(txn, std::move(*ctx.auth));
-    txn.commit();
+    shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await db->open_write_txn();
+      if (ctx.auth) controller->logout(txn, std::move(*ctx.auth));
+      committed = txn.commit();
+    }
+    if (!co_await committed) throw ApiError("Failed to save changes", 500);
     write_no_content(rsp);
   });
 
@@ -1,8 +1,11 @@
 #pragma once
 #include "db/db.h++"
+#include "util/compression.h++"
 #include "util/json.h++"
+#include "util/metrics.h++"
 #include <parallel_hashmap/btree.h>
 #include <uWebSockets/App.h>
+#include <xxhash.h>
 #include <atomic>
 #include <concepts>
 #include <coroutine>
@@ -78,6 +81,46 @@ static inline auto get_query_param(uWS::HttpRequest* req, std::string_view key)
   return req->getQuery(key);
 }
 
+// Weak ETag for a dynamic response. Records have no version numbers, so
+// responses are versioned by a hash of their own body, which changes exactly
+// when one of the records they show does; `variant` is a hash of everything
+// else the response depends on, such as who is logged in.
+static inline auto weak_etag(std::string_view body, uint64_t variant) -> std::string {
+  return fmt::format(R"(W/"{:x}-{:x}")", XXH3_64bits(body.data(), body.size()), variant);
+}
+
+// Weak comparison (RFC 9110 8.8.3.2) of an If-None-Match header against an ETag
+static inline auto etag_matches(std::string_view if_none_match, std::string_view etag) -> bool {
+  if (if_none_match.empty()) return false;
+  if (etag.starts_with("W/")) etag.remove_prefix(2);
+  while (!if_none_match.empty()) {
+    const auto comma = if_none_match.find(',');
+    auto tag = if_none_match.substr(0, comma);
+    if_none_match = comma == std::string_view::npos ? "" : if_none_match.substr(comma + 1);
+    while (tag.starts_with(' ')) tag.remove_prefix(1);
+    while (tag.ends_with(' ')) tag.remove_suffix(1);
+    if (tag == "*") return true;
+    if (tag.starts_with("W/")) tag.remove_prefix(2);
+    if (tag == etag) return true;
+  }
+  return false;
+}
+
+// Ends a response with `body`, compressed with `encoding` if that's worthwhile
+template <bool SSL>
+static inline auto end_with_encoding(
+  uWS::HttpResponse<SSL>* rsp,
+  ContentEncoding encoding,
+  std::string_view body
+) -> void {
+  rsp->writeHeader("Vary", "Accept-Encoding");
+  if (const auto compressed = compress_response(encoding, body)) {
+    rsp->writeHeader("Content-Encoding", content_encoding_name(encoding))->end(*compressed);
+  } else {
+    rsp->end(body);
+  }
+}
+
 template <typename T>
 struct QueryString {
   T query;
@@ -151,6 +194,27 @@ static inline auto hex_id_param(uWS::HttpRequest* req, uint16_t param) {
   return id;
 }
 
+// Latency and response size histograms for one route, labeled by method and
+// route pattern (not URL, which would make a new series for every ID)
+struct RouteMetrics {
+  Metrics::Histogram& latency;
+  Metrics::Histogram& size;
+
+  RouteMetrics(std::string_view method, std::string_view pattern) :
+    latency(Metrics::histogram(
+      "ludwig_http_request_duration_seconds",
+      "Time from receiving an HTTP request to finishing its response",
+      Metrics::Unit::Seconds,
+      {{"method", method}, {"route", pattern}}
+    )),
+    size(Metrics::histogram(
+      "ludwig_http_response_size_bytes",
+      "Size of HTTP response bodies, after compression",
+      Metrics::Unit::Bytes,
+      {{"method", method}, {"route", pattern}}
+    )) {}
+};
+
 template <bool SSL, typename AppContext = std::monostate>
 class RequestContext;
 
@@ -182,12 +246,23 @@ private:
   std::atomic<bool> done = false;
   Cancelable* current_awaiter = nullptr;
   std::string method_s, url_s, user_agent_s;
+  const RouteMetrics* route_metrics = nullptr;
+  Metrics::Stopwatch stopwatch;
+
+  auto record_metrics() noexcept -> void {
+    if constexpr (Metrics::enabled) {
+      if (!route_metrics) return;
+      route_metrics->latency.observe(stopwatch);
+      route_metrics->size.observe(rsp->getWriteOffset());
+    }
+  }
 public:
   std::string_view method, url, user_agent;
 
-  auto setup_sync(uWS::HttpResponse<SSL>* _rsp, uWS::HttpRequest* _req, AppContext ac) -> bool {
+  auto setup_sync(uWS::HttpResponse<SSL>* _rsp, uWS::HttpRequest* _req, AppContext ac, const RouteMetrics* metrics = nullptr) -> bool {
     rsp = _rsp;
     req = _req;
+    route_metrics = metrics;
     pre_try(rsp, req);
     method = req->getMethod();
     url = req->getUrl();
@@ -200,10 +275,11 @@ public:
       return false;
     }
   }
-  auto setup_async(uWS::HttpResponse<SSL>* _rsp, uWS::HttpRequest* _req, AppContext ac) -> bool {
+  auto setup_async(uWS::HttpResponse<SSL>* _rsp, uWS::HttpRequest* _req, AppContext ac, const RouteMetrics* metrics = nullptr) -> bool {
     loop = uWS::Loop::get();
     rsp = _rsp;
     req = _req;
+    route_metrics = metrics;
     pre_try(rsp, req);
     method = method_s = req->getMethod();
     url = url_s = req->getUrl();
@@ -228,6 +304,11 @@ public:
   }
   virtual auto pre_try(const uWS::HttpResponse<SSL>* rsp, uWS::HttpRequest* req) noexcept -> void {}
   virtual auto pre_request(uWS::HttpResponse<SSL>* rsp, uWS::HttpRequest* req, AppContext ac) -> void {}
+  // Sends a response body that the route prepared but did not send itself.
+  // The router calls this after the route returns, once its transactions are
+  // closed, so that compressing the body never holds a read transaction open
+  // or the write lock.
+  virtual auto flush() -> void {}
   virtual ~RequestContext() {}
 
   auto handle_error(const ApiError& e) noexcept -> bool {
@@ -248,6 +329,7 @@ public:
       spdlog::critical("Route {} threw exception in error page callback; response has been truncated. This is a bug.", url);
       rsp->end();
     }
+    record_metrics();
     return true;
   }
 
@@ -267,6 +349,7 @@ public:
 
   auto log() -> void {
     spdlog::debug("[{} {}] - {} {}", method, url, rsp->getRemoteAddressAsText(), user_agent);
+    record_metrics();
   }
 
   auto on_response_thread(uWS::MoveOnlyFunction<void (uWS::HttpResponse<SSL>*)>&& fn) {
@@ -370,9 +453,11 @@ struct RouterPromise {
   auto unhandled_exception() noexcept {
     ctx.handle_error(std::current_exception());
   }
+  bool returned = false;
+
   void return_void() noexcept {
     if (!ctx.done.exchange(true, std::memory_order_acq_rel)) {
-      ctx.log();
+      returned = true;
     } else {
       spdlog::debug("Reached end of coroutine on already completed request");
     }
@@ -381,6 +466,16 @@ struct RouterPromise {
   std::suspend_always initial_suspend() noexcept { return {}; }
   std::suspend_never final_suspend() noexcept {
     if (ctx.current_awaiter) ctx.current_awaiter->cancel();
+    // The coroutine's locals, including any transactions, are gone by now
+    if (returned) {
+      try {
+        ctx.flush();
+      } catch (...) {
+        spdlog::critical("Route {} threw exception while sending its response; response has been truncated. This is a bug.", ctx.url);
+        ctx.rsp->end();
+      }
+      ctx.log();
+    }
     return {};
   }
 
@@ -616,11 +711,12 @@ public:
 
   template <GetHandler<SSL, Ctx> Fn>
   auto get(std::string pattern, Fn&& handler) -> Self {
-    app.get(pattern, [handler = std::move(handler), ac = ac](uWS::HttpResponse<SSL>* rsp, Req req) mutable {
+    app.get(pattern, [handler = std::move(handler), ac = ac, metrics = RouteMetrics("GET", pattern)](uWS::HttpResponse<SSL>* rsp, Req req) mutable {
       Ctx ctx;
-      if (!ctx.setup_sync(rsp, req, ac)) return;
+      if (!ctx.setup_sync(rsp, req, ac, &metrics)) return;
       try {
         handler(rsp, req, ctx);
+        ctx.flush();
         ctx.log();
       } catch (...) {
         ctx.handle_error(std::current_exception());
@@ -632,10 +728,10 @@ public:
 
   template <GetAsyncHandler<SSL, Ctx> Fn>
   auto get_async(std::string pattern, Fn&& handler) -> Self {
-    app.get(pattern, [handler = std::move(handler), ac = ac](uWS::HttpResponse<SSL>* rsp, Req req) mutable {
+    app.get(pattern, [handler = std::move(handler), ac = ac, metrics = RouteMetrics("GET", pattern)](uWS::HttpResponse<SSL>* rsp, Req req) mutable {
       Coro coro = handler(rsp, ContextAwaiter<Ctx>());
       Ctx& ctx = coro.handle.promise().ctx;
-      if (ctx.setup_async(rsp, req, ac)) coro.handle();
+      if (ctx.setup_async(rsp, req, ac, &metrics)) coro.handle();
       else coro.handle.destroy();
     });
     register_route(pattern, "GET");
@@ -644,6 +740,7 @@ public:
 
   template <typename Body, PostHandler<SSL, Ctx, Body> Fn, typename... Args>
   auto post_handler(
+    RouteMetrics metrics,
     Fn handler,
     size_t max_size,
     std::optional<std::string_view> expected_content_type = {},
@@ -660,21 +757,21 @@ public:
           return;
         }
       }
-      if (ctx.setup_async(rsp, req, ac)) coro.handle();
+      if (ctx.setup_async(rsp, req, ac, &metrics)) coro.handle();
       else coro.handle.destroy();
     };
   }
 
   template <PostHandler<SSL, Ctx, StringBody<Ctx>> Fn>
   auto post(std::string pattern, Fn handler, size_t max_size = 10 * MiB, std::optional<std::string_view> expected_content_type = {}) -> Self {
-    app.post(pattern, post_handler<StringBody<Ctx>>(std::move(handler), max_size, expected_content_type));
+    app.post(pattern, post_handler<StringBody<Ctx>>(RouteMetrics("POST", pattern), std::move(handler), max_size, expected_content_type));
     register_route(pattern, "POST");
     return std::move(*this);
   }
 
   template <PostHandler<SSL, Ctx, FormBody<Ctx>> Fn>
   auto post_form(std::string pattern, Fn handler, size_t max_size = 10 * MiB) -> Self {
-    app.post(pattern, post_handler<FormBody<Ctx>>(std::move(handler), max_size, TYPE_FORM));
+    app.post(pattern, post_handler<FormBody<Ctx>>(RouteMetrics("POST", pattern), std::move(handler), max_size, TYPE_FORM));
     register_route(pattern, "POST");
     return std::move(*this);
   }
@@ -687,21 +784,21 @@ public:
     size_t max_size = 10 * MiB,
     std::optional<std::string_view> expected_content_type = "application/json"
   ) -> Self {
-    app.post(pattern, post_handler<JsonBody<T, Ctx>>(std::move(handler), max_size, expected_content_type, parser));
+    app.post(pattern, post_handler<JsonBody<T, Ctx>>(RouteMetrics("POST", pattern), std::move(handler), max_size, expected_content_type, parser));
     register_route(pattern, "POST");
     return std::move(*this);
   }
 
   template <PostHandler<SSL, Ctx, StringBody<Ctx>> Fn>
   auto put(std::string pattern, Fn handler, size_t max_size = 10 * MiB, std::optional<std::string_view> expected_content_type = {}) -> Self {
-    app.put(pattern, post_handler<StringBody<Ctx>>(std::move(handler), max_size, expected_content_type));
+    app.put(pattern, post_handler<StringBody<Ctx>>(RouteMetrics("PUT", pattern), std::move(handler), max_size, expected_content_type));
     register_route(pattern, "PUT");
     return std::move(*this);
   }
 
   template <PostHandler<SSL, Ctx, FormBody<Ctx>> Fn>
   auto put_form(std::string pattern, Fn handler, size_t max_size = 10 * MiB) -> Self {
-    app.put(pattern, post_handler<FormBody<Ctx>>(std::move(handler), max_size, TYPE_FORM));
+    app.put(pattern, post_handler<FormBody<Ctx>>(RouteMetrics("PUT", pattern), std::move(handler), max_size, TYPE_FORM));
     register_route(pattern, "PUT");
     return std::move(*this);
   }
@@ -714,18 +811,19 @@ public:
     size_t max_size = 10 * MiB,
     std::optional<std::string_view> expected_content_type = "application/json"
   ) -> Self {
-    app.put(pattern, post_handler<JsonBody<T, Ctx>>(std::move(handler), max_size, expected_content_type, parser));
+    app.put(pattern, post_handler<JsonBody<T, Ctx>>(RouteMetrics("PUT", pattern), std::move(handler), max_size, expected_content_type, parser));
     register_route(pattern, "PUT");
     return std::move(*this);
   }
 
   template <GetHandler<SSL, Ctx> Fn>
   auto any(std::string pattern, Fn&& handler) -> Self {
-    app.any(pattern, [handler = std::move(handler), ac = ac](uWS::HttpResponse<SSL>* rsp, Req req) mutable {
+    app.any(pattern, [handler = std::move(handler), ac = ac, metrics = RouteMetrics("*", pattern)](uWS::HttpResponse<SSL>* rsp, Req req) mutable {
       Ctx ctx;
-      if (!ctx.setup_sync(rsp, req, ac)) return;
+      if (!ctx.setup_sync(rsp, req, ac, &metrics)) return;
       try {
         handler(rsp, req, ctx);
+        ctx.flush();
         ctx.log();
       } catch (...) {
         ctx.handle_error(std::current_exception());
@@ -749,4 +847,21 @@ static inline auto board_name_param(ReadTxn& txn, uWS::HttpRequest* req, uint16_
   return *board_id;
 }
 
+// Serves every registered metric (see util/metrics.h++) in Prometheus text
+// format. Metrics can reveal traffic and database details, so main() only
+// defines this on its loopback-only --metrics-port listener, never on the
+// public app. The route is not defined at all if metrics are disabled at
+// compile time.
+template <bool SSL>
+static inline auto define_metrics_route(uWS::TemplatedApp<SSL>& app) -> void {
+  if constexpr (Metrics::enabled) {
+    Router(app, {})
+      .get("/metrics", [](auto* rsp, auto*, auto&) {
+        rsp->writeHeader("Content-Type", "text/plain; version=0.0.4; charset=utf-8")
+          ->writeHeader("Cache-Control", "no-store")
+          ->end(Metrics::to_prometheus());
+      });
+  }
+}
+
 }
\ No newline at end of file
@@ -57,11 +57,12 @@ void define_admin_routes(
     require_admin(c);
     auto form = co_await body;
     try {
-      c.app->site_controller->update_site(
+      const auto committed = c.app->site_controller->update_site(
         co_await c.app->db->open_write_txn(),
         form_to_site_update(form),
         c.logged_in_user_id
       );
+      if (!co_await committed) die(500, "Failed to save changes");
       write_redirect_back(rsp, "/site_admin");
     } catch (const ApiError& e) {
       rsp->writeStatus(http_status(e.http_status));
@@ -77,13 +78,14 @@ void define_admin_routes(
     require_admin(c);
     auto form = co_await body;
     try {
-      first_run->first_run_setup(co_await c.app->db->open_write_txn(), {
+      const auto committed = first_run->first_run_setup(co_await c.app->db->open_write_txn(), {
         form_to_site_update(form),
         form.optional_string("base_url"),
         form.optional_string("default_board_name"),
         form.optional_string("admin_username"),
         form.optional_string("admin_password").transform(λx(SecretString(x)))
       }, *c.logged_in_user_id);
+      if (!co_await committed) die(500, "Failed to save changes");
       write_redirect_back(rsp, "/");
     } catch (const ApiError& e) {
       auto txn = c.app->db->open_read_txn();
@@ -112,8 +114,7 @@ void define_admin_routes(
       spdlog::info("Beginning database dump");
       std::binary_semaphore lock(0);
       try {
-        auto txn = c.app->db->open_read_txn();
-        for (auto chunk : dump->export_dump(txn)) {
+        for (auto chunk : dump->export_dump(*c.app->db)) {
           if (done->is_canceled()) return;
           c.on_response_thread([&](auto* rsp) {
             if (!done->is_canceled()) {
@@ -144,27 +145,36 @@ void define_admin_routes(
     });
     auto& c = co_await _c;
     require_admin(c);
-    auto txn = co_await c.app->db->open_write_txn();
-    try {
-      if (is_approve) {
-        c.app->session_controller->approve_local_user_application(txn, id, c.logged_in_user_id);
-      } else {
-        c.app->session_controller->reject_local_user_application(txn, id, c.logged_in_user_id);
+    std::shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await c.app->db->open_write_txn();
+      try {
+        if (is_approve) {
+          c.app->session_controller->approve_local_user_application(txn, id, c.logged_in_user_id);
+        } else {
+          c.app->session_controller->reject_local_user_application(txn, id, c.logged_in_user_id);
+        }
+        committed = txn.commit();
+      } catch (const ApiError& e) {
+        rsp->writeStatus(http_status(e.http_status));
+        ADMIN_PAGE("/site_admin/applications", Applications, html_site_admin_applications_list(c, *c.app->session_controller, txn, c.login, {}, e.message))
+        co_return;
       }
-      txn.commit();
-      write_redirect_back(rsp, "/site_admin/applications");
-    } catch (const ApiError& e) {
-      rsp->writeStatus(http_status(e.http_status));
-      ADMIN_PAGE("/site_admin/applications", Applications, html_site_admin_applications_list(c, *c.app->session_controller, txn, c.login, {}, e.message))
     }
+    if (!co_await committed) die(500, "Failed to save changes");
+    write_redirect_back(rsp, "/site_admin/applications");
   });
 
   r.post("/site_admin/invites/new", [](auto* rsp, auto _c, auto) -> Coro {
     auto& c = co_await _c;
     require_admin(c);
-    auto txn = co_await c.app->db->open_write_txn();
-    c.app->session_controller->create_site_invite(txn, c.logged_in_user_id);
-    txn.commit();
+    std::shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await c.app->db->open_write_txn();
+      c.app->session_controller->create_site_invite(txn, c.logged_in_user_id);
+      committed = txn.commit();
+    }
+    if (!co_await committed) die(500, "Failed to save changes");
     write_redirect_back(rsp, "/site_admin/invites");
   });
 }
@@ -39,6 +39,7 @@ void define_board_routes(
   r.get("/boards", [boards](auto* rsp, auto* req, auto& c) {
     auto txn = c.app->db->open_read_txn();
     c.populate(txn);
+    c.cache_by_etag();
     const auto local = req->getQuery("local") == "1";
     const auto sort = parse_board_sort_type(req->getQuery("sort"));
     const auto sub = req->getQuery("sub") == "1";
@@ -47,7 +48,6 @@ void define_board_routes(
       EnumNameBoardSortType(sort),
       sub ? "1" : "0"
     );
-    rsp->writeHeader("Content-Type", TYPE_HTML);
     html_site_header(c, {
       .canonical_path = "/boards",
       .banner_link = "/boards",
@@ -86,18 +86,22 @@ void define_board_routes(
     auto user = c.require_login();
     auto form = co_await body;
     const auto name = form.required_string("name");
-    auto txn = co_await c.app->db->open_write_txn();
-    boards->create_local_board(
-      txn,
-      user,
-      name,
-      form.optional_string("display_name"),
-      form.optional_string("content_warning"),
-      form.optional_bool("private"),
-      form.optional_bool("restricted_posting"),
-      form.optional_bool("local_only")
-    );
-    txn.commit();
+    std::shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await c.app->db->open_write_txn();
+      boards->create_local_board(
+        txn,
+        user,
+        name,
+        form.optional_string("display_name"),
+        form.optional_string("content_warning"),
+        form.optional_bool("private"),
+        form.optional_bool("restricted_posting"),
+        form.optional_bool("local_only")
+      );
+      committed = txn.commit();
+    }
+    if (!co_await committed) die(500, "Failed to save changes");
     rsp->writeStatus(http_status(303));
     c.write_cookie();
     rsp->writeHeader("Location", format("/b/{}"_cf, name))->end();
@@ -140,9 +144,13 @@ void define_board_routes(
     });
     auto user = c.require_login();
     auto form = co_await body;
-    auto txn = co_await c.app->db->open_write_txn();
-    boards->subscribe(txn, user, board_id, !form.optional_bool("unsubscribe"));
-    txn.commit();
+    std::shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await c.app->db->open_write_txn();
+      boards->subscribe(txn, user, board_id, !form.optional_bool("unsubscribe"));
+      committed = txn.commit();
+    }
+    if (!co_await committed) die(500, "Failed to save changes");
     if (c.is_htmx) {
       rsp->writeHeader("Content-Type", TYPE_HTML);
       html_subscribe_button(c, name, !form.optional_bool("unsubscribe"));
@@ -24,6 +24,7 @@ void define_feed_routes(
   auto feed_route = [posts](uint64_t feed_id, uWS::HttpResponse<SSL>* rsp, uWS::HttpRequest* req, Context<SSL>& c) -> void {
     auto txn = c.app->db->open_read_txn();
     c.populate(txn);
+    c.cache_by_etag();
     const auto sort = parse_sort_type(req->getQuery("sort"), c.login);
     const auto show_threads = req->getQuery("type") != "comments",
       show_images = req->getQuery("images") == "1" || (req->getQuery("sort").empty() ? !c.login || c.login->local_user().show_images_threads() : false);
@@ -33,7 +34,6 @@ void define_feed_routes(
     ) {
       feed_id = PostController::FEED_LOCAL;
     }
-    rsp->writeHeader("Content-Type", TYPE_HTML);
     std::string title = [&]{
       using std::operator""s;
       switch (feed_id) {
@@ -127,6 +127,7 @@ void define_feed_routes(
   r.get("/b/:name", [boards, posts](auto* rsp, auto* req, auto& c) {
     auto txn = c.app->db->open_read_txn();
     c.populate(txn);
+    c.cache_by_etag();
     const auto board_id = board_name_param(txn, req, 0);
     const auto board = boards->board_detail(txn, board_id, c.login);
     const auto sort = parse_sort_type(req->getQuery("sort"), c.login);
@@ -138,7 +139,6 @@ void define_feed_routes(
       EnumNameSortType(sort),
       show_images ? 1 : 0
     );
-    rsp->writeHeader("Content-Type", TYPE_HTML);
     html_site_header(c, board_header_options(req, board.board()));
     if (!c.is_htmx) {
       c.write("<div>");
@@ -177,6 +177,7 @@ void define_feed_routes(
   r.get("/u/:name", [users, posts](auto* rsp, auto* req, auto& c) {
     auto txn = c.app->db->open_read_txn();
     c.populate(txn);
+    c.cache_by_etag();
     const auto user_id = user_name_param(txn, req, 0);
     const auto user = users->user_detail(txn, user_id, c.login);
     const auto sort = parse_user_post_sort_type(req->getQuery("sort"));
@@ -188,7 +189,6 @@ void define_feed_routes(
       EnumNameUserPostSortType(sort),
       show_images ? 1 : 0
     );
-    rsp->writeHeader("Content-Type", TYPE_HTML);
     html_site_header(c, {
       .canonical_path = c.url,
       .banner_link = c.url,
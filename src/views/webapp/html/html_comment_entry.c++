@@ -45,7 +45,9 @@ void html_comment_body(
   bool show_images
 ) noexcept {
   const bool has_warnings = comment.content_warning(context) || comment.mod_state(context).state > ModState::Normal;
-  const auto content = rich_text_to_html(
+  const auto content = post_content_to_html(
+    r,
+    comment.id,
     comment.comment().content_type(),
     comment.comment().content(),
     { .show_images = show_images, .open_links_in_new_tab = login && login->local_user().open_links_in_new_tab() }
@@ -57,9 +59,9 @@ void html_comment_body(
   if (has_warnings) {
     r.write(R"(<details class="content-warning-collapse"><summary>Content hidden (click to show))");
     html_content_warnings(r, comment, context);
-    r.write_fmt(R"(</summary><div>{}</div></details></div>)"_cf, content);
+    r.write_fmt(R"(</summary><div>{}</div></details></div>)"_cf, *content);
   } else {
-    r.write_fmt(R"({}</div>)"_cf, content);
+    r.write_fmt(R"({}</div>)"_cf, *content);
   }
   html_vote_buttons(r, comment, site, login);
   r.write(R"(<div class="controls">)");
@@ -94,7 +94,9 @@ void html_thread_view(
   );
   html_thread_entry(r, thread, site, login, PostContext::View, show_images);
   if (thread.has_text_content()) {
-    const auto content = rich_text_to_html(
+    const auto content = post_content_to_html(
+      r,
+      thread.id,
       thread.thread().content_text_type(),
       thread.thread().content_text(),
       { .show_images = show_images, .open_links_in_new_tab = login && login->local_user().open_links_in_new_tab() }
@@ -102,9 +104,9 @@ void html_thread_view(
     if (thread.thread().content_warning() || thread.board().content_warning() || thread.thread().mod_state() > ModState::Normal) {
       r.write(R"(<div class="thread-content markdown"><details class="content-warning-collapse"><summary>Content hidden (click to show))");
       html_content_warnings(r, thread, PostContext::View);
-      r.write_fmt(R"(</summary><div>{}</div></details></div>)"_cf, content);
+      r.write_fmt(R"(</summary><div>{}</div></details></div>)"_cf, *content);
     } else {
-      r.write_fmt(R"(<div class="thread-content markdown">{}</div>)"_cf, content);
+      r.write_fmt(R"(<div class="thread-content markdown">{}</div>)"_cf, *content);
     }
   }
   r.write_fmt(R"(<section class="comments" id="comments"><h2>{:d} comments</h2>)"_cf, thread.stats().descendant_count());
@@ -3,6 +3,8 @@
 
 namespace Ludwig {
 
+class RichTextCache;
+
 class ResponseWriter {
 protected:
   std::string buf;
@@ -15,6 +17,9 @@ public:
     fmt::format_to(inserter, fmt, std::forward<Args>(args)...);
   }
   virtual auto finish_write() -> void = 0;
+  virtual auto rich_text_cache() const noexcept -> RichTextCache* { return nullptr; }
+  // RichTextCache::generation, read before any transaction this response renders from
+  virtual auto rich_text_generation() const noexcept -> uint64_t { return 0; }
 };
 
 static constexpr std::string_view ESCAPED = "<>'\"&";
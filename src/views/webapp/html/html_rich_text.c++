@@ -1,7 +1,8 @@
 #include "html_rich_text.h++"
 #include "util/rich_text.h++"
+#include "services/rich_text_cache.h++"
 
-using std::back_inserter, std::min, std::string, flatbuffers::Offset, flatbuffers::Vector, fmt::format_to,
+using std::back_inserter, std::make_shared, std::min, std::shared_ptr, std::string, flatbuffers::Offset, flatbuffers::Vector, fmt::format_to,
   fmt::operator""_cf; // NOLINT
 
 namespace Ludwig {
@@ -65,6 +66,21 @@ auto rich_text_to_html(
   return out;
 }
 
+auto post_content_to_html(
+  const ResponseWriter& r,
+  uint64_t post_id,
+  const Vector<RichText>* types,
+  const Vector<Offset<void>>* values,
+  const ToHtmlOptions& opts
+) noexcept -> shared_ptr<const string> {
+  auto* cache = r.rich_text_cache();
+  if (!cache) return make_shared<const string>(rich_text_to_html(types, values, opts));
+  const uint8_t variant = (opts.show_images ? 1 : 0) |
+    (opts.open_links_in_new_tab ? 2 : 0) |
+    (opts.links_nofollow ? 4 : 0);
+  return cache->get(post_id, variant, r.rich_text_generation(), [&] { return rich_text_to_html(types, values, opts); });
+}
+
 auto rich_text_to_html_emojis_only(
   const Vector<RichText>* types,
   const Vector<Offset<void>>* values,
@@ -1,5 +1,6 @@
 #pragma once
 #include "fbs/records.h++"
+#include "html_common.h++"
 
 namespace Ludwig {
 
@@ -16,6 +17,16 @@ auto rich_text_to_html(
   const ToHtmlOptions& opts = {}
 ) noexcept -> std::string;
 
+// Like rich_text_to_html, but uses the response's RichTextCache, if it has one.
+// The cache key does not include opts.lookup_emoji, so it must be the default.
+auto post_content_to_html(
+  const ResponseWriter& r,
+  uint64_t post_id,
+  const flatbuffers::Vector<RichText>* types,
+  const flatbuffers::Vector<flatbuffers::Offset<void>>* values,
+  const ToHtmlOptions& opts = {}
+) noexcept -> std::shared_ptr<const std::string>;
+
 auto rich_text_to_html_emojis_only(
   const flatbuffers::Vector<RichText>* types,
   const flatbuffers::Vector<flatbuffers::Offset<void>>* values,
@@ -31,28 +31,34 @@ namespace Internal {
       const auto post_id = co_await _c.with_request([](auto* req){ return hex_id_param(req, 0); });
       auto user = c.require_login();
       auto form = co_await body;
-      auto txn = co_await c.app->db->open_write_txn();
-      const auto id = posts->create_local_comment(
-        txn,
-        user,
-        post_id,
-        form.required_string("text_content"),
-        form.optional_string("content_warning")
-      );
+      std::shared_ptr<CompletableOnce<bool>> committed;
+      {
+        auto txn = co_await c.app->db->open_write_txn();
+        const auto id = posts->create_local_comment(
+          txn,
+          user,
+          post_id,
+          form.required_string("text_content"),
+          form.optional_string("content_warning")
+        );
+        if (c.is_htmx) {
+          CommentTree tree;
+          tree.emplace(post_id, CommentDetail::get(txn, id, c.login));
+          html_comment_tree(c, tree, post_id, CommentSortType::New, c.site, c.login, true, true, false);
+          html_toast(c, "Reply submitted");
+        }
+        committed = txn.commit();
+      }
+      if (!co_await committed) die(500, "Failed to save changes");
       if (c.is_htmx) {
-        CommentTree tree;
-        tree.emplace(post_id, CommentDetail::get(txn, id, c.login));
         rsp->writeHeader("Content-Type", TYPE_HTML);
         c.write_cookie();
-        html_comment_tree(c, tree, post_id, CommentSortType::New, c.site, c.login, true, true, false);
-        html_toast(c, "Reply submitted");
         c.finish_write();
       } else {
         rsp->writeStatus(http_status(303));
         c.write_cookie();
         rsp->writeHeader("Location", format("/{}s/{:x}"_cf, Detail::noun, post_id))->end();
       }
-      txn.commit();
     });
 
     r.post_form(fmt::format("/{}/:id/action", Detail::noun), [users](auto* rsp, auto _c, auto body) -> Coro {
@@ -62,23 +68,30 @@ namespace Internal {
       });
       auto user = c.require_login();
       auto form = co_await body;
-      auto txn = co_await c.app->db->open_write_txn();
-      const auto action = static_cast<SubmenuAction>(form.required_int("action"));
-      const auto redirect = action_menu_action<Detail>(txn, users, action, user, id);
+      std::optional<std::string> redirect;
+      std::shared_ptr<CompletableOnce<bool>> committed;
+      {
+        auto txn = co_await c.app->db->open_write_txn();
+        const auto action = static_cast<SubmenuAction>(form.required_int("action"));
+        redirect = action_menu_action<Detail>(txn, users, action, user, id);
+        if (!redirect && c.is_htmx) {
+          const auto context = static_cast<PostContext>(form.required_int("context"));
+          c.populate(txn);
+          const auto detail = Detail::get(txn, id, c.login);
+          html_action_menu(c, detail, c.login, context);
+        }
+        committed = txn.commit();
+      }
+      if (!co_await committed) die(500, "Failed to save changes");
       if (redirect) {
         write_redirect_to(rsp, c, *redirect);
       } else if (c.is_htmx) {
-        const auto context = static_cast<PostContext>(form.required_int("context"));
-        c.populate(txn);
-        const auto detail = Detail::get(txn, id, c.login);
         rsp->writeHeader("Content-Type", TYPE_HTML);
         c.write_cookie();
-        html_action_menu(c, detail, c.login, context);
         c.finish_write();
       } else {
         write_redirect_back(rsp, referer);
       }
-      txn.commit();
     });
 
     r.post_form(fmt::format("/{}/:id/vote", Detail::noun), [posts](auto* rsp, auto _c, auto body) -> Coro {
@@ -88,19 +101,25 @@ namespace Internal {
       });
       auto user = c.require_login();
       auto form = co_await body;
-      auto txn = co_await c.app->db->open_write_txn();
-      const auto vote = form.required_vote("vote");
-      posts->vote(txn, user, post_id, vote);
+      std::shared_ptr<CompletableOnce<bool>> committed;
+      {
+        auto txn = co_await c.app->db->open_write_txn();
+        const auto vote = form.required_vote("vote");
+        posts->vote(txn, user, post_id, vote);
+        if (c.is_htmx) {
+          c.populate(txn);
+          const auto detail = Detail::get(txn, post_id, c.login);
+          html_vote_buttons(c, detail, c.site, c.login);
+        }
+        committed = txn.commit();
+      }
+      if (!co_await committed) die(500, "Failed to save changes");
       if (c.is_htmx) {
-        c.populate(txn);
-        const auto detail = Detail::get(txn, post_id, c.login);
         rsp->writeHeader("Content-Type", TYPE_HTML);
-        html_vote_buttons(c, detail, c.site, c.login);
         c.finish_write();
       } else {
         write_redirect_back(rsp, referer);
       }
-      txn.commit();
     });
   };
 }
@@ -121,13 +140,13 @@ void define_post_routes(
   r.get("/thread/:id", [posts, boards](auto* rsp, auto* req, auto& c) {
     auto txn = c.app->db->open_read_txn();
     c.populate(txn);
+    c.cache_by_etag();
     const auto id = hex_id_param(req, 0);
     const auto sort = parse_comment_sort_type(req->getQuery("sort"), c.login);
     const auto show_images = req->getQuery("images") == "1" ||
       (req->getQuery("sort").empty() ? !c.login || c.login->local_user().show_images_comments() : false);
     CommentTree comments;
     const auto detail = posts->thread_detail(txn, comments, id, sort, c.login, req->getQuery("from"));
-    rsp->writeHeader("Content-Type", TYPE_HTML);
     if (c.is_htmx) {
       c.write_cookie();
       html_comment_tree(c, comments, detail.id, sort, c.site, c.login, show_images, false, false);
@@ -146,13 +165,13 @@ void define_post_routes(
   r.get("/comment/:id", [posts, boards](auto* rsp, auto* req, auto& c) {
     auto txn = c.app->db->open_read_txn();
     c.populate(txn);
+    c.cache_by_etag();
     const auto id = hex_id_param(req, 0);
     const auto sort = parse_comment_sort_type(req->getQuery("sort"), c.login);
     const auto show_images = req->getQuery("images") == "1" ||
       (req->getQuery("sort").empty() ? !c.login || c.login->local_user().show_images_comments() : false);
     CommentTree comments;
     const auto detail = posts->comment_detail(txn, comments, id, sort, c.login, req->getQuery("from"));
-    rsp->writeHeader("Content-Type", TYPE_HTML);
     if (c.is_htmx) {
       c.write_cookie();
       html_comment_tree(c, comments, detail.id, sort, c.site, c.login, show_images, false, false);
@@ -195,17 +214,22 @@ void define_post_routes(
       return board_name_param(txn, req, 0);
     });
     auto form = co_await body;
-    auto txn = co_await c.app->db->open_write_txn();
-    const auto id = posts->create_local_thread(
-      txn,
-      user,
-      board_id,
-      form.required_string("title"),
-      form.optional_string("submission_url"),
-      form.optional_string("text_content"),
-      form.optional_string("content_warning")
-    );
-    txn.commit();
+    uint64_t id;
+    std::shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await c.app->db->open_write_txn();
+      id = posts->create_local_thread(
+        txn,
+        user,
+        board_id,
+        form.required_string("title"),
+        form.optional_string("submission_url"),
+        form.optional_string("text_content"),
+        form.optional_string("content_warning")
+      );
+      committed = txn.commit();
+    }
+    if (!co_await committed) die(500, "Failed to save changes");
     rsp->writeStatus(http_status(303));
     c.write_cookie();
     rsp->writeHeader("Location", format("/thread/{:x}"_cf, id))->end();
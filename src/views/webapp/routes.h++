@@ -27,12 +27,13 @@ void define_webapp_routes(
   std::shared_ptr<SearchController> search,
   std::shared_ptr<FirstRunController> first_run,
   std::shared_ptr<DumpController> dump,
-  std::shared_ptr<KeyedRateLimiter> rate_limiter = nullptr
+  std::shared_ptr<KeyedRateLimiter> rate_limiter = nullptr,
+  std::shared_ptr<RichTextCache> rich_text_cache = nullptr
 ) {
   define_static_routes(app);
 
   auto state = std::make_shared<WebappState>(
-    db, sessions, site, rate_limiter
+    db, sessions, site, rate_limiter, rich_text_cache
   );
   Router<SSL, Context<SSL>, std::shared_ptr<WebappState>> r(app, state);
   
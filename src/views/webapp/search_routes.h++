@@ -15,20 +15,33 @@ void define_search_routes(
   using Coro = RouterCoroutine<Context<SSL>>;
 
   r.get_async("/search", [search](auto* rsp, auto _c) -> Coro {
-    auto query = co_await _c.with_request([](auto* req) {
-      return SearchQuery{
-        .query = req->getQuery("search"),
-        /// TODO: Other parameters
-        .include_threads = true,
-        .include_comments = true
-      };
+    auto [query, type_param, sort] = co_await _c.with_request([](auto* req) {
+      return std::tuple(
+        std::string(req->getQuery("search")),
+        std::string(req->getQuery("type")),
+        std::string(req->getQuery("sort"))
+      );
     });
     auto& c = co_await _c;
     {
       auto txn = c.app->db->open_read_txn();
       c.populate(txn);
     }
-    auto results = co_await search->search(query, c.login);
+    // Same type and sort names as the Lemmy API; without a type, only posts are searched
+    using Lemmy::SearchType;
+    const auto type = type_param.empty() ? std::nullopt : std::optional(Lemmy::parse_search_type(type_param));
+    auto results = co_await search->search({
+      .query = query,
+      .include_users = type == SearchType::All || type == SearchType::Users,
+      .include_boards = type == SearchType::All || type == SearchType::Communities,
+      .include_threads = !type || type == SearchType::All || type == SearchType::Posts || type == SearchType::Url,
+      .include_comments = !type || type == SearchType::All || type == SearchType::Comments,
+      .include_cws = !c.login || !c.login->local_user().hide_cw_posts(),
+      .sort = sort == "New" ? SearchResultSort::New
+        : sort.starts_with("Top") ? SearchResultSort::Top
+        : SearchResultSort::Relevant,
+      .limit = 20
+    }, c.login);
     rsp->writeHeader("Content-Type", TYPE_HTML);
     html_site_header(c, {
       .canonical_path = "/search",
@@ -1,41 +1,95 @@
 #pragma once
 #include "webapp_common.h++"
 #include "static/default-theme.min.css.h++"
+#include "static/default-theme.min.css.gz.h++"
+#include "static/default-theme.min.css.zst.h++"
 #include "static/feather-sprite.svg.h++"
+#include "static/feather-sprite.svg.gz.h++"
+#include "static/feather-sprite.svg.zst.h++"
 #include "static/htmx.min.js.h++"
+#include "static/htmx.min.js.gz.h++"
+#include "static/htmx.min.js.zst.h++"
 #include "static/ludwig.js.h++"
+#include "static/ludwig.js.gz.h++"
+#include "static/ludwig.js.zst.h++"
 #include "static/twemoji-piano.ico.h++"
+#include "static/twemoji-piano.ico.gz.h++"
+#include "static/twemoji-piano.ico.zst.h++"
+#ifdef LUDWIG_BROTLI
+#include "static/default-theme.min.css.br.h++"
+#include "static/feather-sprite.svg.br.h++"
+#include "static/htmx.min.js.br.h++"
+#include "static/ludwig.js.br.h++"
+#include "static/twemoji-piano.ico.br.h++"
+#endif
 #include <xxhash.h>
 
 namespace Ludwig {
 
+// A static asset, and its precompressed variants (empty if unavailable)
+struct StaticAsset {
+  std::string_view identity, gzip, brotli, zstd;
+
+  auto encoded(ContentEncoding encoding) const -> std::string_view {
+    switch (encoding) {
+      case ContentEncoding::Gzip: return gzip;
+      case ContentEncoding::Brotli: return brotli;
+      case ContentEncoding::Zstd: return zstd;
+      default: return {};
+    }
+  }
+};
+
+#ifdef LUDWIG_BROTLI
+# define STATIC_ASSET(NAME) StaticAsset{NAME##_str(), NAME##_gz_str(), NAME##_br_str(), NAME##_zst_str()}
+#else
+# define STATIC_ASSET(NAME) StaticAsset{NAME##_str(), NAME##_gz_str(), {}, NAME##_zst_str()}
+#endif
+
 template <bool SSL>
 void serve_static(
   uWS::TemplatedApp<SSL>& app,
   std::string path,
   std::string_view mimetype,
-  std::string_view src
+  StaticAsset asset
 ) noexcept {
   using fmt::operator""_cf;
-  const auto hash = format("\"{:016x}\""_cf, XXH3_64bits(src.data(), src.length()));
-  app.get(path, [src, mimetype, hash](auto* res, auto* req) {
-    if (req->getHeader("if-none-match") == hash) {
-      res->writeStatus(http_status(304))->end();
+  const auto hash = format("{:016x}"_cf, XXH3_64bits(asset.identity.data(), asset.identity.length()));
+  app.get(path, [asset, mimetype, hash](auto* res, auto* req) {
+    auto encoding = negotiate_content_encoding(req->getHeader("accept-encoding"));
+    auto body = asset.encoded(encoding);
+    if (body.empty()) {
+      encoding = ContentEncoding::Identity;
+      body = asset.identity;
+    }
+    // Each encoding is a different representation, so it needs its own strong ETag
+    const auto etag = encoding == ContentEncoding::Identity
+      ? format("\"{}\""_cf, hash)
+      : format("\"{}-{}\""_cf, hash, content_encoding_name(encoding));
+    if (req->getHeader("if-none-match") == etag) {
+      res->writeStatus(http_status(304))
+        ->writeHeader("Etag", etag)
+        ->writeHeader("Vary", "Accept-Encoding")
+        ->end();
     } else {
       res->writeHeader("Content-Type", mimetype)
-        ->writeHeader("Etag", hash)
-        ->end(src);
+        ->writeHeader("Etag", etag)
+        ->writeHeader("Vary", "Accept-Encoding");
+      if (encoding != ContentEncoding::Identity) {
+        res->writeHeader("Content-Encoding", content_encoding_name(encoding));
+      }
+      res->end(body);
     }
   });
 }
 
 template <bool SSL>
 void define_static_routes(uWS::TemplatedApp<SSL>& app) {
-  serve_static(app, "/favicon.ico", "image/vnd.microsoft.icon", twemoji_piano_ico_str());
-  serve_static(app, "/static/default-theme.css", TYPE_CSS, default_theme_min_css_str());
-  serve_static(app, "/static/htmx.min.js", TYPE_JS, htmx_min_js_str());
-  serve_static(app, "/static/ludwig.js", TYPE_JS, ludwig_js_str());
-  serve_static(app, "/static/feather-sprite.svg", TYPE_SVG, feather_sprite_svg_str());
+  serve_static(app, "/favicon.ico", "image/vnd.microsoft.icon", STATIC_ASSET(twemoji_piano_ico));
+  serve_static(app, "/static/default-theme.css", TYPE_CSS, STATIC_ASSET(default_theme_min_css));
+  serve_static(app, "/static/htmx.min.js", TYPE_JS, STATIC_ASSET(htmx_min_js));
+  serve_static(app, "/static/ludwig.js", TYPE_JS, STATIC_ASSET(ludwig_js));
+  serve_static(app, "/static/feather-sprite.svg", TYPE_SVG, STATIC_ASSET(feather_sprite_svg));
 }
 
-}
\ No newline at end of file
+}
@@ -24,10 +24,10 @@ void define_user_routes(
   r.get("/users", [users](auto* rsp, auto* req, auto& c) {
     auto txn = c.app->db->open_read_txn();
     c.populate(txn);
+    c.cache_by_etag();
     const auto local = req->getQuery("local") == "1";
     const auto sort = parse_user_sort_type(req->getQuery("sort"));
     const auto base_url = format("/users?local={}&"_cf, local ? "1" : "0");
-    rsp->writeHeader("Content-Type", TYPE_HTML);
     html_site_header(c, {
       .canonical_path = "/users",
       .banner_link = "/users",
@@ -81,20 +81,25 @@ void define_user_routes(
     try {
       // Logins have low priority because anyone can initiate them.
       // This prevents login spam from DOS'ing other actions.
-      auto txn = co_await c.app->db->open_write_txn(WritePriority::Low);
-      auto login = c.app->session_controller->login(
-        txn,
-        form.required_string("actual_username"),
-        form.required_string("password"),
-        c.ip,
-        c.user_agent,
-        remember
-      );
-      txn.commit();
+      std::optional<LoginResponse> login;
+      std::shared_ptr<CompletableOnce<bool>> committed;
+      {
+        auto txn = co_await c.app->db->open_write_txn(WritePriority::Low);
+        login.emplace(c.app->session_controller->login(
+          txn,
+          form.required_string("actual_username"),
+          form.required_string("password"),
+          c.ip,
+          c.user_agent,
+          remember
+        ));
+        committed = txn.commit();
+      }
+      if (!co_await committed) die(500, "Failed to save changes");
       rsp->writeStatus(http_status(303))
         ->writeHeader("Set-Cookie",
           format(COOKIE_NAME "={:x}; path=/; expires={:%a, %d %b %Y %T %Z}"_cf,
-            login.session_id, fmt::gmtime(login.expiration)))
+            login->session_id, fmt::gmtime(login->expiration)))
         ->writeHeader("Location", (referer.empty() || referer == "/login" || !c.site->setup_done) ? "/" : referer)
         ->end();
     } catch (ApiError e) {
@@ -160,18 +165,22 @@ void define_user_routes(
       }
       // Registrations have low priority because anyone can initiate them.
       // This prevents registration spam from DOS'ing other actions.
-      auto txn = co_await c.app->db->open_write_txn(WritePriority::Low);
-      c.app->session_controller->register_local_user(
-        txn,
-        form.required_string("actual_username"),
-        form.required_string("email"),
-        std::move(password),
-        rsp->getRemoteAddressAsText(),
-        c.user_agent,
-        form.optional_string("invite_code").and_then(invite_code_to_id),
-        form.optional_string("application_reason")
-      );
-      txn.commit();
+      std::shared_ptr<CompletableOnce<bool>> committed;
+      {
+        auto txn = co_await c.app->db->open_write_txn(WritePriority::Low);
+        c.app->session_controller->register_local_user(
+          txn,
+          form.required_string("actual_username"),
+          form.required_string("email"),
+          std::move(password),
+          rsp->getRemoteAddressAsText(),
+          c.user_agent,
+          form.optional_string("invite_code").and_then(invite_code_to_id),
+          form.optional_string("application_reason")
+        );
+        committed = txn.commit();
+      }
+      if (!co_await committed) die(500, "Failed to save changes");
     } catch (ApiError e) {
       rsp->writeStatus(http_status(e.http_status))
         ->writeHeader("Content-Type", TYPE_HTML);
@@ -221,36 +230,47 @@ void define_user_routes(
       return std::pair(hex_id_param(req, 0), std::string(req->getHeader("referer")));
     });
     const auto user = c.require_login();
-    auto txn = co_await c.app->db->open_write_txn();
-    c.app->session_controller->mark_notification_read(txn, user, id);
+    std::shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await c.app->db->open_write_txn();
+      c.app->session_controller->mark_notification_read(txn, user, id);
+      if (c.is_htmx) {
+        c.populate(txn);
+        html_notification(c, NotificationDetail::get(txn, id, *c.login), *c.login);
+      }
+      committed = txn.commit();
+    }
+    if (!co_await committed) die(500, "Failed to save changes");
     if (c.is_htmx) {
-      c.populate(txn);
       rsp->writeHeader("Content-Type", TYPE_HTML);
-      PageCursor cur;
-      html_notification(c, NotificationDetail::get(txn, id, *c.login), *c.login);
       c.finish_write();
     } else {
       write_redirect_back(rsp, referer);
     }
-    txn.commit();
   });
 
   r.post("/notifications/all_read", [](auto* rsp, auto _c, auto body) -> Coro {
     auto& c = co_await _c;
     const auto referer = co_await _c.with_request([](auto* req) { return std::string(req->getHeader("referer")); });
     const auto user = c.require_login();
-    auto txn = co_await c.app->db->open_write_txn();
-    c.app->session_controller->mark_all_notifications_read(txn, user);
+    std::shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await c.app->db->open_write_txn();
+      c.app->session_controller->mark_all_notifications_read(txn, user);
+      if (c.is_htmx) {
+        c.populate(txn);
+        PageCursor cursor;
+        html_notification_list(c, cursor, c.app->session_controller->list_notifications(txn, cursor, *c.login));
+      }
+      committed = txn.commit();
+    }
+    if (!co_await committed) die(500, "Failed to save changes");
     if (c.is_htmx) {
-      c.populate(txn);
       rsp->writeHeader("Content-Type", TYPE_HTML);
-      PageCursor cursor;
-      html_notification_list(c, cursor, c.app->session_controller->list_notifications(txn, cursor, *c.login));
       c.finish_write();
     } else {
       write_redirect_back(rsp, referer);
     }
-    txn.commit();
   });
 
   // USER SETTINGS
@@ -288,13 +308,17 @@ void define_user_routes(
     if (!c.site->registration_invite_required || c.site->invite_admin_only) {
       die(403, "Users cannot generate invite codes on this server");
     }
-    auto txn = co_await c.app->db->open_write_txn();
-    const auto login = c.require_login(txn);
-    if (login.mod_state().state >= ModState::Locked) {
-      die(403, "User does not have permission to create an invite code");
+    std::shared_ptr<CompletableOnce<bool>> committed;
+    {
+      auto txn = co_await c.app->db->open_write_txn();
+      const auto login = c.require_login(txn);
+      if (login.mod_state().state >= ModState::Locked) {
+        die(403, "User does not have permission to create an invite code");
+      }
+      c.app->session_controller->create_site_invite(txn, login.id);
+      committed = txn.commit();
     }
-    c.app->session_controller->create_site_invite(txn, login.id);
-    txn.commit();
+    if (!co_await committed) die(500, "Failed to save changes");
     write_redirect_back(rsp, "/settings/invites");
   });
 }
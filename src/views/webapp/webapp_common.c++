@@ -145,6 +145,7 @@ void html_site_header(GenericContext& c, HtmlHeaderOptions opt) noexcept {
 
 void html_site_footer(GenericContext& c) noexcept {
   if (c.is_htmx) return;
+  c.end_of_stable_content();
   c.write_fmt(
     R"(<div class="spacer"></div><footer><small>Powered by <a href="https://github.com/ar-nelson/ludwig">Ludwig</a>)"
     R"( · v{})"
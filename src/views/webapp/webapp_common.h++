@@ -4,6 +4,8 @@
 #include "views/router_common.h++"
 #include "views/webapp/html/html_common.h++"
 #include "util/rate_limiter.h++"
+#include "services/rich_text_cache.h++"
+#include <xxhash.h>
 #include "controllers/session_controller.h++"
 
 namespace Ludwig {
@@ -19,6 +21,7 @@ struct WebappState {
   std::shared_ptr<SessionController> session_controller;
   std::shared_ptr<SiteController> site_controller;
   std::shared_ptr<KeyedRateLimiter> rate_limiter; // may be null!
+  std::shared_ptr<RichTextCache> rich_text_cache; // may be null!
 };
 
 struct GenericContext : public ResponseWriter {
@@ -29,9 +32,20 @@ struct GenericContext : public ResponseWriter {
   std::optional<std::string> session_cookie;
   std::string ip;
   bool is_htmx;
+  ContentEncoding encoding = ContentEncoding::Identity;
+  std::string if_none_match;
+  // Set by cache_by_etag
+  bool etag_from_page = false;
+  // Set by finish_write; the page is sent by flush
+  bool page_finished = false;
+  // Everything after this in the page (the footer's render time) changes on
+  // every request, so it is left out of the ETag
+  size_t page_stable_end = std::string::npos;
   const SiteDetail* site = nullptr;
   WebappState* app = nullptr;
   std::optional<LocalUserDetail> login;
+  // Read at the start of the request, so before any of its transactions
+  uint64_t rich_text_generation_at_start = 0;
 
   auto populate(ReadTxn& txn) {
     if (logged_in_user_id) {
@@ -67,6 +81,26 @@ struct GenericContext : public ResponseWriter {
     std::pair<std::optional<LoginResponse>, std::optional<std::string>>;
 
   virtual auto write_cookie() const noexcept -> void = 0;
+
+  // Sends this page with an ETag derived from its content, or sends 304 Not
+  // Modified instead if the client's copy has the same ETag. Call before
+  // writing any headers; the page's headers, including Content-Type and the
+  // session cookie, are then written by flush.
+  auto cache_by_etag() noexcept -> void {
+    etag_from_page = true;
+  }
+
+  // Marks the end of the part of the page that the ETag covers
+  auto end_of_stable_content() noexcept -> void {
+    page_stable_end = buf.size();
+  }
+
+  auto rich_text_cache() const noexcept -> RichTextCache* override {
+    return app ? app->rich_text_cache.get() : nullptr;
+  }
+  auto rich_text_generation() const noexcept -> uint64_t override {
+    return rich_text_generation_at_start;
+  }
 };
 
 template <bool SSL>
@@ -79,12 +113,15 @@ struct Context : public RequestContext<SSL, std::shared_ptr<WebappState>>, publi
   void pre_try(const uWS::HttpResponse<SSL>* rsp, Request req) noexcept override {
     start = std::chrono::steady_clock::now();
     is_htmx = !req->getHeader("hx-request").empty() && req->getHeader("hx-boosted").empty();
+    encoding = negotiate_content_encoding(req->getHeader("accept-encoding"));
+    if_none_match = req->getHeader("if-none-match");
   }
 
   void pre_request(Response rsp, Request req, std::shared_ptr<WebappState> app) override {
     using namespace std::chrono;
     this->rsp = rsp;
     this->app = app.get();
+    if (app->rich_text_cache) rich_text_generation_at_start = app->rich_text_cache->generation();
     ip = get_ip(rsp, req);
 
     if (app->rate_limiter && !app->rate_limiter->try_acquire(ip, this->method == "GET" ? 1 : 10)) {
@@ -113,11 +150,37 @@ struct Context : public RequestContext<SSL, std::shared_ptr<WebappState>>, publi
   void error_response(const ApiError& e, Response rsp) noexcept override;
 
   auto write_cookie() const noexcept -> void override {
-    if (session_cookie) rsp->writeHeader("Set-Cookie", *session_cookie);
+    // Pages cached by ETag write their headers in flush, after the 304 check
+    if (session_cookie && !etag_from_page) rsp->writeHeader("Set-Cookie", *session_cookie);
   }
 
   auto finish_write() -> void override {
-    rsp->end(this->buf);
+    page_finished = true;
+  }
+
+  auto flush() -> void override {
+    if (!std::exchange(page_finished, false)) return;
+    if (etag_from_page) {
+      const uint64_t variant[] = {
+        logged_in_user_id.value_or(std::numeric_limits<uint64_t>::max()),
+        is_htmx
+      };
+      const auto etag = weak_etag(
+        std::string_view(this->buf).substr(0, page_stable_end),
+        XXH3_64bits(variant, sizeof(variant))
+      );
+      const bool not_modified = etag_matches(if_none_match, etag);
+      if (not_modified) rsp->writeStatus(http_status(304));
+      else rsp->writeHeader("Content-Type", TYPE_HTML);
+      rsp->writeHeader("Etag", etag)
+        ->writeHeader("Cache-Control", "private, no-cache");
+      if (session_cookie) rsp->writeHeader("Set-Cookie", *session_cookie);
+      if (not_modified) {
+        rsp->end();
+        return;
+      }
+    }
+    end_with_encoding(rsp, encoding, this->buf);
   }
 };
 
@@ -133,6 +196,11 @@ void html_site_footer(GenericContext& c) noexcept;
 template <bool SSL>
 void Context<SSL>::error_response(const ApiError& e, Response rsp) noexcept {
   using fmt::operator""_cf;
+  // Discard the page this request was rendering, if any
+  etag_from_page = false;
+  page_finished = false;
+  page_stable_end = std::string::npos;
+  this->buf.clear();
   if (!is_htmx) {
     if (this->method == "get" && e.http_status == 401) {
       rsp->writeStatus(http_status(303))
@@ -149,6 +217,7 @@ void Context<SSL>::error_response(const ApiError& e, Response rsp) noexcept {
         this->write_fmt(R"(<main><div class="error-page"><h2>Error {}</h2><p>{}</p></div></main>)"_cf, http_status(e.http_status), e.message);
         html_site_footer(*this);
         this->finish_write();
+        this->flush();
         return;
       } catch (...) {
         spdlog::warn("Error when rendering error page");
@@ -0,0 +1,69 @@
+#include "test_common.h++"
+#include "util/compression.h++"
+#include <zlib.h>
+#include <zstd.h>
+
+TEST_CASE("negotiate Accept-Encoding", "[compression]") {
+  using enum ContentEncoding;
+  REQUIRE(negotiate_content_encoding("") == Identity);
+  REQUIRE(negotiate_content_encoding("identity") == Identity);
+  REQUIRE(negotiate_content_encoding("gzip") == Gzip);
+  REQUIRE(negotiate_content_encoding("gzip, deflate, zstd") == Zstd);
+  REQUIRE(negotiate_content_encoding("zstd;q=0.5, gzip") == Gzip);
+  REQUIRE(negotiate_content_encoding("zstd;q=0, gzip;q=0") == Identity);
+  REQUIRE(negotiate_content_encoding(" gzip ; q=0.8 , zstd ; q=0.9") == Zstd);
+}
+
+TEST_CASE("compress_response roundtrip", "[compression]") {
+  string src;
+  for (int i = 0; i < 500; i++) src += fmt::format("<li>Item number {}</li>\n", i);
+
+  REQUIRE(!compress_response(ContentEncoding::Identity, src));
+  REQUIRE(!compress_response(ContentEncoding::Zstd, "too small to compress"));
+
+  SECTION("zstd") {
+    // Compress twice, to exercise reuse of the per-thread context
+    for (int n = 0; n < 2; n++) {
+      const auto compressed = compress_response(ContentEncoding::Zstd, src);
+      REQUIRE(compressed);
+      REQUIRE(compressed->size() < src.size());
+      string out(src.size(), '\0');
+      const auto len = ZSTD_decompress(out.data(), out.size(), compressed->data(), compressed->size());
+      REQUIRE(!ZSTD_isError(len));
+      out.resize(len);
+      REQUIRE(out == src);
+    }
+  }
+
+  SECTION("gzip") {
+    for (int n = 0; n < 2; n++) {
+      const auto compressed = compress_response(ContentEncoding::Gzip, src);
+      REQUIRE(compressed);
+      REQUIRE(compressed->size() < src.size());
+      string out(src.size(), '\0');
+      z_stream stream {};
+      REQUIRE(inflateInit2(&stream, 15 + 16) == Z_OK);
+      stream.next_in = (Bytef*)compressed->data();
+      stream.avail_in = (uInt)compressed->size();
+      stream.next_out = (Bytef*)out.data();
+      stream.avail_out = (uInt)out.size();
+      REQUIRE(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+      out.resize(stream.total_out);
+      inflateEnd(&stream);
+      REQUIRE(out == src);
+    }
+  }
+}
+
+TEST_CASE("weak ETag comparison", "[compression]") {
+  const auto etag = weak_etag("<p>hello</p>", 0xabc);
+  const auto hash = fmt::format("{:x}", XXH3_64bits("<p>hello</p>", 12));
+  REQUIRE(etag == fmt::format(R"(W/"{}-abc")", hash));
+  REQUIRE(etag_matches(etag, etag));
+  REQUIRE(etag_matches(fmt::format(R"("{}-abc")", hash), etag));
+  REQUIRE(etag_matches(fmt::format(R"("foo", W/"{}-abc")", hash), etag));
+  REQUIRE(etag_matches("*", etag));
+  REQUIRE(!etag_matches("", etag));
+  REQUIRE(etag != weak_etag("<p>hello!</p>", 0xabc));
+  REQUIRE(etag != weak_etag("<p>hello</p>", 0xabd));
+}
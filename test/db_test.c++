@@ -3,6 +3,7 @@
 #include "util/rich_text.h++"
 #include <algorithm>
 #include <random>
+#include <catch2/benchmark/catch_benchmark.hpp>
 
 using namespace flatbuffers;
 
@@ -101,6 +102,61 @@ TEST_CASE("priority ordering of async write transactions", "[db][write_txn_async
   CHECK(*id4 < *id5);
 }
 
+TEST_CASE("group commit of async write transactions", "[db][write_txn_async]") {
+  // Records, at dispatch time, whether the event's subject is visible to readers
+  class CheckingEventBus : public DummyEventBus {
+  public:
+    DB* db;
+    vector<pair<uint64_t, bool>> dispatched;
+    auto dispatch(Event, uint64_t subject_id = 0) -> void override {
+      auto txn = db->open_read_txn();
+      dispatched.emplace_back(subject_id, txn.get_user(subject_id).has_value());
+    }
+  };
+  TempFile file;
+  DB db(file.name, 100, true, { .max_txns = 10, .max_delay = 1min });
+  auto event_bus = make_shared<CheckingEventBus>();
+  event_bus->db = &db;
+  const shared_ptr<EventBus> bus = event_bus;
+  vector<bool> committed;
+  db.open_write_txn(WritePriority::High)->on_complete([&](auto txn) {
+    db.open_write_txn(WritePriority::Low)->on_complete([&](auto txn) {
+      txn.queue_event(bus, Event::UserUpdate, create_user(txn, "user3", "User 3"));
+      txn.commit();
+    });
+    db.open_write_txn(WritePriority::Medium)->on_complete([&](auto txn) {
+      // Never committed, so aborted without affecting the rest of the batch
+      txn.queue_event(bus, Event::UserUpdate, create_user(txn, "aborted", "Aborted"));
+    });
+    db.open_write_txn(WritePriority::High)->on_complete([&](auto txn) {
+      txn.queue_event(bus, Event::UserUpdate, create_user(txn, "user2", "User 2"));
+      txn.commit();
+    });
+    txn.queue_event(bus, Event::UserUpdate, create_user(txn, "user1", "User 1"));
+    txn.commit()->on_complete([&](bool ok) { committed.push_back(ok); });
+    CHECK(event_bus->dispatched.empty());
+    CHECK(committed.empty());
+  });
+
+  auto txn = db.open_read_txn();
+  auto id1 = txn.get_user_id_by_name("user1"),
+    id2 = txn.get_user_id_by_name("user2"),
+    id3 = txn.get_user_id_by_name("user3");
+  REQUIRE((id1 && id2 && id3));
+  CHECK(!txn.get_user_id_by_name("aborted"));
+  CHECK(*id1 < *id2);
+  CHECK(*id2 < *id3);
+  CHECK(event_bus->dispatched == vector<pair<uint64_t, bool>>{{*id1, true}, {*id2, true}, {*id3, true}});
+  CHECK(committed == vector<bool>{true});
+
+  const auto stats = db.write_queue_stats();
+  CHECK(stats.txns == 4);
+  CHECK(stats.batches == 1);
+  CHECK(stats.max_batch_size == 4);
+  CHECK(stats.queue_depth == 0);
+  CHECK(stats.max_queue_depth == 3);
+}
+
 static inline auto create_users(DB& db, uint64_t ids[3]) {
   auto txn = db.open_write_txn_sync();
   FlatBufferBuilder fbb;
@@ -304,6 +360,26 @@ static inline auto random_int(std::mt19937& gen, uint64_t n) -> uint64_t {
   return dist(gen);
 }
 
+static inline auto key_rank(const Cursor& key, bool by_board) -> double {
+  const uint64_t bits = by_board ? key.int_field_1() : key.int_field_0();
+  double rank;
+  memcpy(&rank, &bits, sizeof(double));
+  return rank;
+}
+
+static inline auto check_rank_index(DBIter iter, bool by_board, const phmap::flat_hash_set<uint64_t>& deleted = {}) -> size_t {
+  size_t n = 0;
+  double last_rank = INFINITY;
+  for (auto id : iter) {
+    const auto rank = key_rank(*iter.get_cursor(), by_board);
+    REQUIRE(rank <= last_rank);
+    REQUIRE(!deleted.contains(id));
+    last_rank = rank;
+    n++;
+  }
+  return n;
+}
+
 TEST_CASE("generate and delete random posts and check stats", "[db]") {
   spdlog::set_level(spdlog::level::info);
   TempFile file;
@@ -459,11 +535,19 @@ TEST_CASE("generate and delete random posts and check stats", "[db]") {
       REQUIRE(stats.thread_count() == new_threads);
       REQUIRE(stats.comment_count() == top_comments);
       REQUIRE(stats.comment_count() == new_comments);
+      REQUIRE(check_rank_index(txn.list_threads_of_board_hot(board), true) == new_threads);
+      REQUIRE(check_rank_index(txn.list_threads_of_board_active(board), true) == new_threads);
+      REQUIRE(check_rank_index(txn.list_comments_of_board_hot(board), true) == new_comments);
+      REQUIRE(check_rank_index(txn.list_comments_of_board_active(board), true) == new_comments);
       total_threads += new_threads;
       total_comments += new_comments;
     }
     REQUIRE(total_threads == RND_SIZE);
     REQUIRE(total_comments == RND_SIZE);
+    REQUIRE(check_rank_index(txn.list_threads_hot(), false) == RND_SIZE);
+    REQUIRE(check_rank_index(txn.list_threads_active(), false) == RND_SIZE);
+    REQUIRE(check_rank_index(txn.list_comments_hot(), false) == RND_SIZE);
+    REQUIRE(check_rank_index(txn.list_comments_active(), false) == RND_SIZE);
   }
   phmap::flat_hash_set<uint64_t> del_threads, del_comments;
   std::sample(threads.begin(), threads.end(), std::inserter(del_threads, del_threads.begin()), RND_SIZE / 20, gen);
@@ -529,9 +613,165 @@ TEST_CASE("generate and delete random posts and check stats", "[db]") {
       REQUIRE(stats.thread_count() == new_threads);
       REQUIRE(stats.comment_count() == top_comments);
       REQUIRE(stats.comment_count() == new_comments);
+      REQUIRE(check_rank_index(txn.list_threads_of_board_hot(board), true, del_threads) == new_threads);
+      REQUIRE(check_rank_index(txn.list_comments_of_board_hot(board), true, del_comments) == new_comments);
       total_threads += new_threads;
     }
     REQUIRE(total_threads == RND_SIZE- (RND_SIZE / 20));
   }
   spdlog::set_level(spdlog::level::debug);
-}
\ No newline at end of file
+}
+
+TEST_CASE("rank index matches rescored ranks", "[db]") {
+  TempFile file;
+  DB db(file.name, 100, true);
+  uint64_t user_ids[3], board_ids[3], thread_ids[3];
+  create_users(db, user_ids);
+  create_boards(db, board_ids);
+  {
+    auto txn = db.open_write_txn_sync();
+    thread_ids[0] = create_thread(txn, user_ids[0], board_ids[0], "post 1", "http://example.com");
+    thread_ids[1] = create_thread(txn, user_ids[0], board_ids[0], "post 2", "http://example.com");
+    thread_ids[2] = create_thread(txn, user_ids[1], board_ids[1], "post 3", "http://example.com");
+    txn.set_vote(user_ids[0], thread_ids[0], Vote::Upvote);
+    txn.set_vote(user_ids[1], thread_ids[0], Vote::Upvote);
+    txn.set_vote(user_ids[2], thread_ids[1], Vote::Downvote);
+    txn.commit();
+  }
+  const auto list_hot = [&] {
+    auto txn = db.open_read_txn();
+    vector<uint64_t> xs;
+    for (auto id : txn.list_threads_hot()) xs.push_back(id);
+    return xs;
+  };
+  const auto expected = vector{thread_ids[0], thread_ids[2], thread_ids[1]};
+  REQUIRE(list_hot() == expected);
+  {
+    auto txn = db.open_write_txn_sync();
+    optional<pair<Cursor, uint64_t>> from;
+    size_t batches = 0;
+    do {
+      from = txn.rescore_thread_ranks(Timestamp{}, from, 2);
+      batches++;
+    } while (from);
+    REQUIRE(batches == 2);
+    txn.commit();
+  }
+  REQUIRE(list_hot() == expected);
+  {
+    auto txn = db.open_read_txn();
+    vector<uint64_t> xs;
+    for (auto id : txn.list_threads_of_board_hot(board_ids[0])) xs.push_back(id);
+    REQUIRE(xs == vector{thread_ids[0], thread_ids[1]});
+  }
+  {
+    auto txn = db.open_write_txn_sync();
+    txn.delete_thread(thread_ids[0]);
+    txn.commit();
+  }
+  REQUIRE(list_hot() == vector{thread_ids[2], thread_ids[1]});
+}
+
+// The Hot algorithm PostController used before the rank index: walk New,
+// stopping early once no older thread could outrank the best one queued (see
+// ranked() in post_controller.c++).
+static auto hot_page_by_scan(ReadTxn& txn, size_t limit) -> vector<uint64_t> {
+  vector<uint64_t> page;
+  auto iter_by_top = txn.list_threads_top();
+  if (iter_by_top.is_done()) return page;
+  const auto top_stats = txn.get_post_stats(*iter_by_top);
+  if (!top_stats) return page;
+  const auto max_possible_numerator = rank_numerator(top_stats->get().karma());
+  const auto now = now_t();
+  std::priority_queue<pair<double, uint64_t>> queue;
+  for (const auto id : txn.list_threads_new()) {
+    const auto stats = txn.get_post_stats(id);
+    if (!stats) continue;
+    const double denominator =
+      rank_denominator(now - uint_to_timestamp(txn.get_thread(id)->get().created_at()));
+    queue.emplace(rank_numerator(stats->get().karma()) / denominator, id);
+    if (max_possible_numerator / denominator > queue.top().first) continue;
+    page.push_back(queue.top().second);
+    queue.pop();
+    if (page.size() >= limit) return page;
+  }
+  for (; !queue.empty() && page.size() < limit; queue.pop()) page.push_back(queue.top().second);
+  return page;
+}
+
+// Thread count defaults to a million; override with LUDWIG_BENCH_THREADS.
+TEST_CASE("benchmark Hot rank index vs. scan", "[.][db_bench]") {
+  spdlog::set_level(spdlog::level::info);
+  const char* threads_env = getenv("LUDWIG_BENCH_THREADS");
+  const size_t threads = threads_env ? std::stoull(threads_env) : 1'000'000;
+  static constexpr size_t USERS = 100, BATCH = 10'000;
+  TempFile file;
+  DB db(file.name, std::max<size_t>(1024, threads / 256), true);
+  std::mt19937 gen(42);
+  uint64_t boards[3];
+  create_boards(db, boards);
+  vector<uint64_t> users, thread_ids;
+  thread_ids.reserve(threads);
+  const auto now = now_s();
+  {
+    auto txn = db.open_write_txn_sync();
+    for (size_t i = 0; i < USERS; i++) {
+      users.push_back(create_user(txn, fmt::format("benchuser{}", i), "Bench User"));
+    }
+    txn.commit();
+  }
+  FlatBufferBuilder fbb;
+  for (size_t i = 0; i < threads; i += BATCH) {
+    auto txn = db.open_write_txn_sync();
+    for (size_t ii = i; ii < std::min(i + BATCH, threads); ii++) {
+      fbb.Clear();
+      const vector title_type{RichText::Text};
+      const vector title{fbb.CreateString("Lorem ipsum dolor sit amet").Union()};
+      fbb.Finish(CreateThreadDirect(fbb,
+        users[random_int(gen, USERS)],
+        boards[random_int(gen, 3)],
+        &title_type,
+        &title,
+        now - random_int(gen, 86400 * 30),
+        {},
+        {},
+        {},
+        0,
+        0,
+        nullptr,
+        nullptr,
+        "https://example.com"
+      ));
+      thread_ids.push_back(txn.create_thread(fbb.GetBufferSpan()));
+    }
+    txn.commit();
+  }
+  // Vote on 1% of threads, so karma (and the scan's early-exit bound) varies
+  for (size_t i = 0; i < threads / 100; i += BATCH) {
+    auto txn = db.open_write_txn_sync();
+    for (size_t ii = i; ii < std::min(i + BATCH, threads / 100); ii++) {
+      const auto thread = thread_ids[random_int(gen, threads)];
+      const auto votes = random_int(gen, USERS);
+      for (size_t u = 0; u < votes; u++) txn.set_vote(users[u], thread, Vote::Upvote);
+    }
+    txn.commit();
+  }
+  BENCHMARK("first page of Hot from index") {
+    auto txn = db.open_read_txn();
+    size_t n = 0;
+    for (auto id : txn.list_threads_hot()) {
+      if (!txn.get_post_stats(id) || ++n >= 20) break;
+    }
+    return n;
+  };
+  BENCHMARK("first page of Hot from early-terminating scan") {
+    auto txn = db.open_read_txn();
+    return hot_page_by_scan(txn, 20).size();
+  };
+  BENCHMARK("rescore recent ranks") {
+    auto txn = db.open_write_txn_sync();
+    txn.rescore_thread_ranks(now_t() - RANK_RESCORE_MAX_AGE);
+    txn.commit();
+  };
+  spdlog::set_level(spdlog::level::debug);
+}
@@ -0,0 +1,173 @@
+#include "test_common.h++"
+#include "controllers/dump_controller.h++"
+#include "services/lmdb_search_engine.h++"
+#include "util/rich_text.h++"
+
+using namespace flatbuffers;
+
+static constexpr size_t USERS = 20, BOARDS = 3, THREADS = 1500, COMMENTS = 3000;
+
+static auto populate(DB& db, uint64_t users[USERS], uint64_t boards[BOARDS], uint64_t threads[THREADS]) -> void {
+  auto txn = db.open_write_txn_sync();
+  FlatBufferBuilder fbb;
+  for (size_t i = 0; i < USERS; i++) {
+    fbb.Clear();
+    const auto name = fbb.CreateString(fmt::format("user{}", i));
+    UserBuilder user(fbb);
+    user.add_created_at(now_s());
+    user.add_name(name);
+    user.add_salt(0);
+    fbb.Finish(user.Finish());
+    users[i] = txn.create_user(fbb.GetBufferSpan());
+  }
+  for (size_t i = 0; i < BOARDS; i++) {
+    fbb.Clear();
+    const auto name = fbb.CreateString(fmt::format("board{}", i));
+    BoardBuilder board(fbb);
+    board.add_created_at(now_s());
+    board.add_name(name);
+    fbb.Finish(board.Finish());
+    boards[i] = txn.create_board(fbb.GetBufferSpan());
+  }
+  for (size_t i = 0; i < THREADS; i++) {
+    fbb.Clear();
+    const auto [title_type, title] = plain_text_to_rich_text(fbb,
+      fmt::format("Thread {} about {}", i, i % 10 ? "databases" : "red pandas"));
+    ThreadBuilder thread(fbb);
+    thread.add_author(users[i % USERS]);
+    thread.add_board(boards[i % BOARDS]);
+    thread.add_title_type(title_type);
+    thread.add_title(title);
+    thread.add_created_at(now_s() - i);
+    thread.add_salt(0);
+    fbb.Finish(thread.Finish());
+    threads[i] = txn.create_thread(fbb.GetBufferSpan());
+  }
+  for (size_t i = 0; i < COMMENTS; i++) {
+    fbb.Clear();
+    const auto text = fmt::format("Comment {} about a {}", i, (i % THREADS) % 10 ? "database" : "platypus");
+    const auto content_raw = fbb.CreateString(text);
+    const auto [content_type, content] = plain_text_to_rich_text(fbb, text);
+    CommentBuilder comment(fbb);
+    comment.add_author(users[i % USERS]);
+    comment.add_parent(threads[i % THREADS]);
+    comment.add_thread(threads[i % THREADS]);
+    comment.add_created_at(now_s() - i);
+    comment.add_content_raw(content_raw);
+    comment.add_content_type(content_type);
+    comment.add_content(content);
+    comment.add_salt(0);
+    fbb.Finish(comment.Finish());
+    txn.create_comment(fbb.GetBufferSpan());
+  }
+  for (size_t u = 0; u < USERS; u++) {
+    for (size_t t = 0; t < THREADS; t++) {
+      if ((t + u) % 7 == 0) txn.set_vote(users[u], threads[t], Vote::Upvote);
+      else if ((t * u) % 11 == 1) txn.set_vote(users[u], threads[t], Vote::Downvote);
+    }
+    for (size_t b = 0; b < BOARDS; b++) {
+      if ((u + b) % 2 == 0) txn.set_subscription(users[u], boards[b], true);
+    }
+  }
+  txn.commit();
+}
+
+static auto search_ids(SearchEngine& engine, SearchQuery query) -> vector<uint64_t> {
+  vector<uint64_t> ids;
+  engine.search(query)->on_complete([&](auto results) {
+    for (const auto& r : results) ids.push_back(r.id);
+  });
+  return ids;
+}
+
+TEST_CASE("export and import a database dump, with search indexing", "[dump]") {
+  TempFile src_file, dump_file, dst_file, search_file;
+  uint64_t users[USERS], boards[BOARDS], threads[THREADS];
+  DB src(src_file.name, 100, true);
+  populate(src, users, boards, threads);
+  {
+    std::unique_ptr<FILE, int(*)(FILE*)> f(fopen(dump_file.name, "wb"), &fclose);
+    REQUIRE(f != nullptr);
+    DumpController dump;
+    for (auto chunk : dump.export_dump(src)) fwrite(chunk.data(), 1, chunk.size(), f.get());
+  }
+  auto search = make_shared<LmdbSearchEngine>(search_file.name, 100);
+  {
+    std::unique_ptr<FILE, int(*)(FILE*)> f(fopen(dump_file.name, "rb"), &fclose);
+    REQUIRE(f != nullptr);
+    DumpController::import_dump(dst_file.name, f.get(), std::filesystem::file_size(dump_file.name), search, 100);
+  }
+
+  DB dst(dst_file.name, 100);
+  auto src_txn = src.open_read_txn(), dst_txn = dst.open_read_txn();
+  for (size_t i = 0; i < USERS; i++) {
+    REQUIRE(dst_txn.get_user(users[i])->get().name()->string_view() == fmt::format("user{}", i));
+    for (size_t b = 0; b < BOARDS; b++) {
+      REQUIRE(dst_txn.is_user_subscribed_to_board(users[i], boards[b]) == ((i + b) % 2 == 0));
+    }
+  }
+  for (size_t b = 0; b < BOARDS; b++) {
+    REQUIRE(dst_txn.get_board_stats(boards[b])->get().subscriber_count() ==
+      src_txn.get_board_stats(boards[b])->get().subscriber_count());
+  }
+  size_t thread_count = 0, comment_count = 0;
+  for (const auto id : dst_txn.list_threads_old()) {
+    REQUIRE(dst_txn.get_post_stats(id)->get().karma() == src_txn.get_post_stats(id)->get().karma());
+    REQUIRE(dst_txn.get_post_stats(id)->get().descendant_count() == src_txn.get_post_stats(id)->get().descendant_count());
+    thread_count++;
+  }
+  for (const auto id : dst_txn.list_comments_old()) {
+    REQUIRE(dst_txn.get_comment(id)->get().content_raw()->string_view() ==
+      src_txn.get_comment(id)->get().content_raw()->string_view());
+    comment_count++;
+  }
+  REQUIRE(thread_count == THREADS);
+  REQUIRE(comment_count == COMMENTS);
+
+  SearchQuery query { .query = "pandas", .include_threads = true, .include_cws = true, .sort = SearchResultSort::New, .limit = THREADS };
+  REQUIRE(search_ids(*search, query).size() == THREADS / 10);
+
+  // Karma is copied to the search index once all votes are imported
+  query.sort = SearchResultSort::Top;
+  const auto top = search_ids(*search, query);
+  REQUIRE(top.size() == THREADS / 10);
+  REQUIRE(std::is_sorted(top.begin(), top.end(), [&](auto a, auto b) {
+    return dst_txn.get_post_stats(a)->get().karma() > dst_txn.get_post_stats(b)->get().karma();
+  }));
+
+  // Comments are indexed with their thread's board
+  query = { .query = "platypus", .include_comments = true, .include_cws = true, .sort = SearchResultSort::New, .board_id = boards[0], .limit = COMMENTS };
+  const auto comments = search_ids(*search, query);
+  REQUIRE(comments.size() == COMMENTS / 30);
+  for (const auto id : comments) {
+    REQUIRE(dst_txn.get_thread(dst_txn.get_comment(id)->get().thread())->get().board() == boards[0]);
+  }
+  std::remove(fmt::format("{}-lock", src_file.name).c_str());
+  std::remove(fmt::format("{}-lock", dst_file.name).c_str());
+  std::remove(fmt::format("{}-lock", search_file.name).c_str());
+}
+
+TEST_CASE("verify every record type in a dump entry", "[dump]") {
+  FlatBufferBuilder record;
+  {
+    const auto name = record.CreateString("user");
+    UserBuilder user(record);
+    user.add_created_at(now_s());
+    user.add_name(name);
+    user.add_salt(0);
+    record.Finish(user.Finish());
+  }
+  const auto entry = [](DumpType type, const uint8_t* data, size_t size) {
+    auto fbb = std::make_unique<FlatBufferBuilder>();
+    fbb->FinishSizePrefixed(CreateDump(*fbb, 1, type, fbb->CreateVector(data, size)));
+    return fbb;
+  };
+  const auto valid = entry(DumpType::User, record.GetBufferPointer(), record.GetSize());
+  REQUIRE(DB::verify_dump_entry({valid->GetBufferPointer(), valid->GetSize()}).type() == DumpType::User);
+
+  const uint8_t garbage[16] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+  for (const auto type : {DumpType::User, DumpType::LocalUser, DumpType::Board, DumpType::LocalBoard, DumpType::Thread, DumpType::Comment, DumpType::Notification}) {
+    const auto invalid = entry(type, garbage, sizeof(garbage));
+    REQUIRE_THROWS(DB::verify_dump_entry({invalid->GetBufferPointer(), invalid->GetSize()}));
+  }
+}
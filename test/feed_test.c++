@@ -0,0 +1,191 @@
+#include "test_common.h++"
+#include "controllers/post_controller.h++"
+#include "controllers/user_controller.h++"
+#include "models/local_user.h++"
+#include "util/rich_text.h++"
+#include <random>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+using namespace flatbuffers;
+using enum SortType;
+
+static inline auto random_int(std::mt19937& gen, uint64_t n) -> uint64_t {
+  return std::uniform_int_distribution<uint64_t>(0, n - 1)(gen);
+}
+
+struct FeedInstance {
+  TempFile file;
+  shared_ptr<DB> db;
+  shared_ptr<SiteController> site;
+  shared_ptr<UserController> users;
+  shared_ptr<PostController> posts;
+  vector<uint64_t> boards, threads;
+
+  FeedInstance(size_t map_size_mb = 100) {
+    db = make_shared<DB>(file.name, map_size_mb, true);
+    auto txn = db->open_write_txn_sync();
+    txn.set_setting(SettingsKey::created_at, now_s() - 86400 * 30);
+    txn.set_setting(SettingsKey::base_url, "http://ludwig.test");
+    txn.commit();
+    site = make_shared<SiteController>(db);
+    users = make_shared<UserController>(site);
+    posts = make_shared<PostController>(site);
+  }
+  ~FeedInstance() {
+    std::remove(fmt::format("{}-lock", file.name).c_str());
+  }
+
+  // Creates boards, then threads and comments with random boards, ages, and
+  // karma; many of the sort keys are deliberately shared between posts
+  auto populate(size_t n_boards, size_t n_threads, size_t n_comments) -> void {
+    std::mt19937 gen(42);
+    auto txn = db->open_write_txn_sync();
+    vector<uint64_t> voters;
+    for (size_t i = 0; i < 8; i++) {
+      FlatBufferBuilder fbb;
+      const auto name = fbb.CreateString(fmt::format("voter{}", i));
+      UserBuilder user(fbb);
+      user.add_created_at(now_s());
+      user.add_name(name);
+      user.add_salt(0);
+      fbb.Finish(user.Finish());
+      voters.push_back(txn.create_user(fbb.GetBufferSpan()));
+    }
+    FlatBufferBuilder fbb;
+    for (size_t i = 0; i < n_boards; i++) {
+      fbb.Clear();
+      const auto name = fbb.CreateString(fmt::format("board{}", i));
+      BoardBuilder board(fbb);
+      board.add_created_at(now_s());
+      board.add_name(name);
+      fbb.Finish(board.Finish());
+      boards.push_back(txn.create_board(fbb.GetBufferSpan()));
+    }
+    const auto now = now_s();
+    for (size_t i = 0; i < n_threads; i++) {
+      fbb.Clear();
+      const auto [title_type, title] = plain_text_to_rich_text(fbb, fmt::format("Thread {}", i));
+      ThreadBuilder thread(fbb);
+      thread.add_author(voters[i % voters.size()]);
+      thread.add_board(boards[random_int(gen, n_boards)]);
+      thread.add_title_type(title_type);
+      thread.add_title(title);
+      thread.add_created_at(now - 60 * random_int(gen, 60 * 24 * 14));
+      thread.add_salt(0);
+      fbb.Finish(thread.Finish());
+      threads.push_back(txn.create_thread(fbb.GetBufferSpan()));
+    }
+    for (size_t i = 0; i < n_comments; i++) {
+      fbb.Clear();
+      const auto thread = threads[random_int(gen, threads.size())];
+      const auto text = fmt::format("Comment {}", i);
+      const auto content_raw = fbb.CreateString(text);
+      const auto [content_type, content] = plain_text_to_rich_text(fbb, text);
+      CommentBuilder comment(fbb);
+      comment.add_author(voters[i % voters.size()]);
+      comment.add_parent(thread);
+      comment.add_thread(thread);
+      comment.add_created_at(now - 60 * random_int(gen, 60 * 24 * 14));
+      comment.add_content_raw(content_raw);
+      comment.add_content_type(content_type);
+      comment.add_content(content);
+      comment.add_salt(0);
+      fbb.Finish(comment.Finish());
+      txn.create_comment(fbb.GetBufferSpan());
+    }
+    for (const auto voter : voters) {
+      for (const auto thread : threads) {
+        if (!random_int(gen, 4)) txn.set_vote(voter, thread, random_int(gen, 3) ? Vote::Upvote : Vote::Downvote);
+      }
+    }
+    txn.commit();
+  }
+
+  auto create_subscriber(string_view name, size_t n_subscriptions) -> uint64_t {
+    auto txn = db->open_write_txn_sync();
+    const auto id = users->create_local_user(txn, name, {}, "mypassword", false, {}, IsApproved::Yes);
+    for (size_t i = 0; i < n_subscriptions; i++) txn.set_subscription(id, boards[i * boards.size() / n_subscriptions], true);
+    txn.commit();
+    return id;
+  }
+};
+
+// Pages through a feed, `page_size` entries at a time, like the webapp does
+template <class Fn>
+static auto page_ids(Fn list, size_t page_size) -> vector<uint64_t> {
+  vector<uint64_t> ids;
+  PageCursor cursor;
+  do {
+    size_t n = 0;
+    for (const auto& e : list(cursor)) {
+      ids.push_back(e.id);
+      if (++n >= page_size) break;
+    }
+  } while (cursor);
+  return ids;
+}
+
+TEST_CASE("Home feed merges subscribed boards in global index order", "[feed]") {
+  FeedInstance f;
+  f.populate(12, 600, 1200);
+  const auto user_id = f.create_subscriber("subscriber", 5);
+  auto txn = f.db->open_read_txn();
+  const auto login = LocalUserDetail::get_login(txn, user_id);
+  phmap::flat_hash_set<uint64_t> subs;
+  for (const auto id : txn.list_subscribed_boards(user_id)) subs.insert(id);
+  REQUIRE(subs.size() == 5);
+
+  for (const auto sort : {Active, Hot, New, Old, MostComments, TopAll, TopWeek}) {
+    DYNAMIC_SECTION("threads, sort " << EnumNameSortType(sort)) {
+      // Expected: one unpaginated pass over the global index, filtered
+      vector<uint64_t> expected;
+      PageCursor all_cursor;
+      for (const auto& t : f.posts->list_feed_threads(txn, all_cursor, PostController::FEED_ALL, sort, login)) {
+        if (subs.contains(t.thread().board())) expected.push_back(t.id);
+      }
+      REQUIRE_FALSE(expected.empty());
+      for (const size_t page_size : {1000, 20, 7}) {
+        REQUIRE(page_ids([&](PageCursor& c) {
+          return f.posts->list_feed_threads(txn, c, PostController::FEED_HOME, sort, login);
+        }, page_size) == expected);
+      }
+    }
+    DYNAMIC_SECTION("comments, sort " << EnumNameSortType(sort)) {
+      vector<uint64_t> expected;
+      PageCursor all_cursor;
+      for (const auto& c : f.posts->list_feed_comments(txn, all_cursor, PostController::FEED_ALL, sort, login)) {
+        if (subs.contains(c.thread().board())) expected.push_back(c.id);
+      }
+      REQUIRE_FALSE(expected.empty());
+      for (const size_t page_size : {1000, 20, 7}) {
+        REQUIRE(page_ids([&](PageCursor& c) {
+          return f.posts->list_feed_comments(txn, c, PostController::FEED_HOME, sort, login);
+        }, page_size) == expected);
+      }
+    }
+  }
+}
+
+TEST_CASE("benchmark Home feed by number of subscriptions", "[.][feed_bench]") {
+  spdlog::set_level(spdlog::level::info);
+  FeedInstance f(2048);
+  f.populate(1000, 100000, 0);
+  for (const size_t n : {1, 10, 100, 1000}) {
+    const auto user_id = f.create_subscriber(fmt::format("subscriber{}", n), n);
+    for (const auto sort : {Hot, New, TopAll}) {
+      // 1000 subscriptions is over HOME_FEED_MERGE_MAX_BOARDS, so this one
+      // measures the global scan
+      BENCHMARK(fmt::format("first page of Home, {}, {} subscriptions", EnumNameSortType(sort), n)) {
+        auto txn = f.db->open_read_txn();
+        const auto login = LocalUserDetail::get_login(txn, user_id);
+        PageCursor cursor;
+        size_t count = 0;
+        for (const auto& t : f.posts->list_feed_threads(txn, cursor, PostController::FEED_HOME, sort, login)) {
+          if (++count >= 20) break;
+        }
+        return count;
+      };
+    }
+  }
+  spdlog::set_level(spdlog::level::debug);
+}
@@ -62,7 +62,7 @@ public:
     auto api_c = make_shared<Lemmy::ApiController>(site, users, sessions, boards, posts, search, first_run);
     auto remote_media_c = make_shared<RemoteMediaController>(
       pool.io, db, outer_http, xml_ctx, event_bus,
-      [&](auto f) { pool.post(std::move(f)); }
+      [&](auto f) { pool.post(std::move(f)); return true; }
     );
     promise<uint16_t> port_promise;
     auto port_future = port_promise.get_future();
@@ -0,0 +1,44 @@
+#include "test_common.h++"
+#include "util/metrics.h++"
+#include <thread>
+
+TEST_CASE("metrics are summed across threads and exported in Prometheus format", "[metrics]") {
+  if constexpr (!Metrics::enabled) SKIP("Metrics are disabled in this build");
+  auto& counter = Metrics::counter("test_things_total", "Things counted by the test", {{"kind", "a \"quoted\" label"}});
+  auto& latency = Metrics::histogram("test_latency_seconds", "Latency recorded by the test", Metrics::Unit::Seconds);
+  auto& size = Metrics::histogram("test_size_bytes", "Sizes recorded by the test", Metrics::Unit::Bytes);
+  Metrics::callback("test_depth", "Depth read by the test", Metrics::Type::Gauge, [] { return 42.0; });
+
+  // Registering again returns the same metric
+  REQUIRE(&Metrics::counter("test_things_total", "Things counted by the test", {{"kind", "a \"quoted\" label"}}) == &counter);
+  REQUIRE(&Metrics::counter("test_things_total", "Things counted by the test", {{"kind", "other"}}) != &counter);
+  REQUIRE_THROWS(Metrics::histogram("test_things_total", "Wrong type", Metrics::Unit::Bytes));
+
+  vector<std::thread> threads;
+  for (size_t t = 0; t < 8; t++) {
+    threads.emplace_back([&] {
+      for (uint64_t i = 0; i < 1000; i++) {
+        counter.inc();
+        latency.observe(i < 500 ? 500 : 2'000'000);
+        size.observe(i);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  REQUIRE(counter.value() == 8000);
+
+  const auto out = Metrics::to_prometheus();
+  REQUIRE(out.contains("# HELP test_things_total Things counted by the test\n# TYPE test_things_total counter\n"));
+  REQUIRE(out.contains(R"(test_things_total{kind="a \"quoted\" label"} 8000)" "\n"));
+  REQUIRE(out.contains(R"(test_things_total{kind="other"} 0)" "\n"));
+  REQUIRE(out.contains("# TYPE test_latency_seconds histogram\n"));
+  // 500ns is in the first bucket, 2ms is in the bucket up to 2^21ns
+  REQUIRE(out.contains(R"(test_latency_seconds_bucket{le="1.024e-06"} 4000)" "\n"));
+  REQUIRE(out.contains(R"(test_latency_seconds_bucket{le="0.001048576"} 4000)" "\n"));
+  REQUIRE(out.contains(R"(test_latency_seconds_bucket{le="0.002097152"} 8000)" "\n"));
+  REQUIRE(out.contains(R"(test_latency_seconds_bucket{le="+Inf"} 8000)" "\n"));
+  REQUIRE(out.contains("test_latency_seconds_count 8000\n"));
+  REQUIRE(out.contains(R"(test_size_bytes_bucket{le="64"} 512)" "\n"));
+  REQUIRE(out.contains("test_size_bytes_sum 3996000\n"));
+  REQUIRE(out.contains("# TYPE test_depth gauge\ntest_depth 42\n"));
+}
@@ -2,6 +2,7 @@
 #include "util/common.h++"
 #include "util/rich_text.h++"
 #include "views/webapp/html/html_rich_text.h++"
+#include "services/rich_text_cache.h++"
 
 using std::string_view, flatbuffers::FlatBufferBuilder, flatbuffers::Vector,
     flatbuffers::Offset;
@@ -337,3 +338,63 @@ TEST_CASE("parse Markdown auto links", "[rich_text]") {
     REQUIRE(expect_string(blocks, 2) == "https://example.com</a>) for more information</p>");
   }
 }
+
+TEST_CASE("cache rendered HTML by post and options", "[rich_text]") {
+  auto event_bus = make_shared<DummyEventBus>();
+  RichTextCache cache(RichTextCache::VARIANTS * 64 * 1024, event_bus);
+  unsigned renders = 0;
+  const auto render = [&](string s) { return [&renders, s] { renders++; return s; }; };
+
+  CHECK(*cache.get(1, 0, cache.generation(), render("<p>one</p>")) == "<p>one</p>");
+  CHECK(*cache.get(1, 0, cache.generation(), render("wrong")) == "<p>one</p>");
+  CHECK(*cache.get(1, 1, cache.generation(), render("<p>one, variant</p>")) == "<p>one, variant</p>");
+  CHECK(*cache.get(2, 0, cache.generation(), render("<p>two</p>")) == "<p>two</p>");
+  CHECK(renders == 3);
+
+  cache.invalidate(1);
+  CHECK(*cache.get(1, 0, cache.generation(), render("<p>one, edited</p>")) == "<p>one, edited</p>");
+  CHECK(*cache.get(1, 1, cache.generation(), render("<p>one, edited variant</p>")) == "<p>one, edited variant</p>");
+  CHECK(*cache.get(2, 0, cache.generation(), render("wrong")) == "<p>two</p>");
+  CHECK(renders == 5);
+
+  const auto stats = cache.stats();
+  CHECK(stats.hits == 2);
+  CHECK(stats.misses == 5);
+  CHECK(stats.invalidations == 1);
+  CHECK(stats.entries == 3);
+}
+
+TEST_CASE("don't cache HTML rendered from before an invalidation", "[rich_text]") {
+  RichTextCache cache(RichTextCache::VARIANTS * 64 * 1024);
+  const auto render = [](string s) { return [s] { return s; }; };
+
+  // A request reads the generation and opens its transaction, then the post
+  // is edited and invalidated before the request renders it
+  const auto before_edit = cache.generation();
+  cache.invalidate(1);
+  CHECK(*cache.get(1, 0, before_edit, render("<p>old</p>")) == "<p>old</p>");
+  CHECK(*cache.get(1, 0, cache.generation(), render("<p>new</p>")) == "<p>new</p>");
+  CHECK(*cache.get(1, 0, cache.generation(), render("wrong")) == "<p>new</p>");
+
+  // Only post 1's shard was invalidated, so posts in other shards are cached
+  const auto before_other_edit = cache.generation();
+  cache.invalidate(1);
+  for (uint64_t id = 2; id < 34; id++) cache.get(id, 0, before_other_edit, render("<p>other</p>"));
+  CHECK(cache.stats().entries > 0);
+}
+
+TEST_CASE("evict least recently used rendered HTML", "[rich_text]") {
+  // Small enough that each shard holds only a few entries
+  RichTextCache cache(16 * 4 * 1024);
+  const string big(1000, 'x');
+  for (uint64_t id = 1; id <= 1000; id++) {
+    cache.get(id, 0, cache.generation(), [&] { return big; });
+    // Keep post 1 recently used; it should never be evicted
+    cache.get(1, 0, cache.generation(), [&] { return string("wrong"); });
+  }
+  CHECK(*cache.get(1, 0, cache.generation(), [] { return string("wrong"); }) == big);
+  const auto stats = cache.stats();
+  CHECK(stats.evictions > 0);
+  CHECK(stats.bytes <= 16 * 4 * 1024);
+  CHECK(stats.entries + stats.evictions == 1000);
+}
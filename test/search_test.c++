@@ -0,0 +1,200 @@
+#include "test_common.h++"
+#include "services/lmdb_search_engine.h++"
+#include "util/rich_text.h++"
+#include <random>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+using namespace flatbuffers;
+using enum SearchResultType;
+
+static inline auto random_int(std::mt19937& gen, uint64_t n) -> uint64_t {
+  return std::uniform_int_distribution<uint64_t>(0, n - 1)(gen);
+}
+
+struct TempSearchEngine {
+  TempFile file;
+  LmdbSearchEngine engine;
+
+  TempSearchEngine() : engine(file.name, 256) {}
+  ~TempSearchEngine() {
+    std::remove(fmt::format("{}-lock", file.name).c_str());
+  }
+};
+
+static auto index_thread(
+  SearchEngine& engine,
+  uint64_t id,
+  string_view title,
+  uint64_t board = 1,
+  string_view content_warning = ""
+) -> void {
+  FlatBufferBuilder fbb;
+  const auto [title_type, title_vec] = plain_text_to_rich_text(fbb, title);
+  const auto cw = content_warning.empty() ? Offset<String>() : fbb.CreateString(content_warning);
+  ThreadBuilder t(fbb);
+  t.add_author(1);
+  t.add_board(board);
+  t.add_title_type(title_type);
+  t.add_title(title_vec);
+  t.add_created_at(now_s());
+  if (!content_warning.empty()) t.add_content_warning(cw);
+  fbb.Finish(t.Finish());
+  engine.index(id, *GetRoot<Thread>(fbb.GetBufferPointer()), {});
+}
+
+static auto search_ids(SearchEngine& engine, SearchQuery query) -> vector<uint64_t> {
+  vector<uint64_t> ids;
+  engine.search(query)->on_complete([&](auto results) {
+    for (const auto& r : results) ids.push_back(r.id);
+  });
+  return ids;
+}
+
+TEST_CASE("search threads by relevance, new, and top", "[search]") {
+  TempSearchEngine s;
+  index_thread(s.engine, 1, "The red panda is a small mammal");
+  index_thread(s.engine, 2, "Pandas: red panda, giant panda, panda panda panda");
+  index_thread(s.engine, 3, "An unrelated thread about databases");
+  index_thread(s.engine, 4, "Where red panda bears eat bamboo");
+  SearchQuery query { .query = "red panda", .include_threads = true, .include_cws = true, .limit = 10 };
+
+  query.sort = SearchResultSort::Relevant;
+  auto ids = search_ids(s.engine, query);
+  REQUIRE(ids.size() == 3);
+  REQUIRE(ids[0] == 2);
+  REQUIRE(std::find(ids.begin(), ids.end(), 3) == ids.end());
+
+  query.sort = SearchResultSort::New;
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{4, 2, 1});
+
+  s.engine.update_karma(1, Thread, 50);
+  s.engine.update_karma(2, Thread, -5);
+  s.engine.update_karma(4, Thread, 10);
+  query.sort = SearchResultSort::Top;
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{1, 4, 2});
+
+  query.offset = 1;
+  query.limit = 1;
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{4});
+
+  // Reindexing keeps karma, but replaces terms
+  index_thread(s.engine, 1, "A small mammal");
+  query.offset = 0;
+  query.limit = 10;
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{4, 2});
+
+  s.engine.unindex(4, Thread);
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{2});
+
+  query.include_threads = false;
+  query.include_comments = true;
+  REQUIRE(search_ids(s.engine, query).empty());
+}
+
+TEST_CASE("search filters by board and content warning", "[search]") {
+  TempSearchEngine s;
+  index_thread(s.engine, 1, "Bamboo forest", 10);
+  index_thread(s.engine, 2, "Bamboo shoots", 20);
+  index_thread(s.engine, 3, "Bamboo furniture", 10, "Splinters");
+  index_thread(s.engine, 4, "Bamboo bicycles", 20, "Hipsters");
+  SearchQuery query { .query = "Bamboo", .include_threads = true, .sort = SearchResultSort::New, .limit = 10 };
+
+  query.include_cws = true;
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{4, 3, 2, 1});
+  query.include_cws = false;
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{2, 1});
+  query.board_id = 10;
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{1});
+  query.include_cws = true;
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{3, 1});
+  query.sort = SearchResultSort::Relevant;
+  REQUIRE(search_ids(s.engine, query).size() == 2);
+
+  // Moving a thread to another board updates the filter
+  index_thread(s.engine, 2, "Bamboo shoots", 10);
+  query.sort = SearchResultSort::New;
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{3, 2, 1});
+
+  // Boards and users are excluded when filtering by board
+  query.include_users = query.include_boards = true;
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{3, 2, 1});
+}
+
+TEST_CASE("search posting lists span multiple blocks", "[search]") {
+  TempSearchEngine s;
+  static constexpr uint64_t N = 1000;
+  // Insert out of order, to exercise block splits
+  std::mt19937 gen(42);
+  vector<uint64_t> order(N);
+  std::iota(order.begin(), order.end(), 1);
+  std::shuffle(order.begin(), order.end(), gen);
+  for (auto id : order) {
+    index_thread(s.engine, id, id % 3 ? "common words everywhere" : "common words, and a rare platypus", 1 + id % 2);
+  }
+  SearchQuery query { .query = "common", .include_threads = true, .include_cws = true, .sort = SearchResultSort::New, .limit = 5 };
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{1000, 999, 998, 997, 996});
+  query.offset = 500;
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{500, 499, 498, 497, 496});
+
+  query.query = "platypus";
+  query.offset = 0;
+  query.limit = N;
+  query.board_id = 2;
+  auto ids = search_ids(s.engine, query);
+  REQUIRE(ids.size() == 167);
+  REQUIRE(std::all_of(ids.begin(), ids.end(), [](auto id) { return id % 3 == 0 && id % 2 == 1; }));
+  REQUIRE(std::is_sorted(ids.begin(), ids.end(), std::greater<uint64_t>()));
+
+  for (uint64_t id = 3; id <= N; id += 3) s.engine.unindex(id, Thread);
+  REQUIRE(search_ids(s.engine, query).empty());
+  query.query = "common";
+  query.board_id = 0;
+  query.limit = 3;
+  REQUIRE(search_ids(s.engine, query) == vector<uint64_t>{1000, 998, 997});
+}
+
+TEST_CASE("benchmark search on a Zipf-distributed corpus", "[.][search_bench]") {
+  spdlog::set_level(spdlog::level::info);
+  TempFile file;
+  LmdbSearchEngine engine(file.name, 2048);
+  static constexpr size_t THREADS = 100000, VOCABULARY = 5000;
+  static const vector<string_view> words {
+    "the", "of", "and", "to", "in", "is", "that", "for", "it", "with", "as", "was", "on", "be", "at", "by",
+    "this", "have", "from", "or", "one", "had", "not", "but", "what", "all", "were", "when", "we", "there",
+    "can", "an", "your", "which", "their", "said", "if", "do", "will", "each", "about", "how", "up", "out",
+    "them", "then", "she", "many", "some", "so", "these", "would", "other", "into", "has", "more", "her",
+    "two", "like", "him", "see", "time", "could", "no", "make", "than", "first", "been", "its", "who", "now",
+    "people", "my", "made", "over", "did", "down", "only", "way", "find", "use", "may", "water", "long",
+    "little", "very", "after", "words", "called", "just", "where", "most", "know", "panda", "bamboo",
+    "server", "federation", "kernel", "compiler", "garden", "recipe", "bicycle", "mountain", "river"
+  };
+  std::mt19937 gen(42);
+  vector<double> weights;
+  for (size_t i = 1; i <= VOCABULARY; i++) weights.push_back(1.0 / (double)i);
+  std::discrete_distribution<size_t> zipf(weights.begin(), weights.end());
+  const auto word = [&](size_t i) {
+    return i < words.size() ? string(words[i]) : fmt::format("{}{}", words[i % words.size()], i);
+  };
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t id = 1; id <= THREADS; id++) {
+    string title;
+    for (size_t n = 4 + random_int(gen, 16); n > 0; n--) title += word(zipf(gen)) + " ";
+    index_thread(engine, id, title, 1 + random_int(gen, 20), random_int(gen, 20) ? "" : "CW");
+    engine.update_karma(id, Thread, (int64_t)random_int(gen, 1000));
+  }
+  spdlog::info("Indexed {} threads in {:.2f}s", THREADS,
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+  for (const auto q : {"the", "panda", "the people", "bamboo garden recipe"}) {
+    for (const auto sort : {SearchResultSort::Relevant, SearchResultSort::New, SearchResultSort::Top}) {
+      BENCHMARK(fmt::format("{} \"{}\"", sort == SearchResultSort::Relevant ? "Relevant" : sort == SearchResultSort::New ? "New" : "Top", q)) {
+        return search_ids(engine, { .query = q, .include_threads = true, .include_cws = true, .sort = sort, .limit = 20 }).size();
+      };
+    }
+    BENCHMARK(fmt::format("Relevant \"{}\", board filter, no CWs", q)) {
+      return search_ids(engine, { .query = q, .include_threads = true, .sort = SearchResultSort::Relevant, .board_id = 7, .limit = 20 }).size();
+    };
+  }
+  std::remove(fmt::format("{}-lock", file.name).c_str());
+  spdlog::set_level(spdlog::level::debug);
+}
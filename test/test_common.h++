@@ -103,6 +103,7 @@ private:
   };
 protected:
   auto fetch(HttpClientRequest&& req, HttpResponseCallback&& callback) -> void {
+    requests++;
     const auto rsp = get_responses.find(req.url.get_href());
     if (rsp == get_responses.end()) callback(make_unique<Response>(404));
     else if (req.method != "GET") callback(make_unique<Response>(405));
@@ -112,6 +113,8 @@ protected:
     }
   }
 public:
+  std::atomic<size_t> requests = 0;
+
   auto on_get(string url, uint16_t status, string_view mimetype, string_view body) -> MockHttpClient* {
     get_responses.emplace(url, std::tuple(status, mimetype, body));
     return this;
@@ -0,0 +1,127 @@
+#include "test_common.h++"
+#include "services/thumbnail_cache.h++"
+
+static auto stored(ThumbnailStore& store, uint64_t key) -> optional<pair<string, uint64_t>> {
+  optional<pair<string, uint64_t>> out;
+  store.get(key, [&](string_view data, uint64_t hash) { out.emplace(string(data), hash); });
+  return out;
+}
+
+TEST_CASE("stored thumbnails survive reopening the store", "[thumbnail_store]") {
+  TempFile file;
+  const auto a = ThumbnailStore::key("https://example.test/a.png", 256, 256),
+    b = ThumbnailStore::key("https://example.test/b.png", 256, 256),
+    a_banner = ThumbnailStore::key("https://example.test/a.png", 960, 160);
+  REQUIRE(a != b);
+  REQUIRE(a != a_banner);
+  {
+    ThumbnailStore store(file.name, MiB);
+    REQUIRE_FALSE(stored(store, a));
+    store.put(a, "image a", 1);
+    store.put(b, "image b", 2);
+    store.put(a, "image a, again", 3);
+    CHECK(store.stats().entries == 2);
+  }
+  {
+    ThumbnailStore store(file.name, MiB);
+    CHECK(store.stats().entries == 2);
+    CHECK(stored(store, a) == pair<string, uint64_t>("image a, again", 3));
+    CHECK(stored(store, b) == pair<string, uint64_t>("image b", 2));
+    CHECK_FALSE(stored(store, a_banner));
+    CHECK(store.stats().hits == 2);
+    CHECK(store.stats().misses == 1);
+  }
+  std::remove(fmt::format("{}-lock", file.name).c_str());
+}
+
+TEST_CASE("thumbnail store evicts to stay under its byte budget", "[thumbnail_store]") {
+  TempFile file;
+  const size_t budget = 64 * 1024;
+  ThumbnailStore store(file.name, budget);
+  const string data(4000, 'x');
+  for (uint64_t i = 0; i < 100; i++) {
+    store.put(i, data, i);
+    REQUIRE(store.stats().bytes <= budget);
+  }
+  const auto stats = store.stats();
+  CHECK(stats.entries > 10);
+  CHECK(stats.entries <= 16);
+  CHECK(stats.evictions == 100 - stats.entries);
+  // The newest thumbnail is never the one evicted
+  CHECK(stored(store, 99));
+  // Too big to ever fit
+  store.put(1000, string(budget, 'x'), 1000);
+  CHECK_FALSE(stored(store, 1000));
+  std::remove(fmt::format("{}-lock", file.name).c_str());
+}
+
+TEST_CASE("thumbnail store counts overflow pages in whole pages", "[thumbnail_store]") {
+  TempFile file;
+  ThumbnailStore store(file.name, MiB);
+  // Too big to share a page, whatever the page size is
+  store.put(1, string(40000, 'x'), 1);
+  REQUIRE(stored(store, 1));
+  const auto bytes = store.stats().bytes;
+  CHECK(bytes > 40000);
+  // Page sizes are multiples of 4 KiB; the rest is the fixed per-entry overhead
+  CHECK(bytes % 4096 == 64);
+  std::remove(fmt::format("{}-lock", file.name).c_str());
+}
+
+TEST_CASE("thumbnail cache serves stored thumbnails after a restart without fetching", "[thumbnail_store]") {
+  static const string url = "https://example.test/test.jpg";
+  TempFile file;
+  auto http_client = make_shared<MockHttpClient>();
+  http_client->on_get(url, 200, "image/jpeg", load_file(test_root() / "images" / "test.jpg"));
+  const auto get_thumbnail = [](ThumbnailCache& cache) {
+    ImageRef img;
+    cache.thumbnail(url)->on_complete([&](ImageRef i) { img = i; });
+    return img;
+  };
+
+  uint64_t hash;
+  {
+    ThumbnailCache cache(http_client, 16, 256, [](auto f) { f(); return true; }, make_shared<ThumbnailStore>(file.name, MiB));
+    const auto img = get_thumbnail(cache);
+    REQUIRE(img);
+    hash = img.hash();
+    REQUIRE(http_client->requests == 1);
+  }
+  {
+    // Nothing is allowed to be decoded this time
+    ThumbnailCache cache(http_client, 16, 256, [](auto) { return false; }, make_shared<ThumbnailStore>(file.name, MiB));
+    const auto img = get_thumbnail(cache);
+    REQUIRE(img);
+    CHECK(img.hash() == hash);
+    CHECK(XXH3_64bits(img.data(), img.length()) == hash);
+    CHECK(get_thumbnail(cache).hash() == hash);
+    CHECK(http_client->requests == 1);
+  }
+  std::remove(fmt::format("{}-lock", file.name).c_str());
+}
+
+TEST_CASE("thumbnail cache fetches again after its decode was refused", "[thumbnail_store]") {
+  static const string url = "https://example.test/test.jpg";
+  auto http_client = make_shared<MockHttpClient>();
+  http_client->on_get(url, 200, "image/jpeg", load_file(test_root() / "images" / "test.jpg"));
+  bool accept = false;
+  ThumbnailCache cache(http_client, 16, 256, [&](auto f) {
+    if (accept) f();
+    return accept;
+  });
+  const auto get_thumbnail = [&] {
+    optional<ImageRef> img;
+    cache.thumbnail(url)->on_complete([&](ImageRef i) { img = i; });
+    return img;
+  };
+
+  // The refused request still completes, but its failure isn't cached
+  const auto refused = get_thumbnail();
+  REQUIRE(refused);
+  CHECK_FALSE(*refused);
+  accept = true;
+  const auto img = get_thumbnail();
+  REQUIRE(img);
+  CHECK(*img);
+  CHECK(http_client->requests == 2);
+}